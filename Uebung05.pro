@@ -10,20 +10,44 @@ CONFIG += c++17
 
 SOURCES += \
     csv.cpp \
+    distance_kernel.cpp \
+    live_network.cpp \
     main_qt.cpp \
     mainwindow.cpp \
     network.cpp \
+    network_snapshot.cpp \
+    query_cache.cpp \
+    query_context.cpp \
+    reachability.cpp \
     scheduled_trip.cpp \
-    stoptimestablemodel.cpp
+    shape_index.cpp \
+    spatial_index.cpp \
+    stoptimestablemodel.cpp \
+    work_pool.cpp
 
 HEADERS += \
+    batch_query.h \
+    binary_io.h \
     config.h \
     csv.h \
+    distance_kernel.h \
+    live_network.h \
     mainwindow.h \
     network.h \
+    network_snapshot.h \
+    query_cache.h \
+    query_context.h \
+    query_options.h \
+    reachability.h \
+    realtime_update.h \
     scheduled_trip.h \
+    shape_index.h \
+    span.h \
+    spatial_index.h \
     stoptimestablemodel.h \
-    types.h
+    timetable.h \
+    types.h \
+    work_pool.h
 
 FORMS += \
     mainwindow.ui
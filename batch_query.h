@@ -0,0 +1,32 @@
+#pragma once
+#include "types.h"
+#include "query_options.h"
+#include <cstddef>
+#include <string>
+
+namespace bht {
+
+/**
+ * One query of a batch of travel plan queries, see Network::getTravelPlansDepartingAt
+ */
+typedef struct STravelPlanQuery {
+  std::string fromStopId;
+  std::string toStopId;
+  GTFSTime departureTime;
+  QueryOptions options;
+} TravelPlanQuery;
+
+/**
+ * Throughput of a batch of queries. The latency of a query is the time spent
+ * on it, queries answered by one shared search each count an equal share.
+ */
+typedef struct SBatchStatistics {
+  size_t queries;
+  size_t searches;          // searches run, less than queries when origins were shared or plans were cached
+  double seconds;           // wall clock time of the batch
+  double queriesPerSecond;
+  double p50Latency;        // median latency in seconds
+  double p99Latency;        // 99th percentile latency in seconds
+} BatchStatistics;
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace bht {
+
+/**
+ * Helpers to store plain values and vectors of plain values in binary files.
+ * Data is written in the byte order of the machine, files are meant to be
+ * read back on the same kind of machine, e.g. to cache preprocessing results.
+ */
+
+template <typename T>
+void writeValue(std::ostream& stream, const T& value) {
+  static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written");
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::istream& stream, T& value) {
+  static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read");
+  return (bool)stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void writeVector(std::ostream& stream, const std::vector<T>& values) {
+  writeValue(stream, (uint64_t)values.size());
+  stream.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool readVector(std::istream& stream, std::vector<T>& values, uint64_t maxSize) {
+  uint64_t size;
+  if (!readValue(stream, size) || size > maxSize) {
+    return false;
+  }
+  values.resize(size);
+  return (bool)stream.read(reinterpret_cast<char*>(values.data()), size * sizeof(T));
+}
+
+/**
+ * FNV-1a hash to detect changed input data
+ */
+inline uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+/// @brief Start value of hashBytes
+constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+}
@@ -0,0 +1,91 @@
+#include "distance_kernel.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BHT_DISTANCE_AVX2
+#endif
+
+namespace bht {
+
+namespace {
+
+// Meters per microdegree of latitude
+const float METERS_PER_MICRODEGREE = (float)(EARTH_RADIUS * M_PI / 180.0 * 1e-6);
+
+// Differences are taken in 32 bit two's complement so missing coordinates wrap instead of overflowing
+inline float difference(int32_t a, int32_t b) {
+  return (float)(int32_t)((uint32_t)a - (uint32_t)b);
+}
+
+void computeDistancesScalar(int32_t latitude, int32_t longitude, const int32_t* latitudes, const int32_t* longitudes,
+                            size_t count, float* meters, float scaleLatitude, float scaleLongitude) {
+  for (size_t i = 0; i < count; ++i) {
+    const float y = difference(latitudes[i], latitude) * scaleLatitude;
+    const float x = difference(longitudes[i], longitude) * scaleLongitude;
+    meters[i] = std::sqrt(x * x + y * y);
+  }
+}
+
+#if defined(__ARM_NEON)
+size_t computeDistancesNeon(int32_t latitude, int32_t longitude, const int32_t* latitudes, const int32_t* longitudes,
+                            size_t count, float* meters, float scaleLatitude, float scaleLongitude) {
+  const int32x4_t queryLatitude = vdupq_n_s32(latitude);
+  const int32x4_t queryLongitude = vdupq_n_s32(longitude);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const float32x4_t y = vmulq_n_f32(vcvtq_f32_s32(vsubq_s32(vld1q_s32(latitudes + i), queryLatitude)), scaleLatitude);
+    const float32x4_t x = vmulq_n_f32(vcvtq_f32_s32(vsubq_s32(vld1q_s32(longitudes + i), queryLongitude)), scaleLongitude);
+    vst1q_f32(meters + i, vsqrtq_f32(vmlaq_f32(vmulq_f32(x, x), y, y)));
+  }
+  return i;
+}
+#endif
+
+#if defined(BHT_DISTANCE_AVX2)
+__attribute__((target("avx2")))
+size_t computeDistancesAvx2(int32_t latitude, int32_t longitude, const int32_t* latitudes, const int32_t* longitudes,
+                            size_t count, float* meters, float scaleLatitude, float scaleLongitude) {
+  const __m256i queryLatitude = _mm256_set1_epi32(latitude);
+  const __m256i queryLongitude = _mm256_set1_epi32(longitude);
+  const __m256 factorLatitude = _mm256_set1_ps(scaleLatitude);
+  const __m256 factorLongitude = _mm256_set1_ps(scaleLongitude);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i pointLatitude = _mm256_loadu_si256((const __m256i*)(latitudes + i));
+    const __m256i pointLongitude = _mm256_loadu_si256((const __m256i*)(longitudes + i));
+    const __m256 y = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(pointLatitude, queryLatitude)), factorLatitude);
+    const __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(pointLongitude, queryLongitude)), factorLongitude);
+    _mm256_storeu_ps(meters + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y))));
+  }
+  return i;
+}
+
+const bool hasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+
+}
+
+void computeDistances(int32_t latitude, int32_t longitude, const int32_t* latitudes, const int32_t* longitudes, size_t count, float* meters) {
+  computeDistances(latitude, longitude, latitudes, longitudes, count, meters, latitude);
+}
+
+void computeDistances(int32_t latitude, int32_t longitude, const int32_t* latitudes, const int32_t* longitudes, size_t count, float* meters,
+                      int32_t referenceLatitude) {
+  const float scaleLatitude = METERS_PER_MICRODEGREE;
+  const float scaleLongitude = METERS_PER_MICRODEGREE * (float)std::cos(fromMicrodegrees(referenceLatitude) * M_PI / 180.0);
+
+  // The vector kernels handle full blocks, the scalar code the remainder
+  size_t done = 0;
+#if defined(__ARM_NEON)
+  done = computeDistancesNeon(latitude, longitude, latitudes, longitudes, count, meters, scaleLatitude, scaleLongitude);
+#elif defined(BHT_DISTANCE_AVX2)
+  if (hasAvx2) {
+    done = computeDistancesAvx2(latitude, longitude, latitudes, longitudes, count, meters, scaleLatitude, scaleLongitude);
+  }
+#endif
+  computeDistancesScalar(latitude, longitude, latitudes + done, longitudes + done, count - done, meters + done, scaleLatitude, scaleLongitude);
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+
+namespace bht {
+
+/// @brief Mean earth radius in meters
+constexpr double EARTH_RADIUS = 6371000.0;
+
+/// @brief Marker for a stop without coordinates in the coordinate tables
+constexpr int32_t MISSING_COORDINATE = INT32_MIN;
+
+/**
+ * Convert degrees to fixed point microdegrees, which keeps about 11 cm resolution
+ */
+inline int32_t toMicrodegrees(double degrees) {
+  return (int32_t)std::lround(degrees * 1e6);
+}
+
+/**
+ * Convert fixed point microdegrees to degrees
+ */
+inline double fromMicrodegrees(int32_t microdegrees) {
+  return microdegrees * 1e-6;
+}
+
+/**
+ * @brief Compute the equirectangular distance from one position to many points.
+ *
+ * Points are given as a structure of arrays so the kernel can process 8 (AVX2)
+ * or 4 (NEON) points per instruction; the instruction set is picked at runtime
+ * on x86 and falls back to scalar code elsewhere. The longitude scale is taken
+ * at the query latitude, which is accurate to a few centimeters for walking
+ * distances and stays monotonic for ranking nearby points.
+ * @param latitude Latitude of the query position in microdegrees
+ * @param longitude Longitude of the query position in microdegrees
+ * @param latitudes Latitudes of the points in microdegrees
+ * @param longitudes Longitudes of the points in microdegrees
+ * @param count Number of points
+ * @param meters Receives count distances in meters
+ */
+void computeDistances(int32_t latitude, int32_t longitude, const int32_t* latitudes, const int32_t* longitudes, size_t count, float* meters);
+
+/**
+ * @brief Compute distances like above, but with the longitude scale of a fixed reference latitude.
+ *
+ * This measures in one plane projection for all query positions, so the
+ * distances form a true metric (the triangle inequality holds exactly), as
+ * required for consistent search heuristics.
+ * @param referenceLatitude Latitude in microdegrees whose longitude scale is used
+ */
+void computeDistances(int32_t latitude, int32_t longitude, const int32_t* latitudes, const int32_t* longitudes, size_t count, float* meters,
+                      int32_t referenceLatitude);
+
+}
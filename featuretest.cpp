@@ -0,0 +1,1139 @@
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <type_traits>
+#include <gtest/gtest.h>
+#include "types.h"
+#include "network.h"
+#include "distance_kernel.h"
+#include "reachability.h"
+#include "realtime_update.h"
+
+using namespace bht;
+
+namespace {
+
+// Small feed with known answers: line L1 runs A-B-C-D-E every 10 minutes from 08:00 along
+// shape L1 (the 08:20 trip does not pick up at B) and once more after midnight at 24:05,
+// W1 leaves A westwards, N1 leaves C northwards after a 5 minute change, B1 is a
+// slow bus of another agency from A to P next to E, F1 shuttles from D to Q every 10 minutes
+// from 06:00 to 07:00 and X1 leads to a stop misplaced 29 km away. M1 runs from A to the
+// platforms S1 and S3 of station S, whose pathways lead from S1 through the hall SN to S2
+// and only one way on to S3; M2 leaves S2 for T at 09:06, 09:07 and 09:08. K1 runs from G to
+// H1 at 10:00 with a route rule for changing to K2 at H2, K3 is a slower bus from G to Z
+// and Y1 an air shuttle of extended route type 1100 from G to Z at 11:00.
+const std::string fixtureDirectory{"GTFSFixture"};
+
+// Copy the fixture feed to a temporary directory, for tests that change its files
+std::filesystem::path copyFixture(const std::string& name) {
+  namespace fs = std::filesystem;
+  const fs::path directory = fs::temp_directory_path() / name;
+  fs::remove_all(directory);
+  fs::copy(fs::path{fixtureDirectory}, directory);
+  return directory;
+}
+
+std::string readFile(const std::filesystem::path& path) {
+  std::ifstream stream(path);
+  std::stringstream content;
+  content << stream.rdbuf();
+  return content.str();
+}
+
+void writeFile(const std::filesystem::path& path, const std::string& content) {
+  std::ofstream stream(path, std::ios::trunc);
+  stream << content;
+}
+
+// Arrival at the end of a plan in seconds, -1 for an empty plan
+int arrivalOf(const std::vector<StopTime>& plan) {
+  return plan.empty() ? -1 : toSeconds(plan.back().arrivalTime);
+}
+
+// Trip of the last ride of a plan, empty for an empty plan
+std::string lastTripOf(const std::vector<StopTime>& plan) {
+  return plan.empty() ? std::string() : plan.back().tripId;
+}
+
+// Departure at the start of a plan in seconds, -1 for an empty plan
+int departureOf(const std::vector<StopTime>& plan) {
+  return plan.empty() ? -1 : toSeconds(plan.front().departureTime);
+}
+
+// Pairs of stops of a feed connected at 08:00, the test feed has many stops without service
+std::vector<std::pair<std::string, std::string>> connectedPairs(const Network& network, size_t count, unsigned int seed) {
+  std::vector<std::string> stopIds;
+  for (const auto& pair : network.stops) {
+    stopIds.push_back(pair.first);
+  }
+  std::sort(stopIds.begin(), stopIds.end());
+  std::mt19937 random(seed);
+  std::vector<std::pair<std::string, std::string>> pairs;
+  for (unsigned int attempt = 0; attempt < 20000 && pairs.size() < count; attempt++) {
+    const std::string& from = stopIds[random() % stopIds.size()];
+    const std::string& to = stopIds[random() % stopIds.size()];
+    if (from != to && !network.getTravelPlanDepartingAt(from, to, GTFSTime{.hour = 8, .minute = 0, .second = 0}).empty()) {
+      pairs.push_back({from, to});
+    }
+  }
+  return pairs;
+}
+
+// Every stop of the fixture feed, sorted
+std::vector<std::string> fixtureStops(const Network& network) {
+  std::vector<std::string> stopIds;
+  for (const auto& pair : network.stops) {
+    stopIds.push_back(pair.first);
+  }
+  std::sort(stopIds.begin(), stopIds.end());
+  return stopIds;
+}
+
+// Runs of headway based trips start at the start time and every headway after it
+// up to, but not including, the end time of frequencies.txt
+TEST(Network, frequencyRuns) {
+  const FrequencyDeparture runs{6 * 3600, 6 * 3600 + 3000, 600, 0, 0};
+  EXPECT_EQ(nextRun(runs, 0), runs.first);
+  EXPECT_EQ(nextRun(runs, runs.first), runs.first);
+  EXPECT_EQ(nextRun(runs, runs.first + 1), runs.first + 600);
+  EXPECT_EQ(nextRun(runs, runs.last), runs.last);
+  EXPECT_EQ(nextRun(runs, runs.last + 1), INFINITE_TIME);
+  EXPECT_EQ(previousRun(runs, runs.first - 1), INFINITE_TIME);
+  EXPECT_EQ(previousRun(runs, runs.first), runs.first);
+  EXPECT_EQ(previousRun(runs, runs.first + 599), runs.first);
+  EXPECT_EQ(previousRun(runs, runs.last - 1), runs.last - 600);
+  EXPECT_EQ(previousRun(runs, 24 * 3600), runs.last);
+
+  Network network{fixtureDirectory};
+  std::vector<StopTime> board = network.getDepartureBoard("fx:D", GTFSTime{.hour = 5, .minute = 0, .second = 0}, 7);
+  ASSERT_EQ(board.size(), 7u);
+  for (size_t i = 0; i < 6; i++) {
+    EXPECT_EQ(board[i].tripId, "F1");
+    EXPECT_EQ(toSeconds(board[i].departureTime), 6 * 3600 + (int)i * 600);
+  }
+  EXPECT_EQ(board[6].tripId, "L1_0800") << "07:00 is the end time, no run starts there";
+  board = network.getDepartureBoard("fx:D", GTFSTime{.hour = 6, .minute = 50, .second = 1}, 1);
+  ASSERT_EQ(board.size(), 1u);
+  EXPECT_EQ(board[0].tripId, "L1_0800");
+
+  // Offsets of later stops follow the template trip
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 45, .second = 0})), 6 * 3600 + 53 * 60);
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 50, .second = 0})), 6 * 3600 + 53 * 60);
+  EXPECT_TRUE(network.getTravelPlanDepartingAt("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 50, .second = 1}).empty());
+  EXPECT_EQ(departureOf(network.getTravelPlanArrivingBy("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 53, .second = 0})), 6 * 3600 + 50 * 60);
+  EXPECT_EQ(departureOf(network.getTravelPlanArrivingBy("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 52, .second = 59})), 6 * 3600 + 40 * 60);
+  EXPECT_TRUE(network.getTravelPlanArrivingBy("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 2, .second = 59}).empty());
+}
+
+// The A* bound must prune stops heading away from the target: W1-W3 are ready before the
+// arrival at E, but too far west to lead there in time. The misplaced stop of X1 must not
+// drag the speed of the bound down to its impossible hop.
+TEST(Network, aStarSettlesFewerStops) {
+  Network network{fixtureDirectory};
+  QueryContext context;
+  QueryOptions aStar;
+  aStar.algorithm = RoutingAlgorithm_AStar;
+  const GTFSTime departure{.hour = 8, .minute = 0, .second = 0};
+
+  const std::vector<StopTime> dijkstraPlan = network.getTravelPlanDepartingAt(context, "fx:A", "fx:E", departure);
+  const unsigned int dijkstraSettled = context.getSettledCount();
+  const std::vector<StopTime> aStarPlan = network.getTravelPlanDepartingAt(context, "fx:A", "fx:E", departure, aStar);
+  const unsigned int aStarSettled = context.getSettledCount();
+  EXPECT_EQ(arrivalOf(dijkstraPlan), 8 * 3600 + 8 * 60);
+  EXPECT_EQ(arrivalOf(aStarPlan), arrivalOf(dijkstraPlan));
+  EXPECT_LT(aStarSettled, dijkstraSettled) << "A* settled " << aStarSettled << " of " << dijkstraSettled << " stops";
+}
+
+// Decoding the delta encoded shapes gives back the points of shapes.txt in sequence order
+TEST(ShapeIndex, deltaEncoding) {
+  // Two shapes interleaved and out of order, with large and negative deltas
+  const std::vector<Shape> points = {
+    {"b", -33.868820, 151.209296, 2}, {"a", 52.500000, 13.300000, 1}, {"b", -33.867000, 151.207000, 1},
+    {"a", 52.520000, 13.410000, 3}, {"a", 52.510001, 13.349999, 2}, {"b", 51.507351, -0.127758, 3}
+  };
+  ShapeIndex index;
+  index.build(points);
+  EXPECT_EQ(index.size(), 2u);
+  EXPECT_EQ(index.pointCount(), points.size());
+  EXPECT_EQ(index.getShapeIndex("c"), INVALID_INDEX);
+  ASSERT_NE(index.getShapeIndex("a"), INVALID_INDEX);
+  EXPECT_EQ(index.getShapeId(index.getShapeIndex("b")), "b");
+
+  const std::vector<Coordinate> expected = {{52.500000, 13.300000}, {52.510001, 13.349999}, {52.520000, 13.410000}};
+  const std::vector<Coordinate> decoded = index.getPolyline("a");
+  ASSERT_EQ(decoded.size(), expected.size());
+  size_t i = 0;
+  for (const Coordinate& point : index.getShape(index.getShapeIndex("a"))) {
+    EXPECT_NEAR(point.latitude, expected[i].latitude, 1e-6);
+    EXPECT_NEAR(point.longitude, expected[i].longitude, 1e-6);
+    EXPECT_NEAR(decoded[i].latitude, expected[i].latitude, 1e-6);
+    EXPECT_NEAR(decoded[i].longitude, expected[i].longitude, 1e-6);
+    i++;
+  }
+  EXPECT_EQ(i, expected.size());
+  EXPECT_NEAR(index.getPolyline("b").back().longitude, -0.127758, 1e-6);
+
+  Network network{fixtureDirectory};
+  const std::vector<Coordinate> shape = network.getShapeForTrip("L1_0800");
+  ASSERT_EQ(shape.size(), 17u);
+  EXPECT_NEAR(shape.front().latitude, 52.5002, 1e-6);
+  EXPECT_NEAR(shape.back().longitude, 13.38, 1e-6);
+  EXPECT_TRUE(network.getShapeForTrip("W1_0801").empty()) << "Trip without shape";
+  EXPECT_TRUE(network.getShapeForTrip("unknown").empty());
+
+  // Simplifying drops the 11 m zigzag, but keeps the 200 m detour between C and D
+  const std::vector<Coordinate> simplified = network.getShapeForTrip("L1_0800", 30);
+  EXPECT_LT(simplified.size(), shape.size());
+  EXPECT_NEAR(simplified.front().longitude, shape.front().longitude, 1e-9);
+  EXPECT_NEAR(simplified.back().longitude, shape.back().longitude, 1e-9);
+  EXPECT_TRUE(std::any_of(simplified.begin(), simplified.end(), [](const Coordinate& point) { return point.latitude > 52.501; }));
+}
+
+// Stops project onto their shape in the order the trip calls at them, even on loops
+TEST(ShapeIndex, projectStops) {
+  // A square loop that ends where it starts; the last stop must land at its end
+  const std::vector<Shape> points = {
+    {"loop", 52.50, 13.30, 1}, {"loop", 52.50, 13.31, 2}, {"loop", 52.51, 13.31, 3}, {"loop", 52.51, 13.30, 4}, {"loop", 52.50, 13.30, 5}
+  };
+  ShapeIndex index;
+  index.build(points);
+  const int32_t latitudes[] = {toMicrodegrees(52.5001), toMicrodegrees(52.5001), toMicrodegrees(52.5099), toMicrodegrees(52.5001)};
+  const int32_t longitudes[] = {toMicrodegrees(13.3), toMicrodegrees(13.309), toMicrodegrees(13.305), toMicrodegrees(13.3)};
+  ShapeStop projected[4];
+  index.projectStops(index.getShapeIndex("loop"), latitudes, longitudes, 4, projected);
+  for (size_t k = 1; k < 4; k++) {
+    EXPECT_GT(projected[k].distance, projected[k - 1].distance) << "Stop " << k;
+    EXPECT_GE(projected[k].point, projected[k - 1].point) << "Stop " << k;
+  }
+  EXPECT_NEAR(projected[0].distance, 0.0f, 1.0f);
+  EXPECT_EQ(projected[3].point, 4u) << "Last stop projects onto the last segment, not the first";
+
+  // Legs of consecutive stops join up and add up to the whole ride
+  Network network{fixtureDirectory};
+  TripLeg whole;
+  ASSERT_TRUE(network.getTripLeg("L1_0800", 1, 5, whole));
+  double meters = 0;
+  for (unsigned int sequence = 1; sequence < 5; sequence++) {
+    TripLeg leg, next;
+    ASSERT_TRUE(network.getTripLeg("L1_0800", sequence, sequence + 1, leg));
+    EXPECT_GT(leg.meters, 1000.0) << "Leg from stop " << sequence;
+    for (const Coordinate& point : leg.points) {
+      EXPECT_TRUE(point.longitude >= leg.from.longitude && point.longitude <= leg.to.longitude) << "Leg from stop " << sequence;
+    }
+    if (sequence + 1 < 5 && network.getTripLeg("L1_0800", sequence + 1, sequence + 2, next)) {
+      EXPECT_NEAR(leg.to.latitude, next.from.latitude, 1e-9);
+      EXPECT_NEAR(leg.to.longitude, next.from.longitude, 1e-9);
+    }
+    meters += leg.meters;
+  }
+  EXPECT_NEAR(meters, whole.meters, 1.0);
+
+  // The detour between C and D makes the ride longer than the 1.35 km between the stops
+  TripLeg detour;
+  ASSERT_TRUE(network.getTripLeg("L1_0800", 3, 4, detour));
+  EXPECT_GT(detour.meters, 1400.0);
+  EXPECT_EQ(detour.points.size(), 4u);
+
+  TripLeg leg;
+  EXPECT_FALSE(network.getTripLeg("L1_0800", 4, 3, leg)) << "Alighting before boarding";
+  EXPECT_FALSE(network.getTripLeg("L1_0800", 1, 6, leg)) << "Unknown stop sequence";
+  EXPECT_FALSE(network.getTripLeg("W1_0801", 1, 2, leg)) << "Trip without shape";
+  EXPECT_FALSE(network.getTripLeg("unknown", 1, 2, leg));
+}
+
+// Departure boards only list stop times passengers can board, to the second
+TEST(Network, departureBoard) {
+  Network network{fixtureDirectory};
+  auto tripsOf = [](const std::vector<StopTime>& board) {
+    std::vector<std::string> tripIds;
+    for (const StopTime& stopTime : board) {
+      tripIds.push_back(stopTime.tripId);
+    }
+    return tripIds;
+  };
+
+  // Departures at the requested time are included
+  std::vector<std::string> tripIds = tripsOf(network.getDepartureBoard("fx:A", GTFSTime{.hour = 8, .minute = 0, .second = 0}, 10));
+  ASSERT_EQ(tripIds.size(), 8u);
+  std::sort(tripIds.begin(), tripIds.begin() + 2);
+  EXPECT_EQ(tripIds, (std::vector<std::string>{"B1_0800", "L1_0800", "W1_0801", "L1_0810", "L1_0820", "M1_0900", "M1_0901", "L1_2405"}));
+  EXPECT_EQ(network.getDepartureBoard("fx:A", GTFSTime{.hour = 8, .minute = 0, .second = 1}, 1).front().tripId, "W1_0801");
+  EXPECT_EQ(network.getDepartureBoard("fx:A", GTFSTime{.hour = 8, .minute = 0, .second = 0}, 2).size(), 2u);
+
+  // The last stop of a trip and stops without pickup are no departures
+  EXPECT_TRUE(network.getDepartureBoard("fx:E", GTFSTime{.hour = 0, .minute = 0, .second = 0}, 10).empty());
+  EXPECT_EQ(tripsOf(network.getDepartureBoard("fx:B", GTFSTime{.hour = 8, .minute = 15, .second = 0}, 10)), std::vector<std::string>{"L1_2405"});
+
+  // Times after midnight belong to the service day they started on
+  std::vector<StopTime> board = network.getDepartureBoard("fx:A", GTFSTime{.hour = 24, .minute = 0, .second = 0}, 10);
+  ASSERT_EQ(board.size(), 1u);
+  EXPECT_EQ(board[0].departureTime.hour, 24);
+  EXPECT_EQ(board[0].departureTime.minute, 5);
+  EXPECT_EQ(network.getDepartureBoard("fx:A", GTFSTime{.hour = 0, .minute = 5, .second = 0}, 1).front().departureTime.hour, 8);
+
+  // Route filter
+  EXPECT_EQ(tripsOf(network.getDepartureBoard("fx:A", GTFSTime{.hour = 8, .minute = 0, .second = 0}, 10, "W1")), std::vector<std::string>{"W1_0801"});
+  EXPECT_TRUE(network.getDepartureBoard("fx:A", GTFSTime{.hour = 8, .minute = 0, .second = 0}, 10, "unknown").empty());
+  EXPECT_TRUE(network.getDepartureBoard("unknown", GTFSTime{.hour = 8, .minute = 0, .second = 0}, 10).empty());
+}
+
+// Changes follow transfers.txt: stop wide minimum times, rules for routes and trips and forbidden transfers
+TEST(Network, transferRules) {
+  const GTFSTime departure{.hour = 8, .minute = 0, .second = 0};
+  Network network{fixtureDirectory};
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:N2", departure)), 8 * 3600 + 16 * 60) << "5 minutes to change at C miss the 08:05 bus";
+  EXPECT_TRUE(network.getTravelPlanArrivingBy("fx:A", "fx:N2", GTFSTime{.hour = 8, .minute = 15, .second = 0}).empty());
+
+  const std::filesystem::path directory = copyFixture("bht_transfer_rules");
+  const std::string header = "from_stop_id,to_stop_id,transfer_type,min_transfer_time,from_route_id,to_route_id,from_trip_id,to_trip_id\n";
+  const struct {
+    std::string rules;
+    int arrival;
+    const char* description;
+  } cases[] = {
+    {"", 8 * 3600 + 9 * 60, "Changing takes no time without rules"},
+    {"fx:C,fx:C,2,60,,,,\n", 8 * 3600 + 9 * 60, "One minute to change fits"},
+    {"fx:C,fx:C,2,300,,,,\nfx:C,fx:C,2,60,L1,N1,,\n", 8 * 3600 + 9 * 60, "Route rule overrides the stop time"},
+    {"fx:C,fx:C,2,300,,,,\nfx:C,fx:C,1,0,,,L1_0800,N1_0805\n", 8 * 3600 + 9 * 60, "Timed trip rule overrides the stop time"},
+    {"fx:C,fx:C,2,300,,,,\nfx:C,fx:C,2,60,L1,N1,,\nfx:C,fx:C,2,600,,,L1_0800,N1_0812\n", 8 * 3600 + 9 * 60, "Trip rule only applies to its trips"},
+    {"fx:C,fx:C,3,0,L1,N1,,\n", -1, "No transfer between the routes"},
+  };
+  for (const auto& test : cases) {
+    writeFile(directory / "transfers.txt", header + test.rules);
+    Network changed{directory.string()};
+    EXPECT_EQ(arrivalOf(changed.getTravelPlanDepartingAt("fx:A", "fx:N2", departure)), test.arrival) << test.description;
+    const std::vector<StopTime> latest = changed.getTravelPlanArrivingBy("fx:A", "fx:N2", GTFSTime{.hour = 8, .minute = 15, .second = 0});
+    EXPECT_EQ(departureOf(latest), test.arrival == -1 ? -1 : 8 * 3600) << test.description;
+  }
+  std::filesystem::remove_all(directory);
+}
+
+// The route rule from K1 to K2 allows changing from H1 to H2 in 20 seconds instead of the
+// 125 second walk, a search ordered by the walk gives up once the slower K3 reaches Z
+TEST(Network, transferRuleShorterThanFootpath) {
+  const GTFSTime departure{.hour = 10, .minute = 0, .second = 0};
+  Network network{fixtureDirectory};
+  network.preprocessLandmarks();
+  for (RoutingAlgorithm algorithm : {RoutingAlgorithm_Dijkstra, RoutingAlgorithm_AStar, RoutingAlgorithm_ALT}) {
+    QueryOptions options;
+    options.algorithm = algorithm;
+    const std::vector<StopTime> plan = network.getTravelPlanDepartingAt(QueryContext::local(), "fx:G", "fx:Z", departure, options);
+    EXPECT_EQ(lastTripOf(plan), "K2_1001") << "Algorithm " << algorithm;
+    EXPECT_EQ(arrivalOf(plan), 10 * 3600 + 2 * 60 + 10) << "Algorithm " << algorithm;
+  }
+
+  const std::vector<StopTime> latest = network.getTravelPlanArrivingBy("fx:G", "fx:Z", GTFSTime{.hour = 10, .minute = 2, .second = 10});
+  EXPECT_EQ(lastTripOf(latest), "K2_1001");
+  EXPECT_EQ(departureOf(latest), 10 * 3600);
+
+  // Walking misses K2, only K3 is left
+  const std::filesystem::path directory = copyFixture("bht_rule_footpath");
+  const std::string transfers = readFile(directory / "transfers.txt");
+  writeFile(directory / "transfers.txt", transfers.substr(0, transfers.find("fx:H1")));
+  Network walking{directory.string()};
+  EXPECT_EQ(lastTripOf(walking.getTravelPlanDepartingAt("fx:G", "fx:Z", departure)), "K3_1000");
+  std::filesystem::remove_all(directory);
+}
+
+// Stops closer than the footpath radius are connected by walking at WALKING_SPEED
+TEST(Network, footpathRadius) {
+  // P lies 100 m from E, walking there takes 84 seconds
+  Network network{fixtureDirectory};
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:P", GTFSTime{.hour = 8, .minute = 0, .second = 0})), 8 * 3600 + 8 * 60)
+      << "Ride to E and walk";
+  EXPECT_EQ(departureOf(network.getTravelPlanArrivingBy("fx:A", "fx:P", GTFSTime{.hour = 8, .minute = 9, .second = 24})), 8 * 3600);
+  EXPECT_TRUE(network.getTravelPlanArrivingBy("fx:A", "fx:P", GTFSTime{.hour = 8, .minute = 9, .second = 23}).empty());
+
+  for (double radius : {50.0, 0.0}) {
+    Network unconnected{fixtureDirectory, radius};
+    const std::vector<StopTime> plan = unconnected.getTravelPlanDepartingAt("fx:A", "fx:P", GTFSTime{.hour = 8, .minute = 0, .second = 0});
+    ASSERT_EQ(plan.size(), 2u);
+    EXPECT_EQ(plan.back().tripId, "B1_0800") << "Only the bus reaches P without walking from E, radius " << radius;
+    EXPECT_TRUE(unconnected.getTravelPlanArrivingBy("fx:A", "fx:P", GTFSTime{.hour = 8, .minute = 9, .second = 24}).empty());
+  }
+}
+
+// The grid only looks at the cells around a position, it must find the same stops as
+// computing the distance to every stop of the feed
+TEST(Network, nearestStopsMatchFullScan) {
+  Network network{"/GTFSTest"};
+  std::vector<unsigned int> ids;
+  std::vector<int32_t> latitudes, longitudes;
+  for (const auto& [id, stop] : network.stops) {
+    if (stop.latitide != 0 || stop.longitude != 0) {
+      ids.push_back(network.getStopIndex(id));
+      latitudes.push_back(toMicrodegrees(stop.latitide));
+      longitudes.push_back(toMicrodegrees(stop.longitude));
+    }
+  }
+  ASSERT_GT(ids.size(), 1000u);
+
+  std::mt19937 random(5);
+  std::vector<float> meters(ids.size());
+  for (int i = 0; i < 200; i++) {
+    // Positions around stops, and every tenth one far outside of the grid
+    const size_t near = random() % ids.size();
+    const double spread = i % 10 == 0 ? 2.0 : 0.01;
+    const double latitude = fromMicrodegrees(latitudes[near]) + spread * ((double)random() / random.max() - 0.5);
+    const double longitude = fromMicrodegrees(longitudes[near]) + spread * ((double)random() / random.max() - 0.5);
+    computeDistances(toMicrodegrees(latitude), toMicrodegrees(longitude), latitudes.data(), longitudes.data(), ids.size(), meters.data());
+
+    std::vector<StopDistance> expected;
+    for (size_t s = 0; s < ids.size(); s++) {
+      expected.push_back({ids[s], meters[s]});
+    }
+    std::sort(expected.begin(), expected.end(), [](const StopDistance& a, const StopDistance& b) {
+      return a.meters < b.meters || (a.meters == b.meters && a.stop < b.stop);
+    });
+
+    // Ties may come in any order, so the k nearest are compared by their distances
+    const size_t k = 1 + random() % 20;
+    const std::vector<StopDistance> nearest = network.nearestStops(latitude, longitude, k);
+    ASSERT_EQ(nearest.size(), k);
+    for (size_t j = 0; j < k; j++) {
+      EXPECT_EQ(nearest[j].meters, expected[j].meters) << "Position " << i << ", rank " << j;
+    }
+
+    const double radius = (double)(random() % 2000);
+    std::vector<StopDistance> within = network.stopsWithinRadius(latitude, longitude, radius);
+    std::sort(within.begin(), within.end(), [](const StopDistance& a, const StopDistance& b) {
+      return a.meters < b.meters || (a.meters == b.meters && a.stop < b.stop);
+    });
+    const size_t count = std::upper_bound(expected.begin(), expected.end(), radius, [](double r, const StopDistance& e) {
+      return r < e.meters;
+    }) - expected.begin();
+    ASSERT_EQ(within.size(), count);
+    for (size_t j = 0; j < count; j++) {
+      EXPECT_EQ(within[j].stop, expected[j].stop) << "Position " << i << ", radius " << radius;
+    }
+  }
+  EXPECT_TRUE(network.nearestStops(52.5, 13.4, 0).empty());
+  EXPECT_EQ(network.nearestStops(52.5, 13.4, ids.size() + 5).size(), ids.size());
+}
+
+// The vector kernel handles blocks of 8 or 4 points and scalar code the rest, all of
+// them must agree with the distance computed in double precision
+TEST(DistanceKernel, matchesReference) {
+  std::mt19937 random(7);
+  const double metersPerMicrodegree = EARTH_RADIUS * M_PI / 180.0 * 1e-6;
+  for (size_t count : {0, 1, 3, 7, 8, 9, 15, 17, 33, 64, 101}) {
+    const int32_t latitude = toMicrodegrees(52.5) + (int32_t)(random() % 200000) - 100000;
+    const int32_t longitude = toMicrodegrees(13.4) + (int32_t)(random() % 200000) - 100000;
+    const int32_t referenceLatitude = toMicrodegrees(52.0);
+    std::vector<int32_t> latitudes(count), longitudes(count);
+    for (size_t i = 0; i < count; i++) {
+      latitudes[i] = latitude + (int32_t)(random() % 1000000) - 500000;
+      longitudes[i] = longitude + (int32_t)(random() % 1000000) - 500000;
+    }
+    // Canary behind the last point, the kernel must not write past count
+    std::vector<float> meters(count + 1, -1.0f), projected(count + 1, -1.0f);
+    computeDistances(latitude, longitude, latitudes.data(), longitudes.data(), count, meters.data());
+    computeDistances(latitude, longitude, latitudes.data(), longitudes.data(), count, projected.data(), referenceLatitude);
+    EXPECT_EQ(meters[count], -1.0f) << count << " points";
+    EXPECT_EQ(projected[count], -1.0f) << count << " points";
+
+    for (size_t i = 0; i < count; i++) {
+      const double y = (latitudes[i] - latitude) * metersPerMicrodegree;
+      const double x = (longitudes[i] - longitude) * metersPerMicrodegree;
+      const double scale = std::cos(fromMicrodegrees(latitude) * M_PI / 180.0);
+      const double referenceScale = std::cos(fromMicrodegrees(referenceLatitude) * M_PI / 180.0);
+      const double expected = std::sqrt(x * x * scale * scale + y * y);
+      const double expectedProjected = std::sqrt(x * x * referenceScale * referenceScale + y * y);
+      EXPECT_NEAR(meters[i], expected, 1e-5 * expected + 0.01) << "Point " << i << " of " << count;
+      EXPECT_NEAR(projected[i], expectedProjected, 1e-5 * expectedProjected + 0.01) << "Point " << i << " of " << count;
+
+      // The same point on its own goes through the scalar code
+      float single = -1.0f;
+      computeDistances(latitude, longitude, &latitudes[i], &longitudes[i], 1, &single);
+      EXPECT_NEAR(single, meters[i], 1e-6 * expected + 0.001) << "Point " << i << " of " << count;
+    }
+  }
+}
+
+// Landmark bounds only prune the search, ALT must find the arrivals of Dijkstra, also
+// after writing the landmarks to a file and reading them into another network
+TEST(Network, landmarkRouting) {
+  QueryOptions alt;
+  alt.algorithm = RoutingAlgorithm_ALT;
+  QueryContext context;
+  const std::filesystem::path file = std::filesystem::temp_directory_path() / "bht_fixture.pre";
+
+  Network network{fixtureDirectory};
+  network.preprocessLandmarks(4);
+  ASSERT_TRUE(network.savePreprocessing(file.string()));
+  Network loaded{fixtureDirectory};
+  ASSERT_TRUE(loaded.loadPreprocessing(file.string()));
+  const std::vector<std::string> stopIds = fixtureStops(network);
+  unsigned int connected = 0;
+  for (const std::string& from : stopIds) {
+    for (const std::string& to : stopIds) {
+      for (unsigned char minute : {0, 5, 15}) {
+        const GTFSTime time{.hour = 8, .minute = minute, .second = 0};
+        const int expected = arrivalOf(network.getTravelPlanDepartingAt(from, to, time));
+        EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt(context, from, to, time, alt)), expected) << from << " to " << to;
+        const unsigned int settled = context.getSettledCount();
+        EXPECT_EQ(arrivalOf(loaded.getTravelPlanDepartingAt(context, from, to, time, alt)), expected) << from << " to " << to;
+        EXPECT_EQ(context.getSettledCount(), settled) << "Loaded landmarks should prune the same, " << from << " to " << to;
+        connected += expected != -1;
+      }
+    }
+  }
+  EXPECT_GT(connected, 50u);
+
+  // Landmarks of another feed version are rejected and leave the network usable
+  const std::filesystem::path directory = copyFixture("bht_landmark_fingerprint");
+  std::string stopTimes = readFile(directory / "stop_times.txt");
+  stopTimes.replace(stopTimes.find("08:08:00"), 8, "08:07:00");
+  writeFile(directory / "stop_times.txt", stopTimes);
+  Network changed{directory.string()};
+  EXPECT_FALSE(changed.loadPreprocessing(file.string()));
+  EXPECT_EQ(arrivalOf(changed.getTravelPlanDepartingAt(context, "fx:A", "fx:E", GTFSTime{.hour = 8, .minute = 0, .second = 0}, alt)),
+            8 * 3600 + 7 * 60);
+  EXPECT_FALSE(changed.loadPreprocessing((directory / "missing.pre").string()));
+
+  // A truncated file is rejected as well
+  std::filesystem::resize_file(file, std::filesystem::file_size(file) / 2);
+  Network truncated{fixtureDirectory};
+  EXPECT_FALSE(truncated.loadPreprocessing(file.string()));
+  std::filesystem::remove(file);
+  std::filesystem::remove_all(directory);
+
+  Network feed{"/GTFSTest"};
+  feed.preprocessLandmarks();
+  const std::vector<std::pair<std::string, std::string>> pairs = connectedPairs(feed, 20, 11);
+  ASSERT_GT(pairs.size(), 0u);
+  for (const auto& [from, to] : pairs) {
+    for (unsigned char hour : {6, 8, 17}) {
+      const GTFSTime time{.hour = hour, .minute = 30, .second = 0};
+      EXPECT_EQ(arrivalOf(feed.getTravelPlanDepartingAt(context, from, to, time, alt)), arrivalOf(feed.getTravelPlanDepartingAt(from, to, time)))
+          << from << " to " << to;
+    }
+  }
+}
+
+// The trip-based search scans trips over the precomputed transfers, dropping transfers
+// that never improve an arrival must not change the arrivals of Dijkstra
+TEST(Network, tripBasedRouting) {
+  QueryOptions tripBased;
+  tripBased.algorithm = RoutingAlgorithm_TripBased;
+  QueryContext context;
+
+  // Headway based trips are not ridden by the trip-based search, F1 only runs before 07:00
+  Network network{fixtureDirectory};
+  network.preprocessTripTransfers();
+  const std::vector<std::string> stopIds = fixtureStops(network);
+  unsigned int connected = 0;
+  for (const std::string& from : stopIds) {
+    for (const std::string& to : stopIds) {
+      for (unsigned char minute : {0, 5, 15, 59}) {
+        const GTFSTime time{.hour = 8, .minute = minute, .second = 0};
+        const std::vector<StopTime> expected = network.getTravelPlanDepartingAt(from, to, time);
+        const std::vector<StopTime> plan = network.getTravelPlanDepartingAt(context, from, to, time, tripBased);
+        EXPECT_EQ(arrivalOf(plan), arrivalOf(expected)) << from << " to " << to << " at 08:" << (int)minute;
+        if (!plan.empty()) {
+          EXPECT_EQ(plan.front().stopId, expected.front().stopId) << from << " to " << to;
+          EXPECT_EQ(plan.back().stopId, expected.back().stopId) << from << " to " << to;
+        }
+        connected += !expected.empty();
+      }
+    }
+  }
+  EXPECT_GT(connected, 50u);
+
+  // The change at C needs 5 minutes, so L1_0800 only connects to N1_0812
+  const std::vector<StopTime> plan = network.getTravelPlanDepartingAt(context, "fx:A", "fx:N2", GTFSTime{.hour = 8, .minute = 0, .second = 0}, tripBased);
+  ASSERT_TRUE(!plan.empty());
+  EXPECT_EQ(plan.back().tripId, "N1_0812");
+
+  Network feed{"/GTFSTest"};
+  feed.preprocessTripTransfers();
+  const std::vector<std::pair<std::string, std::string>> pairs = connectedPairs(feed, 20, 13);
+  ASSERT_GT(pairs.size(), 0u);
+  for (const auto& [from, to] : pairs) {
+    for (unsigned char hour : {6, 8, 17}) {
+      const GTFSTime time{.hour = hour, .minute = 30, .second = 0};
+      EXPECT_EQ(arrivalOf(feed.getTravelPlanDepartingAt(context, from, to, time, tripBased)), arrivalOf(feed.getTravelPlanDepartingAt(from, to, time)))
+          << from << " to " << to;
+    }
+  }
+}
+
+// An arrive-by plan leaves as late as possible: it arrives in time, and leaving one
+// second later arrives too late or not at all
+TEST(Network, arriveBy) {
+  Network network{fixtureDirectory};
+  EXPECT_EQ(departureOf(network.getTravelPlanArrivingBy("fx:A", "fx:E", GTFSTime{.hour = 8, .minute = 18, .second = 0})), 8 * 3600 + 10 * 60);
+  EXPECT_EQ(departureOf(network.getTravelPlanArrivingBy("fx:A", "fx:E", GTFSTime{.hour = 8, .minute = 17, .second = 59})), 8 * 3600);
+  EXPECT_TRUE(network.getTravelPlanArrivingBy("fx:A", "fx:E", GTFSTime{.hour = 8, .minute = 7, .second = 59}).empty());
+  // The 08:20 trip does not pick up at B
+  EXPECT_EQ(departureOf(network.getTravelPlanArrivingBy("fx:B", "fx:E", GTFSTime{.hour = 8, .minute = 30, .second = 0})), 8 * 3600 + 12 * 60);
+
+  // Plans end at the last stop ridden to without the walk from E to P, so P is left out
+  const std::vector<std::string> stopIds = fixtureStops(network);
+  unsigned int connected = 0;
+  for (const std::string& from : stopIds) {
+    for (const std::string& to : stopIds) {
+      if (to == "fx:P") {
+        continue;
+      }
+      for (unsigned char minute : {8, 14, 19, 30}) {
+        const GTFSTime deadline{.hour = 8, .minute = minute, .second = 0};
+        const std::vector<StopTime> plan = network.getTravelPlanArrivingBy(from, to, deadline);
+        if (plan.empty()) {
+          continue;
+        }
+        connected++;
+        const int departure = departureOf(plan);
+        EXPECT_LE(arrivalOf(plan), toSeconds(deadline)) << from << " to " << to;
+        const GTFSTime leave{.hour = (unsigned char)(departure / 3600), .minute = (unsigned char)(departure / 60 % 60), .second = (unsigned char)(departure % 60)};
+        EXPECT_LE(arrivalOf(network.getTravelPlanDepartingAt(from, to, leave)), toSeconds(deadline)) << from << " to " << to;
+        const GTFSTime later{.hour = leave.hour, .minute = leave.minute, .second = (unsigned char)(leave.second + 1)};
+        const int laterArrival = arrivalOf(network.getTravelPlanDepartingAt(from, to, later));
+        EXPECT_TRUE(laterArrival == -1 || laterArrival > toSeconds(deadline)) << from << " to " << to << " by 08:" << (int)minute;
+      }
+    }
+  }
+  EXPECT_GT(connected, 30u);
+}
+
+// Travel paths have the fewest stops: their length matches a plain breadth first search
+// over getNeighbors(), and every stop of a path is a neighbor of the one before
+TEST(Network, travelPathLength) {
+  Network fixture{fixtureDirectory};
+  std::vector<std::string> path;
+  for (const Stop& stop : fixture.getTravelPath("fx:W3", "fx:N2")) {
+    path.push_back(stop.id);
+  }
+  EXPECT_EQ(path, (std::vector<std::string>{"fx:W3", "fx:W2", "fx:W1", "fx:A", "fx:B", "fx:C", "fx:N1", "fx:N2"}));
+  EXPECT_TRUE(fixture.getTravelPath("fx:A", "fx:X1").empty());
+  EXPECT_TRUE(fixture.getTravelPath("fx:A", "fx:unknown").empty());
+
+  Network network{"/GTFSTest"};
+  QueryContext context;
+  std::vector<std::string> stopIds;
+  for (const auto& pair : network.stops) {
+    stopIds.push_back(pair.first);
+  }
+  std::sort(stopIds.begin(), stopIds.end());
+
+  std::mt19937 random(17);
+  unsigned int found = 0;
+  for (int i = 0; i < 30; i++) {
+    const std::string& from = stopIds[random() % stopIds.size()];
+    const unsigned int source = network.getStopIndex(from);
+    std::vector<int> hops(stopIds.size(), -1);
+    std::vector<unsigned int> queue{source};
+    hops[source] = 0;
+    for (size_t next = 0; next < queue.size(); next++) {
+      for (unsigned int neighbor : network.getNeighbors(context, network.getStopId(queue[next]))) {
+        if (hops[neighbor] == -1) {
+          hops[neighbor] = hops[queue[next]] + 1;
+          queue.push_back(neighbor);
+        }
+      }
+    }
+
+    // Half of the targets are reachable ones, if there are any
+    for (int j = 0; j < 10; j++) {
+      const std::string& to = j % 2 == 0 && queue.size() > 1 ? network.getStopId(queue[1 + random() % (queue.size() - 1)])
+                                                            : stopIds[random() % stopIds.size()];
+      if (to == from) {
+        continue;
+      }
+      const std::vector<Stop> stops = network.getTravelPath(context, from, to);
+      const int expected = hops[network.getStopIndex(to)];
+      ASSERT_EQ((int)stops.size(), expected + 1);
+      if (expected == -1) {
+        continue;
+      }
+      found++;
+      EXPECT_EQ(stops.front().id, from);
+      EXPECT_EQ(stops.back().id, to);
+      for (size_t k = 1; k < stops.size(); k++) {
+        EXPECT_EQ(network.getNeighbors(stops[k - 1].id).count(stops[k].id), 1u) << from << " to " << to << " at " << k;
+      }
+    }
+  }
+  EXPECT_GT(found, 20u);
+}
+
+// Components may only reject pairs without any path, pairs in one strongly connected
+// component or downstream of it must pass
+TEST(Reachability, neverRejectsReachablePairs) {
+  // 0 -> 1 -> 2 -> 0 form a cycle leading to 3, 4 stands alone, 5 -> 6
+  Reachability small;
+  small.build({0, 1, 2, 4, 4, 4, 5, 5}, {1, 2, 0, 3, 6});
+  EXPECT_TRUE(small.isStronglyConnected(0, 2));
+  EXPECT_FALSE(small.isStronglyConnected(2, 3));
+  EXPECT_TRUE(small.mayReach(1, 3));
+  EXPECT_FALSE(small.mayReach(3, 1));
+  EXPECT_FALSE(small.mayReach(0, 4));
+  EXPECT_FALSE(small.mayReach(0, 6));
+  EXPECT_FALSE(small.mayReach(6, 5));
+
+  std::mt19937 random(23);
+  unsigned int rejected = 0;
+  for (int graph = 0; graph < 50; graph++) {
+    const unsigned int nodeCount = 2 + random() % 40;
+    std::vector<std::vector<unsigned int>> edges(nodeCount);
+    for (unsigned int e = random() % (2 * nodeCount); e > 0; e--) {
+      edges[random() % nodeCount].push_back(random() % nodeCount);
+    }
+    std::vector<unsigned int> offsets{0}, targets;
+    for (const std::vector<unsigned int>& out : edges) {
+      targets.insert(targets.end(), out.begin(), out.end());
+      offsets.push_back(targets.size());
+    }
+    Reachability reachability;
+    reachability.build(offsets, targets);
+    for (unsigned int from = 0; from < nodeCount; from++) {
+      std::vector<bool> seen(nodeCount, false);
+      std::vector<unsigned int> stack{from};
+      seen[from] = true;
+      while (!stack.empty()) {
+        const unsigned int node = stack.back();
+        stack.pop_back();
+        for (unsigned int next : edges[node]) {
+          if (!seen[next]) {
+            seen[next] = true;
+            stack.push_back(next);
+          }
+        }
+      }
+      for (unsigned int to = 0; to < nodeCount; to++) {
+        if (seen[to]) {
+          EXPECT_TRUE(reachability.mayReach(from, to)) << "Graph " << graph << ", " << from << " to " << to;
+        }
+        rejected += !reachability.mayReach(from, to);
+      }
+    }
+  }
+  EXPECT_GT(rejected, 0u);
+}
+
+// Travel plans between stops without a connection are rejected before searching
+TEST(Network, rejectUnreachablePairs) {
+  Network network{fixtureDirectory};
+  const GTFSTime midnight{.hour = 0, .minute = 0, .second = 0};
+  for (const auto& [from, to] : std::vector<std::pair<std::string, std::string>>{{"fx:A", "fx:X1"}, {"fx:X2", "fx:X1"}, {"fx:Q", "fx:D"}}) {
+    QueryContext context;
+    EXPECT_TRUE(network.getTravelPlanDepartingAt(context, from, to, midnight).empty()) << from << " to " << to;
+    EXPECT_EQ(context.getSettledCount(), 0u) << from << " to " << to << " should be rejected without a search";
+    EXPECT_TRUE(network.getTravelPlanArrivingBy(context, from, to, GTFSTime{.hour = 23, .minute = 0, .second = 0}).empty());
+    EXPECT_EQ(context.getSettledCount(), 0u) << from << " to " << to << " should be rejected without a search";
+  }
+  QueryContext context;
+  EXPECT_FALSE(network.getTravelPlanDepartingAt(context, "fx:X1", "fx:X2", midnight).empty());
+  EXPECT_GT(context.getSettledCount(), 0u);
+
+  // Rejected pairs have no plan at any time of the day
+  const std::vector<std::string> stopIds = fixtureStops(network);
+  for (const std::string& from : stopIds) {
+    for (const std::string& to : stopIds) {
+      QueryContext fresh;
+      if (from == to || !network.getTravelPlanDepartingAt(fresh, from, to, midnight).empty() || fresh.getSettledCount() > 0) {
+        continue;
+      }
+      for (unsigned char hour = 0; hour < 26; hour += 2) {
+        EXPECT_TRUE(network.getTravelPlanDepartingAt(from, to, GTFSTime{.hour = hour, .minute = 0, .second = 0}).empty()) << from << " to " << to;
+      }
+    }
+  }
+}
+
+// Batches answer every query like a single query, whether it shares the search of its
+// origin, runs on its own with a goal directed algorithm or comes from the cache
+TEST(Network, batchMatchesSingleQueries) {
+  Network network{"/GTFSTest"};
+  network.preprocessLandmarks();
+  network.preprocessTripTransfers();
+  const std::vector<std::pair<std::string, std::string>> pairs = connectedPairs(network, 20, 19);
+  ASSERT_GT(pairs.size(), 0u);
+
+  // Every origin with the targets of all pairs, so origins are shared, plus unknown stops
+  std::vector<TravelPlanQuery> queries;
+  const RoutingAlgorithm algorithms[] = {RoutingAlgorithm_Dijkstra, RoutingAlgorithm_AStar, RoutingAlgorithm_ALT, RoutingAlgorithm_TripBased};
+  for (size_t i = 0; i < pairs.size(); i++) {
+    for (size_t j = 0; j < pairs.size(); j++) {
+      TravelPlanQuery query{pairs[i].first, pairs[j].second, GTFSTime{.hour = 8, .minute = 0, .second = 0}, QueryOptions()};
+      query.options.algorithm = algorithms[(i + j) % 4];
+      queries.push_back(query);
+    }
+  }
+  queries.push_back({"unknown", pairs[0].second, GTFSTime{.hour = 8, .minute = 0, .second = 0}, QueryOptions()});
+  queries.push_back({pairs[0].first, "unknown", GTFSTime{.hour = 8, .minute = 0, .second = 0}, QueryOptions()});
+  queries.push_back({pairs[0].first, pairs[0].first, GTFSTime{.hour = 8, .minute = 0, .second = 0}, QueryOptions()});
+
+  QueryContext context;
+  std::vector<int> expected;
+  for (const TravelPlanQuery& query : queries) {
+    expected.push_back(arrivalOf(network.getTravelPlanDepartingAt(context, query.fromStopId, query.toStopId, query.departureTime, query.options)));
+  }
+  auto expectSame = [&](const std::vector<std::vector<StopTime>>& plans, const std::string& description) {
+    ASSERT_EQ(plans.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+      EXPECT_EQ(arrivalOf(plans[i]), expected[i]) << description << ": " << queries[i].fromStopId << " to " << queries[i].toStopId;
+    }
+  };
+
+  BatchStatistics statistics;
+  expectSame(network.getTravelPlansDepartingAt(queries, &statistics, 4), "uncached");
+  EXPECT_LT(statistics.searches, queries.size());
+
+  network.enableQueryCache();
+  expectSame(network.getTravelPlansDepartingAt(queries, &statistics, 4), "filling the cache");
+  expectSame(network.getTravelPlansDepartingAt(queries, &statistics, 4), "cached");
+  EXPECT_EQ(statistics.searches, 0u) << "All plans should come from the cache";
+  EXPECT_GT(network.getQueryCacheStatistics().hits, 0u);
+  network.disableQueryCache();
+
+  // Only Dijkstra queries share the search of their origin
+  Network fixture{fixtureDirectory};
+  for (RoutingAlgorithm algorithm : algorithms) {
+    std::vector<TravelPlanQuery> shared;
+    for (const char* to : {"fx:C", "fx:E", "fx:N2"}) {
+      shared.push_back({"fx:A", to, GTFSTime{.hour = 8, .minute = 0, .second = 0}, QueryOptions()});
+      shared.back().options.algorithm = algorithm;
+    }
+    const std::vector<std::vector<StopTime>> plans = fixture.getTravelPlansDepartingAt(shared, &statistics, 1);
+    EXPECT_EQ(statistics.searches, algorithm == RoutingAlgorithm_Dijkstra ? 1u : 3u) << "Algorithm " << (int)algorithm;
+    EXPECT_EQ(arrivalOf(plans[2]), 8 * 3600 + 16 * 60) << "Algorithm " << (int)algorithm;
+  }
+}
+
+// Real-time delays move the trips they are given for from their stop on, cancellations
+// take trips out, later updates of a trip replace earlier ones and clearing restores
+// the timetable
+TEST(Network, realtimeUpdates) {
+  Network network{fixtureDirectory};
+  const GTFSTime eight{.hour = 8, .minute = 0, .second = 0};
+  auto update = [](const std::string& tripId, unsigned int stopSequence, const std::string& stopId, int delay, bool canceled = false) {
+    return TripUpdate{tripId, stopSequence, stopId, delay, delay, canceled};
+  };
+  auto boardAt = [&](const std::string& stopId, const GTFSTime& time) {
+    std::vector<std::string> trips;
+    for (const StopTime& stopTime : network.getDepartureBoard(stopId, time, 3)) {
+      trips.push_back(stopTime.tripId + "@" + std::to_string(toSeconds(stopTime.departureTime) / 60 - 8 * 60));
+    }
+    return trips;
+  };
+  ASSERT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:E", eight)), 8 * 3600 + 8 * 60);
+  const std::vector<std::string> timetable = boardAt("fx:A", eight);
+
+  // Five minutes late from C on, the departure at A stays on time
+  EXPECT_EQ(network.applyRealtimeUpdates({update("L1_0800", INVALID_INDEX, "fx:C", 300)}), 1u);
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:E", eight)), 8 * 3600 + 13 * 60);
+  EXPECT_EQ(departureOf(network.getTravelPlanDepartingAt("fx:A", "fx:E", eight)), 8 * 3600);
+  EXPECT_EQ(boardAt("fx:C", eight), (std::vector<std::string>{"N1_0805@5", "L1_0800@9", "N1_0812@12"}));
+  EXPECT_EQ(network.applyRealtimeUpdates({update("L1_0800", INVALID_INDEX, "fx:C", 300)}), 0u) << "The same update again changes nothing";
+
+  // The same delay given by stop sequence, and a vehicle one minute early
+  network.clearRealtimeUpdates();
+  EXPECT_EQ(network.applyRealtimeUpdates({update("L1_0800", 3, "", 300), update("L1_0810", INVALID_INDEX, "fx:D", -60)}), 2u);
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:E", eight)), 8 * 3600 + 13 * 60);
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:E", GTFSTime{.hour = 8, .minute = 1, .second = 0})), 8 * 3600 + 17 * 60);
+
+  // A cancellation replaces the delay, the next trip takes over
+  EXPECT_EQ(network.applyRealtimeUpdates({update("L1_0800", INVALID_INDEX, "", 0, true)}), 1u);
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:E", eight)), 8 * 3600 + 17 * 60);
+  EXPECT_EQ(boardAt("fx:A", eight), (std::vector<std::string>{"B1_0800@0", "W1_0801@1", "L1_0810@10"}));
+  EXPECT_EQ(network.applyRealtimeUpdates({update("unknown", INVALID_INDEX, "", 600)}), 0u);
+
+  // Headway based trips can be canceled but not delayed
+  network.clearRealtimeUpdates();
+  network.applyRealtimeUpdates({update("F1", INVALID_INDEX, "", 120)});
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 0, .second = 0})), 6 * 3600 + 3 * 60);
+  network.applyRealtimeUpdates({update("F1", INVALID_INDEX, "", 0, true)});
+  EXPECT_TRUE(network.getTravelPlanDepartingAt("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 0, .second = 0}).empty());
+
+  network.clearRealtimeUpdates();
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:E", eight)), 8 * 3600 + 8 * 60);
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:D", "fx:Q", GTFSTime{.hour = 6, .minute = 0, .second = 0})), 6 * 3600 + 3 * 60);
+  EXPECT_EQ(boardAt("fx:A", eight), timetable);
+
+  // Updates drop the trip transfers, the trip-based search falls back until they are rebuilt
+  QueryContext context;
+  QueryOptions tripBased;
+  tripBased.algorithm = RoutingAlgorithm_TripBased;
+  network.preprocessTripTransfers();
+  network.applyRealtimeUpdates({update("L1_0800", INVALID_INDEX, "fx:C", 300)});
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt(context, "fx:A", "fx:E", eight, tripBased)), 8 * 3600 + 13 * 60);
+  network.preprocessTripTransfers();
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt(context, "fx:A", "fx:E", eight, tripBased)), 8 * 3600 + 13 * 60);
+  EXPECT_TRUE(network.getTravelPlanDepartingAt(context, "fx:A", "fx:N2", eight, tripBased).empty())
+      << "Five minutes late at C, L1_0800 misses N1_0812";
+}
+
+// Reloading reads only the changed files, rebuilds what depends on them and answers
+// like a network loaded from scratch
+TEST(Network, reloadChangedFiles) {
+  const std::filesystem::path directory = copyFixture("bht_fixture_reload");
+  Network network{directory.string()};
+  const GTFSTime eight{.hour = 8, .minute = 0, .second = 0};
+  auto replace = [&](const std::string& name, const std::string& from, const std::string& to) {
+    std::string content = readFile(directory / name);
+    content.replace(content.find(from), from.size(), to);
+    writeFile(directory / name, content);
+  };
+  // Real-time updates the reloaded network still holds, applied to the full load as well
+  std::vector<TripUpdate> updates;
+  auto expectSameAsFullLoad = [&](const std::string& step) {
+    Network full{directory.string()};
+    full.applyRealtimeUpdates(updates);
+    EXPECT_EQ(network.stops.size(), full.stops.size()) << step;
+    EXPECT_EQ(network.trips.size(), full.trips.size()) << step;
+    EXPECT_EQ(network.stopTimes.size(), full.stopTimes.size()) << step;
+    EXPECT_EQ(network.calendarDates.size(), full.calendarDates.size()) << step;
+    EXPECT_EQ(network.transfers.size(), full.transfers.size()) << step;
+    const std::vector<std::string> stopIds = fixtureStops(full);
+    for (unsigned char hour : {8, 9, 10}) {
+      const GTFSTime departure{.hour = hour, .minute = 0, .second = 0};
+      for (const std::string& from : stopIds) {
+        for (const std::string& to : stopIds) {
+          const std::vector<StopTime> expected = full.getTravelPlanDepartingAt(from, to, departure);
+          const std::vector<StopTime> plan = network.getTravelPlanDepartingAt(from, to, departure);
+          EXPECT_EQ(arrivalOf(plan), arrivalOf(expected)) << step << ": " << from << " to " << to << " at " << (int)hour;
+          EXPECT_EQ(lastTripOf(plan), lastTripOf(expected)) << step << ": " << from << " to " << to << " at " << (int)hour;
+        }
+      }
+    }
+  };
+  EXPECT_TRUE(network.reload(directory.string()).empty());
+
+  // Calendars feed no index, the plans stay the same
+  replace("calendar.txt", "20241231", "20251231");
+  EXPECT_EQ(network.reload(directory.string()), std::vector<std::string>{"calendar.txt"});
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:N2", eight)), 8 * 3600 + 16 * 60);
+  writeFile(directory / "calendar_dates.txt", readFile(directory / "calendar_dates.txt") + "daily,20240101,2\n");
+  EXPECT_EQ(network.reload(directory.string()), std::vector<std::string>{"calendar_dates.txt"});
+  expectSameAsFullLoad("calendar_dates.txt");
+
+  // Without the minimum change time at C the earlier connection is caught; preprocessing
+  // is dropped, real-time updates are kept
+  network.preprocessLandmarks();
+  updates.push_back(TripUpdate{"W1_0801", INVALID_INDEX, "", 60, 60, false});
+  network.applyRealtimeUpdates(updates);
+  replace("transfers.txt", "fx:C,fx:C,2,300", "fx:C,fx:C,2,0");
+  EXPECT_EQ(network.reload(directory.string()), std::vector<std::string>{"transfers.txt"});
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:N2", eight)), 8 * 3600 + 9 * 60);
+  QueryContext context;
+  QueryOptions alt;
+  alt.algorithm = RoutingAlgorithm_ALT;
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt(context, "fx:A", "fx:N2", eight, alt)), 8 * 3600 + 9 * 60);
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:W3", eight)), 8 * 3600 + 8 * 60) << "W1_0801 is still late";
+  expectSameAsFullLoad("transfers.txt");
+
+  // New shape points only move the legs
+  TripLeg before, after;
+  ASSERT_TRUE(network.getTripLeg("L1_0800", 1, 5, before));
+  replace("shapes.txt", "L1,52.502000,13.345000", "L1,52.504000,13.345000");
+  EXPECT_EQ(network.reload(directory.string()), std::vector<std::string>{"shapes.txt"});
+  ASSERT_TRUE(network.getTripLeg("L1_0800", 1, 5, after));
+  EXPECT_GT(after.meters, before.meters + 100);
+  expectSameAsFullLoad("shapes.txt");
+
+  // Changed times rebuild everything and drop the real-time updates
+  replace("stop_times.txt", "L1_0800,08:08:00,08:08:00", "L1_0800,08:07:00,08:07:00");
+  EXPECT_EQ(network.reload(directory.string()), std::vector<std::string>{"stop_times.txt"});
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:E", eight)), 8 * 3600 + 7 * 60);
+  EXPECT_EQ(arrivalOf(network.getTravelPlanDepartingAt("fx:A", "fx:W3", eight)), 8 * 3600 + 7 * 60);
+  updates.clear();
+  expectSameAsFullLoad("stop_times.txt");
+  Network fresh{directory.string()};
+  ASSERT_TRUE(fresh.getTripLeg("L1_0800", 1, 5, before));
+  EXPECT_EQ(before.meters, after.meters);
+
+  // Dropped trips rebuild the timetable, their stop times are left without a trip
+  replace("trips.txt", "K2,daily,K2_1001,Fixture Z,,0,,,0,0\n", "");
+  EXPECT_EQ(network.reload(directory.string()), std::vector<std::string>{"trips.txt"});
+  EXPECT_EQ(lastTripOf(network.getTravelPlanDepartingAt("fx:G", "fx:Z", GTFSTime{.hour = 10, .minute = 0, .second = 0})), "K3_1000");
+  expectSameAsFullLoad("trips.txt");
+  std::filesystem::remove_all(directory);
+}
+
+// Filters restrict the trips a plan may ride; the agency table compiled for a query is
+// reused by later queries of the context only for the same agencies and network version
+TEST(Network, tripFilters) {
+  Network network{fixtureDirectory};
+  QueryContext context;
+  const GTFSTime eight{.hour = 8, .minute = 0, .second = 0};
+  auto plan = [&](const Network& on, const std::string& to, const QueryOptions& options) {
+    return on.getTravelPlanDepartingAt(context, "fx:A", to, eight, options);
+  };
+  QueryOptions options;
+  EXPECT_EQ(lastTripOf(plan(network, "fx:P", options)), "L1_0800");
+
+  options.modes = TransportMode_Bus;
+  EXPECT_EQ(lastTripOf(plan(network, "fx:P", options)), "B1_0800");
+  EXPECT_EQ(arrivalOf(plan(network, "fx:P", options)), 8 * 3600 + 20 * 60);
+  options.modes = TransportMode_Rail;
+  EXPECT_EQ(arrivalOf(plan(network, "fx:P", options)), 8 * 3600 + 8 * 60);
+  options.modes = TransportMode_Tram;
+  EXPECT_TRUE(plan(network, "fx:E", options).empty());
+
+  // Only the coach and bus blocks of the extended route types travel by bus, the air
+  // shuttle Y1 of type 1100 is left to TransportMode_Other
+  EXPECT_EQ(getTransportMode(200), TransportMode_Bus);
+  EXPECT_EQ(getTransportMode(715), TransportMode_Bus);
+  EXPECT_EQ(getTransportMode(1100), TransportMode_Other);
+  EXPECT_EQ(getTransportMode(1500), TransportMode_Other);
+  EXPECT_EQ(getTransportMode(1234567), TransportMode_Other);
+  const GTFSTime eleven{.hour = 11, .minute = 0, .second = 0};
+  options.modes = TransportMode_All;
+  EXPECT_EQ(lastTripOf(network.getTravelPlanDepartingAt(context, "fx:G", "fx:Z", eleven, options)), "Y1_1100");
+  options.modes = TransportMode_Other;
+  EXPECT_EQ(lastTripOf(network.getTravelPlanDepartingAt(context, "fx:G", "fx:Z", eleven, options)), "Y1_1100");
+  options.modes = TransportMode_Bus;
+  EXPECT_TRUE(network.getTravelPlanDepartingAt(context, "fx:G", "fx:Z", eleven, options).empty());
+  options.modes = TransportMode_All & ~TransportMode_Other;
+  EXPECT_TRUE(network.getTravelPlanDepartingAt(context, "fx:G", "fx:Z", eleven, options).empty());
+
+  // L1_0800 is not wheelchair accessible and no L1 trip but L1_0810 takes bikes
+  options = QueryOptions();
+  options.wheelchairAccessible = true;
+  EXPECT_EQ(lastTripOf(plan(network, "fx:E", options)), "L1_0810");
+  options = QueryOptions();
+  options.bikesAllowed = true;
+  EXPECT_EQ(arrivalOf(plan(network, "fx:E", options)), 8 * 3600 + 18 * 60);
+  EXPECT_EQ(departureOf(network.getTravelPlanArrivingBy(context, "fx:A", "fx:E", GTFSTime{.hour = 8, .minute = 30, .second = 0}, options)),
+            8 * 3600 + 10 * 60);
+
+  // Switching agencies on one context
+  options = QueryOptions();
+  options.agencyIds = {"bus"};
+  EXPECT_EQ(lastTripOf(plan(network, "fx:P", options)), "B1_0800");
+  options.agencyIds = {"rail"};
+  EXPECT_EQ(lastTripOf(plan(network, "fx:P", options)), "L1_0800");
+  options.agencyIds = {"bus"};
+  EXPECT_EQ(lastTripOf(plan(network, "fx:P", options)), "B1_0800");
+  options.agencyIds = {"unknown"};
+  EXPECT_TRUE(plan(network, "fx:P", options).empty());
+  options.agencyIds = {"unknown", "rail"};
+  EXPECT_EQ(arrivalOf(plan(network, "fx:E", options)), 8 * 3600 + 8 * 60);
+
+  // Another network where bus is unknown and coach takes its dense index
+  const std::filesystem::path directory = copyFixture("bht_fixture_agencies");
+  std::string agencies = readFile(directory / "agency.txt");
+  agencies.replace(agencies.find("bus,"), 4, "coach,");
+  writeFile(directory / "agency.txt", agencies);
+  std::string routes = readFile(directory / "routes.txt");
+  for (size_t at = routes.find(",bus,"); at != std::string::npos; at = routes.find(",bus,")) {
+    routes.replace(at, 5, ",coach,");
+  }
+  writeFile(directory / "routes.txt", routes);
+  Network renamed{directory.string()};
+  options.agencyIds = {"bus"};
+  EXPECT_EQ(lastTripOf(plan(network, "fx:P", options)), "B1_0800");
+  EXPECT_TRUE(plan(renamed, "fx:P", options).empty()) << "The table of the other network must not be reused";
+  options.agencyIds = {"coach"};
+  EXPECT_EQ(lastTripOf(plan(renamed, "fx:P", options)), "B1_0800");
+  std::filesystem::remove_all(directory);
+}
+
+// The views point into the tables of the network and hold what the copying methods return
+TEST(Network, viewsMatchCopies) {
+  Network network{"/GTFSTest"};
+  auto idsOf = [](const auto& items) {
+    std::vector<std::string> ids;
+    for (const auto& item : items) {
+      if constexpr (std::is_pointer_v<std::decay_t<decltype(item)>>) {
+        ids.push_back(item->id);
+      } else {
+        ids.push_back(item.id);
+      }
+    }
+    return ids;
+  };
+
+  const std::vector<Route> routes = network.getRoutes();
+  ASSERT_GT(routes.size(), 0u);
+  EXPECT_EQ(idsOf(network.viewRoutes()), idsOf(routes));
+  std::mt19937 random(29);
+  for (int i = 0; i < 50; i++) {
+    const Route& route = routes[random() % routes.size()];
+    EXPECT_EQ(network.findRoute(route.id), &network.routes.at(route.id));
+    const std::vector<Trip> trips = network.getTripsForRoute(route.id);
+    EXPECT_EQ(idsOf(network.viewTripsForRoute(route.id)), idsOf(trips)) << "Route " << route.id;
+    if (trips.empty()) {
+      continue;
+    }
+
+    // The copies leave out stop times of stops missing in stops.txt
+    const Trip& trip = trips[random() % trips.size()];
+    ASSERT_TRUE(network.findTrip(trip.id) != nullptr);
+    EXPECT_EQ(network.findTrip(trip.id)->id, trip.id);
+    std::vector<StopTime> viewed;
+    for (const StopTime& stopTime : network.viewStopTimesForTrip(trip.id)) {
+      if (network.findStop(stopTime.stopId) != nullptr) {
+        viewed.push_back(stopTime);
+      }
+    }
+    const std::vector<StopTime> copied = network.getStopTimesForTrip(trip.id);
+    ASSERT_EQ(viewed.size(), copied.size());
+    for (size_t k = 0; k < copied.size(); k++) {
+      EXPECT_EQ(viewed[k].stopId, copied[k].stopId) << "Trip " << trip.id;
+      EXPECT_EQ(viewed[k].stopSequence, copied[k].stopSequence) << "Trip " << trip.id;
+      EXPECT_EQ(toSeconds(viewed[k].arrivalTime), toSeconds(copied[k].arrivalTime)) << "Trip " << trip.id;
+      EXPECT_EQ(toSeconds(viewed[k].departureTime), toSeconds(copied[k].departureTime)) << "Trip " << trip.id;
+    }
+  }
+  EXPECT_TRUE(network.findRoute("unknown") == nullptr);
+  EXPECT_TRUE(network.findTrip("unknown") == nullptr);
+  EXPECT_TRUE(network.findStop("unknown") == nullptr);
+  EXPECT_TRUE(network.viewTripsForRoute("unknown").empty());
+  EXPECT_TRUE(network.viewStopTimesForTrip("unknown").empty());
+
+  std::vector<std::string> stopIds;
+  for (const auto& pair : network.stops) {
+    stopIds.push_back(pair.first);
+  }
+  std::sort(stopIds.begin(), stopIds.end());
+  std::vector<const Stop*> viewed;
+  for (int i = 0; i < 50; i++) {
+    const std::string& stopId = stopIds[random() % stopIds.size()];
+    EXPECT_EQ(network.findStop(stopId), &network.stops.at(stopId));
+    EXPECT_EQ(network.getStopById(stopId).name, network.findStop(stopId)->name);
+    network.getStopsForTransfer(stopId, viewed);
+    EXPECT_EQ(idsOf(viewed), idsOf(network.getStopsForTransfer(stopId))) << "Stop " << stopId;
+  }
+  for (const std::string& needle : std::vector<std::string>{"Bahnhof", "hauptbahnhof", "S ", "Alex", "xyz-nothing", ""}) {
+    network.search(std::string_view(needle), viewed);
+    EXPECT_EQ(idsOf(viewed), idsOf(network.search(needle))) << "Search " << needle;
+  }
+}
+
+// Changing platforms inside a station with pathways.txt takes the shortest walk through its
+// pathways: 60 seconds from S1 to the hall and 100 m at WALKING_SPEED on to S2, instead of
+// the free change within a station or the walk of the footpath radius
+TEST(Network, stationPathways) {
+  for (double radius : {DEFAULT_FOOTPATH_RADIUS, 0.0}) {
+    Network network{fixtureDirectory, radius};
+    const std::vector<StopTime> plan = network.getTravelPlanDepartingAt("fx:A", "fx:T", GTFSTime{.hour = 9, .minute = 0, .second = 0});
+    EXPECT_EQ(lastTripOf(plan), "M2_0908") << "Radius " << radius;
+    EXPECT_EQ(arrivalOf(plan), 9 * 3600 + 15 * 60) << "Radius " << radius;
+    EXPECT_TRUE(network.getTravelPlanArrivingBy("fx:A", "fx:T", GTFSTime{.hour = 9, .minute = 14, .second = 0}).empty()) << "Radius " << radius;
+
+    // Leaving S1 144 seconds before a departure at S2 still catches it
+    EXPECT_EQ(lastTripOf(network.getTravelPlanDepartingAt("fx:S1", "fx:T", GTFSTime{.hour = 9, .minute = 4, .second = 36})), "M2_0907");
+    EXPECT_EQ(lastTripOf(network.getTravelPlanDepartingAt("fx:S1", "fx:T", GTFSTime{.hour = 9, .minute = 4, .second = 37})), "M2_0908");
+
+    // The pathway to S3 is one way, nothing leads back to S2 although it is within the radius
+    EXPECT_TRUE(network.getTravelPlanDepartingAt("fx:S3", "fx:T", GTFSTime{.hour = 9, .minute = 0, .second = 0}).empty()) << "Radius " << radius;
+    EXPECT_TRUE(network.getTravelPlanDepartingAt("fx:S3", "fx:S2", GTFSTime{.hour = 9, .minute = 0, .second = 0}).empty()) << "Radius " << radius;
+  }
+
+  // transfers.txt still overrides the pathways
+  const std::filesystem::path directory = copyFixture("bht_fixture_pathways");
+  writeFile(directory / "transfers.txt", readFile(directory / "transfers.txt") + "fx:S3,fx:S2,2,60,,,,\nfx:S1,fx:S2,2,0,,,,\n");
+  Network overridden{directory.string()};
+  EXPECT_EQ(lastTripOf(overridden.getTravelPlanDepartingAt("fx:S3", "fx:T", GTFSTime{.hour = 9, .minute = 5, .second = 0})), "M2_0906");
+  EXPECT_EQ(arrivalOf(overridden.getTravelPlanDepartingAt("fx:A", "fx:T", GTFSTime{.hour = 9, .minute = 0, .second = 0})), 9 * 3600 + 13 * 60);
+  std::filesystem::remove_all(directory);
+}
+
+} // namespace
@@ -0,0 +1,53 @@
+#include "live_network.h"
+#include <exception>
+
+namespace bht {
+
+LiveNetwork::LiveNetwork(NetworkSnapshot snapshot)
+    : network(snapshot.share()) {
+}
+
+LiveNetwork::~LiveNetwork() {
+    std::lock_guard<std::mutex> lock(reloadMutex);
+    if (reloadThread.joinable()) {
+        reloadThread.join();
+    }
+}
+
+NetworkSnapshot LiveNetwork::current() const {
+    return NetworkSnapshot(std::atomic_load(&network));
+}
+
+void LiveNetwork::publish(NetworkSnapshot snapshot) {
+    std::atomic_store(&network, snapshot.share());
+}
+
+std::future<bool> LiveNetwork::reload(const std::string& directory, double footpathRadius, const std::function<void(Network&)>& prepare) {
+    std::lock_guard<std::mutex> lock(reloadMutex);
+    if (reloadThread.joinable()) {
+        reloadThread.join();
+    }
+
+    std::promise<bool> done;
+    std::future<bool> result = done.get_future();
+    reloadThread = std::thread([this, directory, footpathRadius, prepare](std::promise<bool> done) {
+        // Readers keep using the current network while the new one is read
+        bool published = false;
+        try {
+            Network loaded(directory, footpathRadius);
+            if (!loaded.stops.empty()) {
+                if (prepare) {
+                    prepare(loaded);
+                }
+                publish(NetworkSnapshot(std::move(loaded)));
+                published = true;
+            }
+        } catch (const std::exception&) {
+            // Malformed feeds keep the current network
+        }
+        done.set_value(published);
+    }, std::move(done));
+    return result;
+}
+
+}
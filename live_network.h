@@ -0,0 +1,67 @@
+#pragma once
+#include "network_snapshot.h"
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace bht {
+
+/**
+ * Network that can be replaced by a new feed while it is being queried.
+ *
+ * Readers take the current snapshot with current() and run their queries
+ * on it. reload() reads the new feed on a background thread and publishes
+ * it with an atomic pointer swap, so readers never wait for a reload: queries
+ * that already hold the old snapshot finish on it, new ones get the new
+ * network, and the old network is freed once the last reader drops it.
+ */
+class LiveNetwork {
+  private:
+    std::shared_ptr<const Network> network; // only accessed through std::atomic_load and std::atomic_store
+    std::mutex reloadMutex; // guards reloadThread
+    std::thread reloadThread; // thread of the last reload, joined before the next one starts
+
+  public:
+    /**
+     * Serve an already loaded network
+     */
+    explicit LiveNetwork(NetworkSnapshot snapshot);
+
+    /**
+     * Wait for a running reload to finish
+     */
+    ~LiveNetwork();
+
+    LiveNetwork(const LiveNetwork&) = delete;
+    LiveNetwork& operator=(const LiveNetwork&) = delete;
+
+    /**
+     * @brief Return the network to run the next queries on, keep the snapshot for all
+     * queries that have to see the same data. Never blocks.
+     */
+    NetworkSnapshot current() const;
+
+    /**
+     * @brief Replace the network for all following calls of current()
+     * @param snapshot New network
+     */
+    void publish(NetworkSnapshot snapshot);
+
+    /**
+     * @brief Read a feed on a background thread and publish it once it is complete.
+     * Only one reload runs at a time, a second call waits for the running one first.
+     * @param directory Directory containing the GTFS files
+     * @param footpathRadius Maximum walking distance between stops in meters
+     * @param prepare Called with the new network before it is published, e.g. to preprocess
+     * landmarks or enable the query cache
+     * @return Becomes true once the new network is published, false if the feed could not be
+     * read or has no stops, in which case the current network stays in place
+     */
+    std::future<bool> reload(const std::string& directory, double footpathRadius = DEFAULT_FOOTPATH_RADIUS,
+                             const std::function<void(Network&)>& prepare = nullptr);
+};
+
+}
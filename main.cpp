@@ -1,11 +1,11 @@
-#include "network.h"
+#include "network_snapshot.h"
 #include "scheduled_trip.h"
 #include <iostream>
 
 int main(int argc, char **argv) {
-  bht::Network n{argv[1]};
-  bht::NetworkScheduledTrip trip = n.getScheduledTrip("230419258");
+  bht::NetworkSnapshot n = bht::NetworkSnapshot::load(argv[1]);
+  bht::NetworkScheduledTrip trip = n->getScheduledTrip("230419258");
   for (bht::NetworkScheduledTrip::iterator iter = trip.begin(); iter != trip.end(); iter++) {
-    std::cout << iter->stopSequence << ": " << n.stops[iter->stopId].name << std::endl;
+    std::cout << iter->stopSequence << ": " << n->getStopById(iter->stopId).name << std::endl;
   }
 }
\ No newline at end of file
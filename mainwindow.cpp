@@ -34,9 +34,9 @@ MainWindow::MainWindow(QWidget *parent)
     ui->toStopComboBox->setModel(&toStopsModel);
 
     // Setup displayed routes
-    for (auto &item : myNetwork.getRoutes()) {
-        std::string displayName = myNetwork.getRouteDisplayName(item);
-        routes.push_back(std::make_pair(item.id, displayName));
+    for (const bht::Route *item : myNetwork.viewRoutes()) {
+        std::string displayName = myNetwork.getRouteDisplayName(*item);
+        routes.push_back(std::make_pair(item->id, displayName));
     }
 
     // Sort the results by name
@@ -90,14 +90,14 @@ void MainWindow::on_routeComboBox_currentIndexChanged(int index) {
     std::cout << "DEBUG: Selected route ID: " << routeId << std::endl;
 
     // Find trips for the selected route
-    auto tripsForRoute = myNetwork.getTripsForRoute(routeId);
+    auto tripsForRoute = myNetwork.viewTripsForRoute(routeId);
     std::cout << "DEBUG: Found " << tripsForRoute.size() << " trips for route" << std::endl;
     
     trips.clear();
-    for (auto &item : tripsForRoute) {
-        std::string displayName = myNetwork.getTripDisplayName(item);
-        trips.push_back(std::make_pair(item.id, displayName));
-        std::cout << "DEBUG: Trip: " << item.id << " - " << displayName << std::endl;
+    for (const bht::Trip *item : tripsForRoute) {
+        std::string displayName = myNetwork.getTripDisplayName(*item);
+        trips.push_back(std::make_pair(item->id, displayName));
+        std::cout << "DEBUG: Trip: " << item->id << " - " << displayName << std::endl;
     }
 
     // Clear and reset UI - UTILISE LE MODÈLE FAHRPLAN
@@ -175,7 +175,7 @@ void MainWindow::on_calculateRouteButton_clicked() {
     };
     
     // Calculate route
-    auto travelPlan = myNetwork.getTravelPlanDepartingAt(fromStopId, toStopId, gtfsDepartureTime);
+    auto travelPlan = myNetwork.getTravelPlanDepartingAt(queryContext, fromStopId, toStopId, gtfsDepartureTime);
     
     if (travelPlan.empty()) {
         QMessageBox::information(this, "Keine Route gefunden", 
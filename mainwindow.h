@@ -43,6 +43,9 @@ private:
     /// The network we fetched
     bht::Network myNetwork;
 
+    /// Working memory reused by the route calculations of the UI thread
+    bht::QueryContext queryContext;
+
     /// Model for displayed routes
     QStringListModel routesModel;
 
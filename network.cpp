@@ -1,154 +1,2396 @@
 #include "network.h"
 #include "csv.h"
+#include "binary_io.h"
 #include <algorithm>
-#include <queue>
 #include <unordered_map>
 #include <unordered_set>
 #include <iostream>
 #include <tuple>
 #include <cctype>
 #include <locale>
+#include <cmath>
+#include <functional>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 
 namespace bht {
 
-Network::Network(std::string directory) {
-  // Fetch data
-  readAgencies(directory + "/agency.txt");
-  readCalendarDates(directory + "/calendar_dates.txt");
-  readCalendars(directory + "/calendar.txt");
-  readLevels(directory + "/levels.txt");
-  readPathways(directory + "/pathways.txt");
-  readRoutes(directory + "/routes.txt");
-  readShapes(directory + "/shapes.txt");
-  readStops(directory + "/stops.txt");
-  readStopTimes(directory + "/stop_times.txt");
-  readTransfers(directory + "/transfers.txt");
-  readTrips(directory + "/trips.txt");
+namespace {
+
+// Data versions are unique over all networks, so a cache shared by copies never mixes them up
+std::atomic<uint64_t> nextDataVersion{1};
+
+// Indices to rebuild after a GTFS file changed, see Network::reload()
+typedef enum ERebuildLevel { RebuildLevel_None = 0, RebuildLevel_Footpaths = 1, RebuildLevel_All = 2 } RebuildLevel;
+
+// Replace a container by a new one, unlike clear() this also resets the bucket layout of hash maps
+template <typename T>
+void resetContainer(T& container) {
+    container = T();
+}
+
+// Content hash of a file, missing files hash like empty ones
+uint64_t hashFile(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary);
+    uint64_t hash = HASH_SEED;
+    char buffer[1 << 16];
+    while (stream.read(buffer, sizeof(buffer)) || stream.gcount() > 0) {
+        hash = hashBytes(hash, buffer, (size_t)stream.gcount());
+    }
+    return hash;
+}
+
+// Route id of a trip or of a route id itself, to search the trips ordered by route
+std::string_view routeKey(const Trip* trip) {
+    return trip->routeId;
+}
+
+std::string_view routeKey(std::string_view routeId) {
+    return routeId;
+}
+
+// Order of the departure and arrival tables of a stop
+bool departsBefore(const Departure& a, const Departure& b) {
+    return std::tie(a.time, a.trip) < std::tie(b.time, b.trip);
+}
+
+}
+
+Network::Network(std::string directory, double footpathRadius) : footpathRadius(footpathRadius) {
+  // Nothing was read yet, so every file counts as changed
+  reload(directory);
+}
+
+std::vector<std::string> Network::reload(const std::string& directory) {
+    // Files in the order they are read, with their data and the indices depending on them
+    struct FeedFile {
+        const char* name;
+        void (Network::*read)(std::string);
+        std::function<void()> clear;
+        RebuildLevel level;
+    };
+    const FeedFile files[] = {
+        {"agency.txt", &Network::readAgencies, [this]() { resetContainer(agencies); }, RebuildLevel_All},
+        {"calendar_dates.txt", &Network::readCalendarDates, [this]() { resetContainer(calendarDates); }, RebuildLevel_None},
+        {"calendar.txt", &Network::readCalendars, [this]() { resetContainer(calendars); }, RebuildLevel_None},
+        {"frequencies.txt", &Network::readFrequencies, [this]() { resetContainer(frequencies); }, RebuildLevel_All},
+        {"levels.txt", &Network::readLevels, [this]() { resetContainer(levels); }, RebuildLevel_None},
+        {"pathways.txt", &Network::readPathways, [this]() { resetContainer(pathways); }, RebuildLevel_Footpaths},
+        {"routes.txt", &Network::readRoutes, [this]() { resetContainer(routes); }, RebuildLevel_All},
+        {"shapes.txt", &Network::readShapes, [this]() { resetContainer(shapes); }, RebuildLevel_None},
+        {"stops.txt", &Network::readStops, [this]() {
+            resetContainer(stops);
+            resetContainer(stopsForTransferMap);
+            resetContainer(zoneStops);
+            resetContainer(prefixStops);
+        }, RebuildLevel_All},
+        {"stop_times.txt", &Network::readStopTimes, [this]() { resetContainer(stopTimes); }, RebuildLevel_All},
+        {"transfers.txt", &Network::readTransfers, [this]() { resetContainer(transfers); }, RebuildLevel_Footpaths},
+        {"trips.txt", &Network::readTrips, [this]() { resetContainer(trips); }, RebuildLevel_All},
+    };
+
+    std::vector<std::string> changed;
+    RebuildLevel level = RebuildLevel_None;
+    for (const FeedFile& file : files) {
+        const std::string path = directory + "/" + file.name;
+        const uint64_t hash = hashFile(path);
+        auto known = feedHashes.find(file.name);
+        if (known != feedHashes.end() && known->second == hash) {
+            continue;
+        }
+        file.clear();
+        (this->*file.read)(path);
+        feedHashes[file.name] = hash;
+        changed.push_back(file.name);
+        level = std::max(level, file.level);
+    }
+
+    // Shapes only feed the stop projections, which a full rebuild computes anyway
+    if (level != RebuildLevel_All && std::find(changed.begin(), changed.end(), "shapes.txt") != changed.end()) {
+        buildShapeProjections();
+    }
+
+    if (level == RebuildLevel_All) {
+        buildIndices();
+    } else if (level == RebuildLevel_Footpaths) {
+        // Stops and trips are unchanged, only the walking connections and what is derived from them
+        dataVersion = nextDataVersion++;
+        buildPathways();
+        buildFootpaths();
+        buildReachability();
+        buildHeuristic();
+        landmarks.clear();
+        landmarkDistancesTo.clear();
+        landmarkDistancesFrom.clear();
+        tripTransferOffsets.clear();
+        tripTransfers.clear();
+    }
+    return changed;
+}
+
+void Network::buildIndices() {
+    dataVersion = nextDataVersion++;
+    landmarks.clear();
+    landmarkDistancesTo.clear();
+    landmarkDistancesFrom.clear();
+
+    // Dense stop indices in id order
+    stopIds.clear();
+    stopIds.reserve(stops.size());
+    for (const auto& pair : stops) {
+        stopIds.push_back(pair.first);
+    }
+    std::sort(stopIds.begin(), stopIds.end());
+    stopIndex.clear();
+    indexedStops.resize(stopIds.size());
+    for (unsigned int i = 0; i < stopIds.size(); ++i) {
+        stopIndex[stopIds[i]] = i;
+        indexedStops[i] = &stops.find(stopIds[i])->second;
+    }
+
+    tripIndex.clear();
+    routeTrips.clear();
+    for (unsigned int i = 0; i < trips.size(); ++i) {
+        tripIndex[trips[i].id] = i;
+        routeTrips.push_back(&trips[i]);
+    }
+    std::stable_sort(routeTrips.begin(), routeTrips.end(), [](const Trip* a, const Trip* b) { return a->routeId < b->routeId; });
+
+    // Group stop times by trip (counting sort) and order each trip by stop sequence
+    std::vector<unsigned int> stopTimeTrips(stopTimes.size(), INVALID_INDEX);
+    tripOffsets.assign(trips.size() + 1, 0);
+    for (size_t i = 0; i < stopTimes.size(); ++i) {
+        auto tripIt = tripIndex.find(stopTimes[i].tripId);
+        if (tripIt != tripIndex.end()) {
+            stopTimeTrips[i] = tripIt->second;
+            tripOffsets[tripIt->second + 1]++;
+        }
+    }
+    for (size_t t = 0; t < trips.size(); ++t) {
+        tripOffsets[t + 1] += tripOffsets[t];
+    }
+
+    std::vector<unsigned int> fill(tripOffsets.begin(), tripOffsets.end() - 1);
+    tripStopTimes.assign(tripOffsets.back(), StopTime{});
+    for (size_t i = 0; i < stopTimes.size(); ++i) {
+        if (stopTimeTrips[i] != INVALID_INDEX) {
+            tripStopTimes[fill[stopTimeTrips[i]]++] = stopTimes[i];
+        }
+    }
+
+    tripEvents.resize(tripStopTimes.size());
+    std::vector<unsigned int> stopEventCounts(stopIds.size(), 0);
+    for (size_t t = 0; t < trips.size(); ++t) {
+        std::stable_sort(tripStopTimes.begin() + tripOffsets[t], tripStopTimes.begin() + tripOffsets[t + 1]);
+
+        for (unsigned int i = tripOffsets[t]; i < tripOffsets[t + 1]; ++i) {
+            const StopTime& stopTime = tripStopTimes[i];
+            auto stopIt = stopIndex.find(stopTime.stopId);
+            unsigned int stop = stopIt == stopIndex.end() ? INVALID_INDEX : stopIt->second;
+            tripEvents[i] = {stop, toSeconds(stopTime.arrivalTime), toSeconds(stopTime.departureTime)};
+            if (stop != INVALID_INDEX) {
+                stopEventCounts[stop]++;
+            }
+        }
+    }
+
+    // Trips calling at each stop
+    stopEventOffsets.assign(stopIds.size() + 1, 0);
+    for (size_t s = 0; s < stopIds.size(); ++s) {
+        stopEventOffsets[s + 1] = stopEventOffsets[s] + stopEventCounts[s];
+    }
+    fill.assign(stopEventOffsets.begin(), stopEventOffsets.end() - 1);
+    stopEvents.resize(stopEventOffsets.back());
+    for (unsigned int t = 0; t < trips.size(); ++t) {
+        for (unsigned int i = tripOffsets[t]; i < tripOffsets[t + 1]; ++i) {
+            if (tripEvents[i].stop != INVALID_INDEX) {
+                stopEvents[fill[tripEvents[i].stop]++] = {t, i - tripOffsets[t]};
+            }
+        }
+    }
+
+    // Departure boards: every stop time except the last of a trip or one without pickup
+    sortedRoutes.clear();
+    for (const auto& pair : routes) {
+        sortedRoutes.push_back(&pair.second);
+    }
+    indexedRoutes = sortedRoutes;
+    std::sort(indexedRoutes.begin(), indexedRoutes.end(), [](const Route* a, const Route* b) { return a->id < b->id; });
+    routeIndex.clear();
+    for (unsigned int r = 0; r < indexedRoutes.size(); ++r) {
+        routeIndex[indexedRoutes[r]->id] = r;
+    }
+    std::sort(sortedRoutes.begin(), sortedRoutes.end(), [](const Route* a, const Route* b) { return a->shortName < b->shortName; });
+    tripRoutes.resize(trips.size());
+    for (size_t t = 0; t < trips.size(); ++t) {
+        auto routeIt = routeIndex.find(trips[t].routeId);
+        tripRoutes[t] = routeIt == routeIndex.end() ? INVALID_INDEX : routeIt->second;
+    }
+
+    // Properties the query options filter trips and stops by, see compileTripFilter()
+    std::vector<std::string> agencyIds;
+    for (const auto& pair : agencies) {
+        agencyIds.push_back(pair.first);
+    }
+    std::sort(agencyIds.begin(), agencyIds.end());
+    agencyIndex.clear();
+    for (unsigned int a = 0; a < agencyIds.size(); ++a) {
+        agencyIndex[agencyIds[a]] = a;
+    }
+    tripFlags.assign(trips.size(), 0);
+    tripAgencies.assign(trips.size(), INVALID_INDEX);
+    for (size_t t = 0; t < trips.size(); ++t) {
+        auto routeIt = routes.find(trips[t].routeId);
+        if (routeIt != routes.end()) {
+            // Feeds with a single agency may leave the agency of their routes empty
+            auto agencyIt = routeIt->second.agencyId.empty() && agencyIds.size() == 1 ? agencyIndex.begin() : agencyIndex.find(routeIt->second.agencyId);
+            tripAgencies[t] = agencyIt == agencyIndex.end() ? INVALID_INDEX : agencyIt->second;
+            tripFlags[t] |= getTransportMode(routeIt->second.type);
+        }
+        if (trips[t].wheelchairAccessible != WheelchairAccessibility_Available) {
+            tripFlags[t] |= TripFlag_NotWheelchairAccessible;
+        }
+        if (!trips[t].bikesAllowed) {
+            tripFlags[t] |= TripFlag_NoBikes;
+        }
+    }
+    wheelchairStops.assign(stopIds.size(), false);
+    for (unsigned int s = 0; s < stopIds.size(); ++s) {
+        // Platforms without information inherit the accessibility of their station
+        const Stop& stop = stops.at(stopIds[s]);
+        WheelchairAccessibility boarding = stop.wheelchairBoarding;
+        auto parentIt = stops.find(stop.parentStation);
+        if (boarding == WheelchairAccessibility_Inherit && !stop.parentStation.empty() && parentIt != stops.end()) {
+            boarding = parentIt->second.wheelchairBoarding;
+        }
+        wheelchairStops[s] = boarding == WheelchairAccessibility_Available;
+    }
+
+    // Run windows of headway based trips, their template times are not departures themselves
+    std::vector<std::vector<Frequency>> tripFrequencies(trips.size());
+    for (const Frequency& frequency : frequencies) {
+        auto tripIt = tripIndex.find(frequency.tripId);
+        if (tripIt != tripIndex.end() && frequency.headwaySecs > 0 && toSeconds(frequency.endTime) > toSeconds(frequency.startTime)) {
+            tripFrequencies[tripIt->second].push_back(frequency);
+        }
+    }
+    frequencyTrips.assign(trips.size(), false);
+    for (size_t t = 0; t < trips.size(); ++t) {
+        frequencyTrips[t] = !tripFrequencies[t].empty();
+    }
+    scheduledTripEvents.clear();
+
+    departureOffsets.assign(1, 0);
+    departures.clear();
+    frequencyOffsets.assign(1, 0);
+    frequencyDepartures.clear();
+    arrivalOffsets.assign(1, 0);
+    arrivals.clear();
+    frequencyArrivalOffsets.assign(1, 0);
+    frequencyArrivals.clear();
+    for (unsigned int s = 0; s < stopIds.size(); ++s) {
+        for (unsigned int e = stopEventOffsets[s]; e < stopEventOffsets[s + 1]; ++e) {
+            const StopEvent& event = stopEvents[e];
+            const unsigned int index = tripOffsets[event.trip] + event.position;
+
+            // Runs start every headway seconds before the end time, offset by the template time of this stop
+            auto addRuns = [&](std::vector<FrequencyDeparture>& runs, int time) {
+                const int offset = time - tripEvents[tripOffsets[event.trip]].departure;
+                for (const Frequency& frequency : tripFrequencies[event.trip]) {
+                    const int start = toSeconds(frequency.startTime);
+                    const int headway = (int)frequency.headwaySecs;
+                    const int lastStart = start + (toSeconds(frequency.endTime) - 1 - start) / headway * headway;
+                    runs.push_back({start + offset, lastStart + offset, headway, event.trip, event.position});
+                }
+            };
+
+            // Arrivals: every stop time except the first of a trip
+            if (index > tripOffsets[event.trip]) {
+                if (tripFrequencies[event.trip].empty()) {
+                    arrivals.push_back({tripEvents[index].arrival, event.trip, event.position});
+                } else {
+                    addRuns(frequencyArrivals, tripEvents[index].arrival);
+                }
+            }
+
+            if (index + 1 >= tripOffsets[event.trip + 1] || tripStopTimes[index].pickupType == PickupType_NoPickup) {
+                continue;
+            }
+            if (tripFrequencies[event.trip].empty()) {
+                departures.push_back({tripEvents[index].departure, event.trip, event.position});
+            } else {
+                addRuns(frequencyDepartures, tripEvents[index].departure);
+            }
+        }
+        departureOffsets.push_back(departures.size());
+        frequencyOffsets.push_back(frequencyDepartures.size());
+        arrivalOffsets.push_back(arrivals.size());
+        frequencyArrivalOffsets.push_back(frequencyArrivals.size());
+    }
+    routeDepartures = departures;
+    for (unsigned int s = 0; s < stopIds.size(); ++s) {
+        std::sort(departures.begin() + departureOffsets[s], departures.begin() + departureOffsets[s + 1], departsBefore);
+        std::sort(routeDepartures.begin() + departureOffsets[s], routeDepartures.begin() + departureOffsets[s + 1],
+                  [this](const Departure& a, const Departure& b) {
+                      return std::tie(tripRoutes[a.trip], a.time, a.trip) < std::tie(tripRoutes[b.trip], b.time, b.trip);
+                  });
+        std::sort(arrivals.begin() + arrivalOffsets[s], arrivals.begin() + arrivalOffsets[s + 1], departsBefore);
+    }
+    buildRoutePatterns();
+
+    // Transfer stops of the same station
+    transferOffsets.assign(1, 0);
+    transferStops.clear();
+    std::vector<const Stop*> stationStops;
+    for (unsigned int s = 0; s < stopIds.size(); ++s) {
+        getStopsForTransfer(stopIds[s], stationStops);
+        for (const Stop* transferStop : stationStops) {
+            unsigned int other = getStopIndex(transferStop->id);
+            if (other != INVALID_INDEX && other != s) {
+                transferStops.push_back(other);
+            }
+        }
+        transferOffsets.push_back(transferStops.size());
+    }
+
+    buildAdjacency();
+    buildPathways();
+    buildFootpaths();
+    buildReachability();
+    buildHeuristic();
+    buildShapeProjections();
+}
+
+void Network::buildAdjacency() {
+    const size_t stopCount = stopIds.size();
+    std::vector<unsigned int> marks(stopCount, INVALID_INDEX);
+    adjacencyOffsets.assign(1, 0);
+    adjacency.clear();
+    for (unsigned int stop = 0; stop < stopCount; ++stop) {
+        marks[stop] = stop;
+        auto add = [&](unsigned int neighbor) {
+            if (neighbor != INVALID_INDEX && marks[neighbor] != stop) {
+                marks[neighbor] = stop;
+                adjacency.push_back(neighbor);
+            }
+        };
+
+        // Next/previous stops of all trips calling here
+        for (unsigned int e = stopEventOffsets[stop]; e < stopEventOffsets[stop + 1]; ++e) {
+            const unsigned int begin = tripOffsets[stopEvents[e].trip];
+            const unsigned int end = tripOffsets[stopEvents[e].trip + 1];
+            const unsigned int current = begin + stopEvents[e].position;
+            if (current + 1 < end) {
+                add(tripEvents[current + 1].stop);
+            }
+            if (current > begin) {
+                add(tripEvents[current - 1].stop);
+            }
+        }
+
+        // Transfer possibilities (same station)
+        for (unsigned int t = transferOffsets[stop]; t < transferOffsets[stop + 1]; ++t) {
+            add(transferStops[t]);
+        }
+        adjacencyOffsets.push_back(adjacency.size());
+    }
+
+    // Same edges grouped by target for the backward half of getTravelPath
+    incomingAdjacencyOffsets.assign(stopCount + 1, 0);
+    for (unsigned int neighbor : adjacency) {
+        incomingAdjacencyOffsets[neighbor + 1]++;
+    }
+    for (size_t s = 0; s < stopCount; ++s) {
+        incomingAdjacencyOffsets[s + 1] += incomingAdjacencyOffsets[s];
+    }
+    std::vector<unsigned int> fill(incomingAdjacencyOffsets.begin(), incomingAdjacencyOffsets.end() - 1);
+    incomingAdjacency.resize(adjacency.size());
+    for (unsigned int stop = 0; stop < stopCount; ++stop) {
+        for (unsigned int e = adjacencyOffsets[stop]; e < adjacencyOffsets[stop + 1]; ++e) {
+            incomingAdjacency[fill[adjacency[e]]++] = stop;
+        }
+    }
+}
+
+void Network::buildReachability() {
+    pathReachability.build(adjacencyOffsets, adjacency);
+
+    // Travel plans move along trips and footpaths. The edges are a superset of
+    // what the searches use, so a pair rejected here has no travel plan.
+    const size_t stopCount = stopIds.size();
+    std::vector<std::vector<unsigned int>> edges(stopCount);
+    for (size_t t = 0; t < trips.size(); ++t) {
+        unsigned int previous = INVALID_INDEX;
+        for (unsigned int i = tripOffsets[t]; i < tripOffsets[t + 1]; ++i) {
+            const unsigned int stop = tripEvents[i].stop;
+            if (stop == INVALID_INDEX) {
+                continue;
+            }
+            if (previous != INVALID_INDEX && previous != stop) {
+                edges[previous].push_back(stop);
+            }
+            previous = stop;
+        }
+    }
+    std::vector<unsigned int> offsets(1, 0);
+    std::vector<unsigned int> targets;
+    for (unsigned int s = 0; s < stopCount; ++s) {
+        std::sort(edges[s].begin(), edges[s].end());
+        edges[s].erase(std::unique(edges[s].begin(), edges[s].end()), edges[s].end());
+        targets.insert(targets.end(), edges[s].begin(), edges[s].end());
+        for (unsigned int f = footpathOffsets[s]; f < footpathOffsets[s + 1]; ++f) {
+            targets.push_back(footpaths[f].stop);
+        }
+        offsets.push_back(targets.size());
+    }
+    planReachability.build(offsets, targets);
+}
+
+void Network::buildRoutePatterns() {
+    // Candidates share the route, the stop sequence and whether they run by frequencies.txt
+    std::map<std::tuple<unsigned int, bool, std::vector<unsigned int>>, std::vector<unsigned int>> candidates;
+    for (unsigned int t = 0; t < trips.size(); ++t) {
+        std::vector<unsigned int> sequence;
+        for (unsigned int i = tripOffsets[t]; i < tripOffsets[t + 1]; ++i) {
+            sequence.push_back(tripEvents[i].stop);
+        }
+        candidates[std::make_tuple(tripRoutes[t], (bool)frequencyTrips[t], std::move(sequence))].push_back(t);
+    }
+
+    tripPatterns.assign(trips.size(), INVALID_INDEX);
+    tripPatternRanks.assign(trips.size(), INVALID_INDEX);
+    patternOffsets.assign(1, 0);
+    patternTrips.clear();
+    std::vector<std::vector<unsigned int>> lines;
+    for (auto& pair : candidates) {
+        const unsigned int length = (unsigned int)std::get<2>(pair.first).size();
+        std::vector<unsigned int>& group = pair.second;
+        std::sort(group.begin(), group.end(), [this, length](unsigned int a, unsigned int b) {
+            const int first = length > 0 ? tripEvents[tripOffsets[a]].departure : 0;
+            const int second = length > 0 ? tripEvents[tripOffsets[b]].departure : 0;
+            return std::tie(first, a) < std::tie(second, b);
+        });
+
+        // Each trip joins the first pattern whose last trip it does not overtake anywhere
+        lines.clear();
+        for (unsigned int trip : group) {
+            auto line = std::find_if(lines.begin(), lines.end(), [&](const std::vector<unsigned int>& l) { return tripFollows(l.back(), trip); });
+            if (line == lines.end()) {
+                lines.emplace_back();
+                line = lines.end() - 1;
+            }
+            line->push_back(trip);
+        }
+        for (const std::vector<unsigned int>& line : lines) {
+            for (unsigned int trip : line) {
+                tripPatterns[trip] = (unsigned int)patternOffsets.size() - 1;
+                tripPatternRanks[trip] = (unsigned int)patternTrips.size();
+                patternTrips.push_back(trip);
+            }
+            patternOffsets.push_back(patternTrips.size());
+        }
+    }
+
+    // Patterns calling at each stop, taken from the first trip of every pattern
+    const size_t patternCount = patternOffsets.size() - 1;
+    stopPatternOffsets.assign(stopIds.size() + 1, 0);
+    for (size_t p = 0; p < patternCount; ++p) {
+        const unsigned int trip = patternTrips[patternOffsets[p]];
+        for (unsigned int i = tripOffsets[trip]; i < tripOffsets[trip + 1]; ++i) {
+            if (tripEvents[i].stop != INVALID_INDEX) {
+                stopPatternOffsets[tripEvents[i].stop + 1]++;
+            }
+        }
+    }
+    for (size_t s = 0; s < stopIds.size(); ++s) {
+        stopPatternOffsets[s + 1] += stopPatternOffsets[s];
+    }
+    std::vector<unsigned int> fill(stopPatternOffsets.begin(), stopPatternOffsets.end() - 1);
+    stopPatterns.resize(stopPatternOffsets.back());
+    for (unsigned int p = 0; p < patternCount; ++p) {
+        const unsigned int trip = patternTrips[patternOffsets[p]];
+        for (unsigned int i = tripOffsets[trip]; i < tripOffsets[trip + 1]; ++i) {
+            if (tripEvents[i].stop != INVALID_INDEX) {
+                stopPatterns[fill[tripEvents[i].stop]++] = {p, i - tripOffsets[trip]};
+            }
+        }
+    }
+
+    // Transfers of the trip-based search refer to the patterns and have to be computed again
+    tripTransferOffsets.clear();
+    tripTransfers.clear();
+}
+
+void Network::buildShapeProjections() {
+    // Trips of a route pattern call at the same stops, so they share the projection onto the same shape
+    struct Projection {
+        unsigned int shape;
+        unsigned int trip; // first trip of the pattern with this shape
+        unsigned int first; // first entry in shapeStops
+    };
+    std::vector<Projection> projections;
+    std::unordered_map<uint64_t, unsigned int> patternShapes; // route pattern and shape -> projection
+    tripShapeStops.assign(trips.size(), INVALID_INDEX);
+    unsigned int entries = 0;
+    for (unsigned int t = 0; t < trips.size(); ++t) {
+        const unsigned int shape = shapes.getShapeIndex(trips[t].shapeId);
+        if (shape == INVALID_INDEX) {
+            continue;
+        }
+        auto inserted = patternShapes.emplace(((uint64_t)tripPatterns[t] << 32) | shape, (unsigned int)projections.size());
+        if (inserted.second) {
+            projections.push_back({shape, t, entries});
+            entries += tripOffsets[t + 1] - tripOffsets[t];
+        }
+        tripShapeStops[t] = projections[inserted.first->second].first;
+    }
+    shapeStops.resize(entries);
+
+    // Long shapes first so the pool can even out the short ones at the end
+    std::vector<unsigned int> order(projections.size());
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+        return shapes.getShape(projections[a].shape).size() > shapes.getShape(projections[b].shape).size();
+    });
+
+    // Every projection writes its own range of shapeStops
+    WorkStealingPool::run(order.size(), 0, [&](size_t task, unsigned int) {
+        const Projection& projection = projections[order[task]];
+        const unsigned int begin = tripOffsets[projection.trip];
+        const unsigned int count = tripOffsets[projection.trip + 1] - begin;
+        std::vector<int32_t> latitudes(count, MISSING_COORDINATE), longitudes(count, MISSING_COORDINATE);
+        for (unsigned int k = 0; k < count; ++k) {
+            const unsigned int stop = tripEvents[begin + k].stop;
+            if (stop != INVALID_INDEX) {
+                latitudes[k] = stopLatitudes[stop];
+                longitudes[k] = stopLongitudes[stop];
+            }
+        }
+        shapes.projectStops(projection.shape, latitudes.data(), longitudes.data(), count, shapeStops.data() + projection.first);
+    });
+}
+
+unsigned int Network::findTripPosition(unsigned int trip, unsigned int stopSequence) const {
+    const auto begin = tripStopTimes.begin() + tripOffsets[trip];
+    const auto end = tripStopTimes.begin() + tripOffsets[trip + 1];
+    if (begin == end || stopSequence < begin->stopSequence) {
+        return INVALID_INDEX;
+    }
+
+    // Stop sequences are usually numbered without gaps
+    const unsigned int guess = stopSequence - begin->stopSequence;
+    if (guess < (unsigned int)(end - begin) && begin[guess].stopSequence == stopSequence) {
+        return guess;
+    }
+    auto it = std::lower_bound(begin, end, stopSequence, [](const StopTime& stopTime, unsigned int sequence) {
+        return stopTime.stopSequence < sequence;
+    });
+    return it != end && it->stopSequence == stopSequence ? (unsigned int)(it - begin) : INVALID_INDEX;
+}
+
+bool Network::tripFollows(unsigned int earlier, unsigned int later) const {
+    const unsigned int length = tripOffsets[earlier + 1] - tripOffsets[earlier];
+    for (unsigned int k = 0; k < length; ++k) {
+        const TripEvent& a = tripEvents[tripOffsets[earlier] + k];
+        const TripEvent& b = tripEvents[tripOffsets[later] + k];
+        if (a.arrival > b.arrival || a.departure > b.departure) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Network::buildHeuristic() {
+    const size_t stopCount = stopIds.size();
+
+    // Union stops connected by zero time footpaths, hops and transfer rules,
+    // no lower bound based on distance holds between them
+    std::vector<unsigned int> parent(stopCount);
+    for (unsigned int s = 0; s < stopCount; ++s) {
+        parent[s] = s;
+    }
+    auto find = [&parent](unsigned int stop) {
+        while (parent[stop] != stop) {
+            parent[stop] = parent[parent[stop]];
+            stop = parent[stop];
+        }
+        return stop;
+    };
+    auto unite = [&](unsigned int a, unsigned int b) {
+        parent[find(b)] = find(a);
+    };
+    for (unsigned int s = 0; s < stopCount; ++s) {
+        for (unsigned int f = footpathOffsets[s]; f < footpathOffsets[s + 1]; ++f) {
+            if (footpaths[f].duration <= 0) {
+                unite(s, footpaths[f].stop);
+            }
+        }
+        for (unsigned int r = transferRuleOffsets[s]; r < transferRuleOffsets[s + 1]; ++r) {
+            unite(s, transferRules[r].toStop);
+        }
+    }
+    auto forEachHop = [this](auto visit) {
+        for (size_t t = 0; t < trips.size(); ++t) {
+            unsigned int previous = INVALID_INDEX;
+            for (unsigned int e = tripOffsets[t]; e < tripOffsets[t + 1]; ++e) {
+                if (tripEvents[e].stop == INVALID_INDEX) {
+                    continue;
+                }
+                if (previous != INVALID_INDEX) {
+                    visit(tripEvents[previous].stop, tripEvents[e].stop, tripEvents[e].arrival - tripEvents[previous].departure);
+                }
+                previous = e;
+            }
+        }
+    };
+    forEachHop([&](unsigned int from, unsigned int to, int time) {
+        if (time <= 0) {
+            unite(from, to);
+        }
+    });
+
+    // Hops faster than any vehicle come from misplaced stops or times. Instead of letting
+    // one of them slow down the bound of the whole feed, their ends join one cluster like
+    // stops without travel time in between. Merging moves the cluster centers, so this
+    // repeats until no hop between two clusters is too fast.
+    std::vector<std::pair<unsigned int, unsigned int>> outliers;
+    bool complete;
+    float speed;
+    do {
+        for (const auto& hop : outliers) {
+            unite(hop.first, hop.second);
+        }
+        outliers.clear();
+
+        // Cluster centers are the mean position of their stops
+        std::vector<unsigned int> clusterIds(stopCount, INVALID_INDEX);
+        std::vector<int64_t> sumLatitudes, sumLongitudes;
+        std::vector<unsigned int> located;
+        stopClusters.assign(stopCount, INVALID_INDEX);
+        for (unsigned int s = 0; s < stopCount; ++s) {
+            const unsigned int root = find(s);
+            if (clusterIds[root] == INVALID_INDEX) {
+                clusterIds[root] = sumLatitudes.size();
+                sumLatitudes.push_back(0);
+                sumLongitudes.push_back(0);
+                located.push_back(0);
+            }
+            const unsigned int cluster = stopClusters[s] = clusterIds[root];
+            if (stopLatitudes[s] != MISSING_COORDINATE) {
+                sumLatitudes[cluster] += stopLatitudes[s];
+                sumLongitudes[cluster] += stopLongitudes[s];
+                located[cluster]++;
+            }
+        }
+        clusterLatitudes.assign(located.size(), MISSING_COORDINATE);
+        clusterLongitudes.assign(located.size(), MISSING_COORDINATE);
+        int64_t referenceSum = 0, referenceCount = 0;
+        for (size_t c = 0; c < located.size(); ++c) {
+            if (located[c] > 0) {
+                clusterLatitudes[c] = (int32_t)(sumLatitudes[c] / located[c]);
+                clusterLongitudes[c] = (int32_t)(sumLongitudes[c] / located[c]);
+                referenceSum += clusterLatitudes[c];
+                referenceCount++;
+            }
+        }
+        heuristicLatitude = referenceCount > 0 ? (int32_t)(referenceSum / referenceCount) : 0;
+
+        // Fastest movement between two clusters, the bound is only admissible if every stop has a position
+        complete = true;
+        speed = 0;
+        auto measure = [&](unsigned int from, unsigned int to, int time) {
+            const unsigned int a = stopClusters[from];
+            const unsigned int b = stopClusters[to];
+            if (a == b || time <= 0) {
+                return;
+            }
+            if (clusterLatitudes[a] == MISSING_COORDINATE || clusterLatitudes[b] == MISSING_COORDINATE) {
+                complete = false;
+                return;
+            }
+            float meters;
+            computeDistances(clusterLatitudes[a], clusterLongitudes[a], &clusterLatitudes[b], &clusterLongitudes[b], 1, &meters, heuristicLatitude);
+            if (meters > MAX_HEURISTIC_SPEED * time) {
+                outliers.push_back({from, to});
+            } else {
+                speed = std::max(speed, meters / time);
+            }
+        };
+        forEachHop(measure);
+        for (unsigned int s = 0; s < stopCount; ++s) {
+            for (unsigned int f = footpathOffsets[s]; f < footpathOffsets[s + 1]; ++f) {
+                measure(s, footpaths[f].stop, footpaths[f].duration);
+            }
+        }
+    } while (!outliers.empty());
+
+    // Leave some room for rounding in the float distances
+    heuristicScale = complete && speed > 0 ? 0.999f / speed : 0;
+}
+
+void Network::preprocessLandmarks(unsigned int landmarkCount) {
+    const size_t stopCount = stopIds.size();
+
+    // Time independent lower bound graph: the fastest hop between two stops over all
+    // trips, footpaths and zero time changes allowed by transfer rules
+    std::map<std::pair<unsigned int, unsigned int>, int> weights;
+    auto addEdge = [&weights](unsigned int from, unsigned int to, int time) {
+        auto inserted = weights.insert({{from, to}, std::max(0, time)});
+        if (!inserted.second) {
+            inserted.first->second = std::min(inserted.first->second, std::max(0, time));
+        }
+    };
+    for (size_t t = 0; t < trips.size(); ++t) {
+        unsigned int previous = INVALID_INDEX;
+        for (unsigned int e = tripOffsets[t]; e < tripOffsets[t + 1]; ++e) {
+            if (tripEvents[e].stop == INVALID_INDEX) {
+                continue;
+            }
+            if (previous != INVALID_INDEX && tripEvents[previous].stop != tripEvents[e].stop) {
+                addEdge(tripEvents[previous].stop, tripEvents[e].stop, tripEvents[e].arrival - tripEvents[previous].departure);
+            }
+            previous = e;
+        }
+    }
+    for (unsigned int s = 0; s < stopCount; ++s) {
+        for (unsigned int f = footpathOffsets[s]; f < footpathOffsets[s + 1]; ++f) {
+            addEdge(s, footpaths[f].stop, footpaths[f].duration);
+        }
+        for (unsigned int r = transferRuleOffsets[s]; r < transferRuleOffsets[s + 1]; ++r) {
+            if (transferRules[r].toStop != s) {
+                addEdge(s, transferRules[r].toStop, 0);
+            }
+        }
+    }
+    std::vector<unsigned int> forwardOffsets(stopCount + 1, 0), backwardOffsets(stopCount + 1, 0);
+    for (const auto& edge : weights) {
+        forwardOffsets[edge.first.first + 1]++;
+        backwardOffsets[edge.first.second + 1]++;
+    }
+    for (size_t s = 0; s < stopCount; ++s) {
+        forwardOffsets[s + 1] += forwardOffsets[s];
+        backwardOffsets[s + 1] += backwardOffsets[s];
+    }
+    std::vector<Footpath> forward(weights.size()), backward(weights.size());
+    std::vector<unsigned int> forwardFill(forwardOffsets.begin(), forwardOffsets.end() - 1);
+    std::vector<unsigned int> backwardFill(backwardOffsets.begin(), backwardOffsets.end() - 1);
+    for (const auto& edge : weights) {
+        forward[forwardFill[edge.first.first]++] = {edge.first.second, edge.second};
+        backward[backwardFill[edge.first.second]++] = {edge.first.first, edge.second};
+    }
+
+    // Spread the landmarks over the network: start with the stop farthest from the
+    // center, then repeatedly take the stop farthest from all landmarks chosen so far
+    std::vector<int32_t> candidateLatitudes, candidateLongitudes;
+    std::vector<unsigned int> candidates;
+    int64_t sumLatitudes = 0, sumLongitudes = 0;
+    for (unsigned int s = 0; s < stopCount; ++s) {
+        if (stopEventOffsets[s] != stopEventOffsets[s + 1] && stopLatitudes[s] != MISSING_COORDINATE) {
+            candidates.push_back(s);
+            candidateLatitudes.push_back(stopLatitudes[s]);
+            candidateLongitudes.push_back(stopLongitudes[s]);
+            sumLatitudes += stopLatitudes[s];
+            sumLongitudes += stopLongitudes[s];
+        }
+    }
+    landmarks.clear();
+    if (!candidates.empty()) {
+        std::vector<float> nearest(candidates.size()), distances(candidates.size());
+        computeDistances((int32_t)(sumLatitudes / (int64_t)candidates.size()), (int32_t)(sumLongitudes / (int64_t)candidates.size()),
+                         candidateLatitudes.data(), candidateLongitudes.data(), candidates.size(), nearest.data());
+        while (landmarks.size() < std::min<size_t>(landmarkCount, candidates.size())) {
+            const size_t next = std::max_element(nearest.begin(), nearest.end()) - nearest.begin();
+            landmarks.push_back(candidates[next]);
+            computeDistances(candidateLatitudes[next], candidateLongitudes[next], candidateLatitudes.data(), candidateLongitudes.data(),
+                             candidates.size(), distances.data());
+            for (size_t c = 0; c < candidates.size(); ++c) {
+                nearest[c] = std::min(nearest[c], distances[c]);
+            }
+        }
+    }
+
+    // One search in each direction per landmark, spread over all cores
+    const size_t landmarkTotal = landmarks.size();
+    std::vector<std::vector<uint16_t>> columnsTo(landmarkTotal), columnsFrom(landmarkTotal);
+    auto search = [&](unsigned int landmark, const std::vector<unsigned int>& offsets, const std::vector<Footpath>& edges, std::vector<uint16_t>& column) {
+        std::vector<int> times(stopCount, INFINITE_TIME);
+        std::vector<QueueEntry> heap = {{0, landmark}};
+        times[landmark] = 0;
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<QueueEntry>());
+            const QueueEntry current = heap.back();
+            heap.pop_back();
+            if (current.time > times[current.stop]) {
+                continue;
+            }
+            for (unsigned int e = offsets[current.stop]; e < offsets[current.stop + 1]; ++e) {
+                if (current.time + edges[e].duration < times[edges[e].stop]) {
+                    times[edges[e].stop] = current.time + edges[e].duration;
+                    heap.push_back({times[edges[e].stop], edges[e].stop});
+                    std::push_heap(heap.begin(), heap.end(), std::greater<QueueEntry>());
+                }
+            }
+        }
+        column.resize(stopCount);
+        for (size_t s = 0; s < stopCount; ++s) {
+            column[s] = (uint16_t)std::min<int>(times[s], SATURATED_LANDMARK);
+        }
+    };
+    WorkStealingPool::run(landmarkTotal, 0, [&](size_t l, unsigned int) {
+        search(landmarks[l], backwardOffsets, backward, columnsTo[l]);
+        search(landmarks[l], forwardOffsets, forward, columnsFrom[l]);
+    });
+
+    // Store stop major so one stop's entries share a cache line
+    landmarkDistancesTo.resize(stopCount * landmarkTotal);
+    landmarkDistancesFrom.resize(stopCount * landmarkTotal);
+    for (size_t l = 0; l < landmarkTotal; ++l) {
+        for (size_t s = 0; s < stopCount; ++s) {
+            landmarkDistancesTo[s * landmarkTotal + l] = columnsTo[l][s];
+            landmarkDistancesFrom[s * landmarkTotal + l] = columnsFrom[l][s];
+        }
+    }
+}
+
+void Network::preprocessTripTransfers() {
+    const size_t stopCount = stopIds.size();
+    const unsigned int tripCount = (unsigned int)trips.size();
+
+    // Transfers found for each trip as position and target, filled by the workers
+    std::vector<std::vector<std::pair<unsigned int, TripTransfer>>> found(tripCount);
+
+    // Earliest arrival and earliest time to change trips at every stop known so far
+    // when leaving the trip at the current position or later
+    struct Reached { int arrival; int change; };
+    auto processTrip = [&](unsigned int trip, std::vector<Reached>& reached, std::vector<unsigned int>& stamps, unsigned int epoch) {
+        auto improve = [&](unsigned int stop, int arrival, int change) {
+            if (stamps[stop] != epoch) {
+                stamps[stop] = epoch;
+                reached[stop] = {INFINITE_TIME, INFINITE_TIME};
+            }
+            bool better = false;
+            if (arrival < reached[stop].arrival) {
+                reached[stop].arrival = arrival;
+                better = true;
+            }
+            if (change < reached[stop].change) {
+                reached[stop].change = change;
+                better = true;
+            }
+            return better;
+        };
+        auto arrive = [&](unsigned int stop, int arrival) {
+            const int change = stopChangeTimes[stop] == INFINITE_TIME ? INFINITE_TIME : arrival + stopChangeTimes[stop];
+            bool better = improve(stop, arrival, change);
+            for (unsigned int f = footpathOffsets[stop]; f < footpathOffsets[stop + 1]; ++f) {
+                better = improve(footpaths[f].stop, arrival + footpaths[f].duration, arrival + footpaths[f].duration) || better;
+            }
+            return better;
+        };
+
+        const unsigned int begin = tripOffsets[trip];
+        const unsigned int length = tripOffsets[trip + 1] - begin;
+        for (unsigned int i = length; i-- > 1;) {
+            const TripEvent& event = tripEvents[begin + i];
+            if (event.stop == INVALID_INDEX) {
+                continue;
+            }
+            arrive(event.stop, event.arrival);
+
+            // Board the first trip of every pattern at the stop or a stop in walking distance,
+            // transfer rules may allow trips departing before the usual change time
+            const bool hasRules = transferRuleOffsets[event.stop] != transferRuleOffsets[event.stop + 1];
+            auto transferTo = [&](unsigned int stop, int ready) {
+                for (unsigned int e = stopPatternOffsets[stop]; e < stopPatternOffsets[stop + 1]; ++e) {
+                    const PatternEvent& pattern = stopPatterns[e];
+                    const unsigned int first = patternTrips[patternOffsets[pattern.pattern]];
+                    const unsigned int patternLength = tripOffsets[first + 1] - tripOffsets[first];
+                    if (frequencyTrips[first] || pattern.position + 1 >= patternLength) {
+                        continue;
+                    }
+                    unsigned int target = INVALID_INDEX;
+                    for (unsigned int r = findFirstPatternTrip(pattern.pattern, pattern.position, hasRules ? event.arrival : ready);
+                         r < patternOffsets[pattern.pattern + 1]; ++r) {
+                        const unsigned int candidate = patternTrips[r];
+                        const int departure = tripEvents[tripOffsets[candidate] + pattern.position].departure;
+                        if (candidate == trip || (tripFlags[candidate] & TripFlag_Canceled) ||
+                            tripStopTimes[tripOffsets[candidate] + pattern.position].pickupType == PickupType_NoPickup) {
+                            continue;
+                        }
+                        const TransferRule* rule = hasRules ? findTransferRule(event.stop, stop, trip, candidate) : nullptr;
+                        int earliest = ready;
+                        if (rule != nullptr) {
+                            earliest = rule->type == TransferType_NoTransfer ? INFINITE_TIME :
+                                       rule->type == TransferType_Timed || rule->type == TransferType_InSeatTransfer ? event.arrival :
+                                       rule->type == TransferType_MinTransferTime ? event.arrival + rule->minTransferTime : ready;
+                        }
+                        if (departure >= earliest) {
+                            target = candidate;
+                            break;
+                        }
+                    }
+                    if (target == INVALID_INDEX) {
+                        continue;
+                    }
+
+                    // Keep the transfer if riding on improves the arrival or change time anywhere
+                    bool useful = false;
+                    for (unsigned int k = tripOffsets[target] + pattern.position + 1; k < tripOffsets[target + 1]; ++k) {
+                        if (tripEvents[k].stop != INVALID_INDEX) {
+                            useful = arrive(tripEvents[k].stop, tripEvents[k].arrival) || useful;
+                        }
+                    }
+                    if (useful) {
+                        found[trip].push_back({i, {target, pattern.position}});
+                    }
+                }
+            };
+            if (stopChangeTimes[event.stop] != INFINITE_TIME) {
+                transferTo(event.stop, event.arrival + stopChangeTimes[event.stop]);
+            }
+            for (unsigned int f = footpathOffsets[event.stop]; f < footpathOffsets[event.stop + 1]; ++f) {
+                transferTo(footpaths[f].stop, event.arrival + footpaths[f].duration);
+            }
+        }
+    };
+
+    // Trips are independent of each other, every worker keeps its own stop tables
+    struct Tables {
+        std::vector<Reached> reached;
+        std::vector<unsigned int> stamps;
+        unsigned int epoch = 0;
+    };
+    std::vector<Tables> tables(WorkStealingPool::getWorkerCount(tripCount, 0));
+    WorkStealingPool::run(tripCount, 0, [&](size_t t, unsigned int worker) {
+        if (frequencyTrips[t] || (tripFlags[t] & TripFlag_Canceled)) {
+            return;
+        }
+        Tables& own = tables[worker];
+        if (own.stamps.empty()) {
+            own.reached.resize(stopCount);
+            own.stamps.assign(stopCount, 0);
+        }
+        processTrip((unsigned int)t, own.reached, own.stamps, ++own.epoch);
+    });
+
+    // Transfers grouped by the trip event they start at
+    tripTransferOffsets.assign(tripEvents.size() + 1, 0);
+    for (unsigned int t = 0; t < tripCount; ++t) {
+        for (const auto& transfer : found[t]) {
+            tripTransferOffsets[tripOffsets[t] + transfer.first + 1]++;
+        }
+    }
+    for (size_t e = 0; e < tripEvents.size(); ++e) {
+        tripTransferOffsets[e + 1] += tripTransferOffsets[e];
+    }
+    std::vector<unsigned int> fill(tripTransferOffsets.begin(), tripTransferOffsets.end() - 1);
+    tripTransfers.resize(tripTransferOffsets.back());
+    for (unsigned int t = 0; t < tripCount; ++t) {
+        for (const auto& transfer : found[t]) {
+            tripTransfers[fill[tripOffsets[t] + transfer.first]++] = transfer.second;
+        }
+    }
+}
+
+uint64_t Network::getFingerprint() const {
+    uint64_t hash = HASH_SEED;
+    for (const std::string& id : stopIds) {
+        hash = hashBytes(hash, id.c_str(), id.size() + 1);
+    }
+    for (const Trip& trip : trips) {
+        hash = hashBytes(hash, trip.id.c_str(), trip.id.size() + 1);
+    }
+    hash = hashBytes(hash, tripEvents.data(), tripEvents.size() * sizeof(TripEvent));
+    hash = hashBytes(hash, footpaths.data(), footpaths.size() * sizeof(Footpath));
+    hash = hashBytes(hash, transferRules.data(), transferRules.size() * sizeof(TransferRule));
+    return hash;
+}
+
+namespace {
+
+// Layout of the preprocessing file: header, then tagged sections with their size so readers can skip unknown ones
+const uint32_t PREPROCESSING_MAGIC = 0x50544842; // "BHTP"
+const uint32_t PREPROCESSING_VERSION = 1;
+const uint32_t SECTION_END = 0;
+const uint32_t SECTION_LANDMARKS = 1;
+const uint32_t SECTION_TRIP_TRANSFERS = 2;
+
+}
+
+bool Network::savePreprocessing(const std::string& path) const {
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    writeValue(stream, PREPROCESSING_MAGIC);
+    writeValue(stream, PREPROCESSING_VERSION);
+    writeValue(stream, getFingerprint());
+
+    if (!landmarks.empty()) {
+        writeValue(stream, SECTION_LANDMARKS);
+        writeValue(stream, (uint64_t)(3 * sizeof(uint64_t) + landmarks.size() * sizeof(unsigned int) +
+                                      (landmarkDistancesTo.size() + landmarkDistancesFrom.size()) * sizeof(uint16_t)));
+        writeVector(stream, landmarks);
+        writeVector(stream, landmarkDistancesTo);
+        writeVector(stream, landmarkDistancesFrom);
+    }
+    if (!tripTransferOffsets.empty()) {
+        writeValue(stream, SECTION_TRIP_TRANSFERS);
+        writeValue(stream, (uint64_t)(2 * sizeof(uint64_t) + tripTransferOffsets.size() * sizeof(unsigned int) +
+                                      tripTransfers.size() * sizeof(TripTransfer)));
+        writeVector(stream, tripTransferOffsets);
+        writeVector(stream, tripTransfers);
+    }
+    writeValue(stream, SECTION_END);
+    return (bool)stream;
+}
+
+bool Network::loadPreprocessing(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary);
+    uint32_t magic, version;
+    uint64_t fingerprint;
+    if (!readValue(stream, magic) || !readValue(stream, version) || !readValue(stream, fingerprint) ||
+        magic != PREPROCESSING_MAGIC || version != PREPROCESSING_VERSION || fingerprint != getFingerprint()) {
+        return false;
+    }
+
+    // Read everything first so a damaged file leaves the network unchanged
+    const size_t stopCount = stopIds.size();
+    std::vector<unsigned int> newLandmarks;
+    std::vector<uint16_t> newDistancesTo, newDistancesFrom;
+    std::vector<unsigned int> newTransferOffsets;
+    std::vector<TripTransfer> newTransfers;
+    for (;;) {
+        uint32_t section;
+        uint64_t size;
+        if (!readValue(stream, section)) {
+            return false;
+        }
+        if (section == SECTION_END) {
+            break;
+        }
+        if (!readValue(stream, size)) {
+            return false;
+        }
+        if (section == SECTION_LANDMARKS) {
+            if (!readVector(stream, newLandmarks, stopCount) ||
+                !readVector(stream, newDistancesTo, stopCount * newLandmarks.size()) ||
+                !readVector(stream, newDistancesFrom, stopCount * newLandmarks.size()) ||
+                newDistancesTo.size() != stopCount * newLandmarks.size() || newDistancesFrom.size() != newDistancesTo.size()) {
+                return false;
+            }
+        } else if (section == SECTION_TRIP_TRANSFERS) {
+            if (!readVector(stream, newTransferOffsets, tripEvents.size() + 1) ||
+                newTransferOffsets.size() != tripEvents.size() + 1 ||
+                !readVector(stream, newTransfers, newTransferOffsets.back())) {
+                return false;
+            }
+            for (size_t e = 0; e < tripEvents.size(); ++e) {
+                if (newTransferOffsets[e] > newTransferOffsets[e + 1]) {
+                    return false;
+                }
+            }
+            for (const TripTransfer& transfer : newTransfers) {
+                if (transfer.trip >= trips.size() || transfer.position + 1 >= tripOffsets[transfer.trip + 1] - tripOffsets[transfer.trip]) {
+                    return false;
+                }
+            }
+        } else if (!stream.seekg(size, std::ios::cur)) {
+            return false;
+        }
+    }
+
+    landmarks = std::move(newLandmarks);
+    landmarkDistancesTo = std::move(newDistancesTo);
+    landmarkDistancesFrom = std::move(newDistancesFrom);
+    tripTransferOffsets = std::move(newTransferOffsets);
+    tripTransfers = std::move(newTransfers);
+    return true;
+}
+
+size_t Network::applyRealtimeUpdates(const std::string& path) {
+    return applyRealtimeUpdates(readTripUpdates(path));
+}
+
+size_t Network::applyRealtimeUpdates(const std::vector<TripUpdate>& updates) {
+    // Updates grouped by trip, each with the position of the stop it starts at
+    std::unordered_map<unsigned int, std::vector<std::pair<unsigned int, const TripUpdate*>>> tripUpdates;
+    for (const TripUpdate& update : updates) {
+        auto tripIt = tripIndex.find(update.tripId);
+        if (tripIt == tripIndex.end()) {
+            continue;
+        }
+        auto begin = tripStopTimes.begin() + tripOffsets[tripIt->second];
+        auto end = tripStopTimes.begin() + tripOffsets[tripIt->second + 1];
+        auto start = begin;
+        if (update.stopSequence != INVALID_INDEX) {
+            start = std::find_if(begin, end, [&update](const StopTime& stopTime) { return stopTime.stopSequence == update.stopSequence; });
+        } else if (!update.stopId.empty()) {
+            start = std::find_if(begin, end, [&update](const StopTime& stopTime) { return stopTime.stopId == update.stopId; });
+        }
+        if (start != end || update.canceled) {
+            tripUpdates[tripIt->second].push_back({(unsigned int)(start - begin), &update});
+        }
+    }
+
+    std::vector<unsigned int> changedTrips;
+    std::vector<TripEvent> events;
+    bool faster = false;
+    for (auto& pair : tripUpdates) {
+        const unsigned int trip = pair.first;
+        auto& starts = pair.second;
+        std::stable_sort(starts.begin(), starts.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        const bool canceled = std::any_of(starts.begin(), starts.end(), [](const auto& start) { return start.second->canceled; });
+
+        // Updates always start from the timetable, earlier updates of the trip are replaced
+        const unsigned int length = tripOffsets[trip + 1] - tripOffsets[trip];
+        auto saved = scheduledTripEvents.find(trip);
+        if (saved == scheduledTripEvents.end()) {
+            const TripEvent* current = tripEvents.data() + tripOffsets[trip];
+            saved = scheduledTripEvents.emplace(trip, std::vector<TripEvent>(current, current + length)).first;
+        }
+        const std::vector<TripEvent>& scheduled = saved->second;
+
+        // A delay holds until the next update, times never run backwards along the trip
+        events = scheduled;
+        int arrivalDelay = 0, departureDelay = 0;
+        int previous = 0;
+        size_t next = 0;
+        for (unsigned int k = 0; k < length; ++k) {
+            for (; next < starts.size() && starts[next].first == k; ++next) {
+                if (!starts[next].second->canceled) {
+                    arrivalDelay = starts[next].second->arrivalDelay;
+                    departureDelay = starts[next].second->departureDelay;
+                }
+            }
+            if ((arrivalDelay != 0 || departureDelay != 0) && !frequencyTrips[trip]) {
+                events[k].arrival = std::max(previous, scheduled[k].arrival + arrivalDelay);
+                events[k].departure = std::max(events[k].arrival, scheduled[k].departure + departureDelay);
+            }
+            previous = events[k].departure;
+        }
+
+        if (setTripTimes(trip, events.data(), canceled, faster)) {
+            changedTrips.push_back(trip);
+        }
+        const bool onTime = std::equal(events.begin(), events.end(), scheduled.begin(), [](const TripEvent& a, const TripEvent& b) {
+            return a.arrival == b.arrival && a.departure == b.departure;
+        });
+        if (onTime) {
+            scheduledTripEvents.erase(saved);
+        }
+    }
+    refreshRealtimeTables(changedTrips, faster);
+    return changedTrips.size();
+}
+
+void Network::clearRealtimeUpdates() {
+    std::vector<unsigned int> changedTrips;
+    bool faster = false;
+    for (const auto& pair : scheduledTripEvents) {
+        if (setTripTimes(pair.first, pair.second.data(), false, faster)) {
+            changedTrips.push_back(pair.first);
+        }
+    }
+    scheduledTripEvents.clear();
+    for (unsigned int t = 0; t < trips.size(); ++t) {
+        if (tripFlags[t] & TripFlag_Canceled) {
+            tripFlags[t] &= ~TripFlag_Canceled;
+            changedTrips.push_back(t);
+        }
+    }
+    refreshRealtimeTables(changedTrips, faster);
+}
+
+bool Network::setTripTimes(unsigned int trip, const TripEvent* events, bool canceled, bool& faster) {
+    const unsigned int begin = tripOffsets[trip];
+    const unsigned int length = tripOffsets[trip + 1] - begin;
+
+    // The lower bounds of A* and ALT only hold as long as no hop gets faster
+    unsigned int previous = INVALID_INDEX;
+    for (unsigned int k = 0; k < length; ++k) {
+        if (events[k].stop == INVALID_INDEX) {
+            continue;
+        }
+        if (previous != INVALID_INDEX &&
+            events[k].arrival - events[previous].departure < tripEvents[begin + k].arrival - tripEvents[begin + previous].departure) {
+            faster = true;
+        }
+        previous = k;
+    }
+
+    bool changed = ((tripFlags[trip] & TripFlag_Canceled) != 0) != canceled;
+    tripFlags[trip] = canceled ? tripFlags[trip] | TripFlag_Canceled : tripFlags[trip] & ~TripFlag_Canceled;
+    for (unsigned int k = 0; k < length; ++k) {
+        TripEvent& event = tripEvents[begin + k];
+        if (event.arrival != events[k].arrival || event.departure != events[k].departure) {
+            event.arrival = events[k].arrival;
+            event.departure = events[k].departure;
+            tripStopTimes[begin + k].arrivalTime = fromSeconds(event.arrival);
+            tripStopTimes[begin + k].departureTime = fromSeconds(event.departure);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void Network::refreshRealtimeTables(std::vector<unsigned int>& changedTrips, bool faster) {
+    if (changedTrips.empty()) {
+        return;
+    }
+
+    // Only the tables of the stops served by the changed trips are touched
+    std::sort(changedTrips.begin(), changedTrips.end());
+    std::vector<unsigned int> changedStops;
+    for (unsigned int trip : changedTrips) {
+        for (unsigned int i = tripOffsets[trip]; i < tripOffsets[trip + 1]; ++i) {
+            if (tripEvents[i].stop != INVALID_INDEX) {
+                changedStops.push_back(tripEvents[i].stop);
+            }
+        }
+    }
+    std::sort(changedStops.begin(), changedStops.end());
+    changedStops.erase(std::unique(changedStops.begin(), changedStops.end()), changedStops.end());
+
+    auto update = [&](Departure* begin, Departure* end, bool arrival) {
+        for (Departure* entry = begin; entry != end; ++entry) {
+            if (std::binary_search(changedTrips.begin(), changedTrips.end(), entry->trip)) {
+                const TripEvent& event = tripEvents[tripOffsets[entry->trip] + entry->position];
+                entry->time = arrival ? event.arrival : event.departure;
+            }
+        }
+    };
+    for (unsigned int stop : changedStops) {
+        Departure* begin = departures.data() + departureOffsets[stop];
+        Departure* end = departures.data() + departureOffsets[stop + 1];
+        update(begin, end, false);
+        std::sort(begin, end, departsBefore);
+
+        begin = routeDepartures.data() + departureOffsets[stop];
+        end = routeDepartures.data() + departureOffsets[stop + 1];
+        update(begin, end, false);
+        std::sort(begin, end, [this](const Departure& a, const Departure& b) {
+            return std::tie(tripRoutes[a.trip], a.time, a.trip) < std::tie(tripRoutes[b.trip], b.time, b.trip);
+        });
+
+        begin = arrivals.data() + arrivalOffsets[stop];
+        end = arrivals.data() + arrivalOffsets[stop + 1];
+        update(begin, end, true);
+        std::sort(begin, end, departsBefore);
+    }
+
+    // Route patterns stay valid unless a trip now overtakes one of its neighbours,
+    // the trip transfers depend on the times and always have to be computed again
+    bool overtaken = false;
+    for (unsigned int trip : changedTrips) {
+        const unsigned int pattern = tripPatterns[trip];
+        const unsigned int rank = tripPatternRanks[trip];
+        if ((rank > patternOffsets[pattern] && !tripFollows(patternTrips[rank - 1], trip)) ||
+            (rank + 1 < patternOffsets[pattern + 1] && !tripFollows(trip, patternTrips[rank + 1]))) {
+            overtaken = true;
+        }
+    }
+    if (overtaken) {
+        buildRoutePatterns();
+    } else {
+        tripTransferOffsets.clear();
+        tripTransfers.clear();
+    }
+
+    if (faster) {
+        landmarks.clear();
+        landmarkDistancesTo.clear();
+        landmarkDistancesFrom.clear();
+        buildHeuristic();
+    }
+    dataVersion = nextDataVersion++;
+}
+
+void Network::buildPathways() {
+    // Platforms are the stops trips call at, boarding areas belong to their platform
+    auto platformOf = [this](const std::string& stopId) {
+        auto it = stops.find(stopId);
+        if (it == stops.end()) {
+            return INVALID_INDEX;
+        }
+        if (it->second.locationType == LocationType_Stop) {
+            return getStopIndex(stopId);
+        }
+        if (it->second.locationType == LocationType_BoardingArea) {
+            return getStopIndex(it->second.parentStation);
+        }
+        return INVALID_INDEX;
+    };
+    auto stationOf = [this](const std::string& stopId) {
+        std::string id = stopId;
+        for (auto it = stops.find(id); it != stops.end() && !it->second.parentStation.empty() &&
+                                       it->second.locationType != LocationType_Station; it = stops.find(id)) {
+            id = it->second.parentStation;
+        }
+        return id;
+    };
+
+    // Pathway graph of every station, nodes are local to the station
+    struct Edge { unsigned int to; int time; };
+    struct StationGraph {
+        std::unordered_map<std::string, unsigned int> nodes;
+        std::vector<std::vector<Edge>> edges;
+        unsigned int node(const std::string& stopId) {
+            auto inserted = nodes.insert({stopId, (unsigned int)nodes.size()});
+            if (inserted.second) {
+                edges.emplace_back();
+            }
+            return inserted.first->second;
+        }
+    };
+    std::map<std::string, StationGraph> graphs;
+    for (const auto& pair : pathways) {
+        const Pathway& pathway = pair.second;
+        StationGraph& graph = graphs[stationOf(pathway.fromStopId)];
+        const unsigned int from = graph.node(pathway.fromStopId);
+        const unsigned int to = graph.node(pathway.toStopId);
+        const int time = pathway.traversalTime > 0 ? (int)pathway.traversalTime : (int)std::ceil(pathway.length / WALKING_SPEED);
+        graph.edges[from].push_back({to, time});
+        if (pathway.isBidirectional) {
+            graph.edges[to].push_back({from, time});
+        }
+    }
+
+    stationPlatformOffsets.assign(1, 0);
+    stationPlatforms.clear();
+    stationTimeOffsets.assign(1, 0);
+    stationTimes.clear();
+    for (auto& entry : graphs) {
+        StationGraph& graph = entry.second;
+        std::vector<std::string> nodeIds(graph.nodes.size());
+        for (const auto& node : graph.nodes) {
+            nodeIds[node.second] = node.first;
+        }
+
+        // Platforms of the station and the pathway nodes standing for them
+        std::vector<unsigned int> nodePlatforms(nodeIds.size());
+        const size_t firstPlatform = stationPlatforms.size();
+        for (size_t n = 0; n < nodeIds.size(); ++n) {
+            nodePlatforms[n] = platformOf(nodeIds[n]);
+            if (nodePlatforms[n] != INVALID_INDEX &&
+                std::find(stationPlatforms.begin() + firstPlatform, stationPlatforms.end(), nodePlatforms[n]) == stationPlatforms.end()) {
+                stationPlatforms.push_back(nodePlatforms[n]);
+            }
+        }
+        const size_t platformCount = stationPlatforms.size() - firstPlatform;
+        if (platformCount < 2) {
+            stationPlatforms.resize(firstPlatform);
+            continue;
+        }
+        std::sort(stationPlatforms.begin() + firstPlatform, stationPlatforms.end());
+        auto platformSlot = [&](unsigned int stop) {
+            return std::lower_bound(stationPlatforms.begin() + firstPlatform, stationPlatforms.end(), stop) - (stationPlatforms.begin() + firstPlatform);
+        };
+
+        // Pathway nodes linked in either direction, only those pairs are judged by the pathways
+        std::vector<unsigned int> components(nodeIds.size());
+        for (size_t n = 0; n < nodeIds.size(); ++n) {
+            components[n] = (unsigned int)n;
+        }
+        auto componentOf = [&](unsigned int node) {
+            while (components[node] != node) {
+                node = components[node] = components[components[node]];
+            }
+            return node;
+        };
+        for (size_t n = 0; n < nodeIds.size(); ++n) {
+            for (const Edge& edge : graph.edges[n]) {
+                components[componentOf((unsigned int)n)] = componentOf(edge.to);
+            }
+        }
+
+        // Shortest paths from every platform node over the pathway graph
+        const size_t matrix = stationTimes.size();
+        stationTimes.resize(matrix + platformCount * platformCount, UNLINKED_PATHWAY);
+        std::vector<int> times(nodeIds.size());
+        std::vector<QueueEntry> heap;
+        for (size_t source = 0; source < nodeIds.size(); ++source) {
+            if (nodePlatforms[source] == INVALID_INDEX) {
+                continue;
+            }
+            std::fill(times.begin(), times.end(), INFINITE_TIME);
+            times[source] = 0;
+            heap.assign(1, {0, (unsigned int)source});
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), std::greater<QueueEntry>());
+                QueueEntry current = heap.back();
+                heap.pop_back();
+                if (current.time > times[current.stop]) {
+                    continue;
+                }
+                for (const Edge& edge : graph.edges[current.stop]) {
+                    if (current.time + edge.time < times[edge.to]) {
+                        times[edge.to] = current.time + edge.time;
+                        heap.push_back({times[edge.to], edge.to});
+                        std::push_heap(heap.begin(), heap.end(), std::greater<QueueEntry>());
+                    }
+                }
+            }
+
+            const size_t row = matrix + platformSlot(nodePlatforms[source]) * platformCount;
+            for (size_t target = 0; target < nodeIds.size(); ++target) {
+                if (nodePlatforms[target] != INVALID_INDEX && componentOf((unsigned int)target) == componentOf((unsigned int)source)) {
+                    uint16_t& entry = stationTimes[row + platformSlot(nodePlatforms[target])];
+                    entry = std::min<int>(entry, times[target] == INFINITE_TIME ? UNREACHABLE_PATHWAY : std::min<int>(times[target], UNREACHABLE_PATHWAY - 1));
+                }
+            }
+        }
+        stationPlatformOffsets.push_back(stationPlatforms.size());
+        stationTimeOffsets.push_back(stationTimes.size());
+    }
+}
+
+void Network::buildFootpaths() {
+    const size_t stopCount = stopIds.size();
+
+    // Changing between stops of the same station takes no time unless pathways.txt or transfers.txt say otherwise
+    std::map<std::pair<unsigned int, unsigned int>, int> durations;
+    for (unsigned int s = 0; s < stopCount; ++s) {
+        for (unsigned int t = transferOffsets[s]; t < transferOffsets[s + 1]; ++t) {
+            durations[{s, transferStops[t]}] = 0;
+        }
+    }
+
+    // Platforms linked by pathways.txt take the shortest walk through the station, linked
+    // pairs without a way between them get no footpath unless transfers.txt adds one
+    for (size_t station = 0; station + 1 < stationPlatformOffsets.size(); ++station) {
+        const unsigned int first = stationPlatformOffsets[station];
+        const unsigned int count = stationPlatformOffsets[station + 1] - first;
+        for (unsigned int a = 0; a < count; ++a) {
+            for (unsigned int b = 0; b < count; ++b) {
+                const uint16_t time = stationTimes[stationTimeOffsets[station] + a * count + b];
+                if (a != b && time != UNLINKED_PATHWAY) {
+                    durations[{stationPlatforms[first + a], stationPlatforms[first + b]}] = time == UNREACHABLE_PATHWAY ? INFINITE_TIME : time;
+                }
+            }
+        }
+    }
+    stopChangeTimes.assign(stopCount, 0);
+    std::vector<std::vector<TransferRule>> rules(stopCount);
+
+    // Transfers may reference a station, which applies to all of its stops
+    auto expand = [this](const std::string& stopId) {
+        std::vector<unsigned int> result;
+        auto stopIt = stops.find(stopId);
+        if (stopIt == stops.end()) {
+            return result;
+        }
+        if (stopIt->second.locationType == LocationType_Station) {
+            auto range = stopsForTransferMap.equal_range(stopId);
+            for (auto it = range.first; it != range.second; ++it) {
+                result.push_back(getStopIndex(it->second));
+            }
+        } else {
+            result.push_back(getStopIndex(stopId));
+        }
+        return result;
+    };
+    auto resolve = [](const std::unordered_map<std::string_view, unsigned int>& index, const std::string& id, bool& known) {
+        if (id.empty()) {
+            return INVALID_INDEX;
+        }
+        auto it = index.find(id);
+        if (it == index.end()) {
+            known = false;
+            return INVALID_INDEX;
+        }
+        return it->second;
+    };
+
+    for (const Transfer& transfer : transfers) {
+        bool known = true;
+        const unsigned int fromRoute = resolve(routeIndex, transfer.fromRouteId, known);
+        const unsigned int toRoute = resolve(routeIndex, transfer.toRouteId, known);
+        const unsigned int fromTrip = resolve(tripIndex, transfer.fromTripId, known);
+        const unsigned int toTrip = resolve(tripIndex, transfer.toTripId, known);
+        if (!known) {
+            continue; // Rules for unknown routes or trips can never match
+        }
+
+        const bool qualified = fromRoute != INVALID_INDEX || toRoute != INVALID_INDEX || fromTrip != INVALID_INDEX || toTrip != INVALID_INDEX;
+        const int minTransferTime = (int)transfer.minTransferTime;
+        const int duration = transfer.type == TransferType_NoTransfer ? INFINITE_TIME :
+                             transfer.type == TransferType_MinTransferTime ? minTransferTime : 0;
+        for (unsigned int from : expand(transfer.fromStopId)) {
+            for (unsigned int to : expand(transfer.toStopId)) {
+                if (qualified) {
+                    rules[from].push_back({to, fromRoute, toRoute, fromTrip, toTrip, transfer.type, minTransferTime});
+                } else if (from == to) {
+                    stopChangeTimes[from] = duration;
+                } else {
+                    durations[{from, to}] = duration;
+                }
+            }
+        }
+    }
+
+    // Walk between nearby stops served by trips, unless transfers.txt already covers the pair
+    stopLatitudes.assign(stopCount, MISSING_COORDINATE);
+    stopLongitudes.assign(stopCount, MISSING_COORDINATE);
+    for (unsigned int s = 0; s < stopCount; ++s) {
+        const Stop& stop = stops.at(stopIds[s]);
+        if (stop.latitide != 0 || stop.longitude != 0) {
+            stopLatitudes[s] = toMicrodegrees(stop.latitide);
+            stopLongitudes[s] = toMicrodegrees(stop.longitude);
+        }
+    }
+    stopGrid.build(stopLatitudes, stopLongitudes, footpathRadius);
+    if (footpathRadius > 0) {
+        for (unsigned int s = 0; s < stopCount; ++s) {
+            if (stopEventOffsets[s] == stopEventOffsets[s + 1] || stopLatitudes[s] == MISSING_COORDINATE) {
+                continue;
+            }
+            stopGrid.forEachWithin(fromMicrodegrees(stopLatitudes[s]), fromMicrodegrees(stopLongitudes[s]), footpathRadius, [&](unsigned int other, double meters) {
+                if (other != s && stopEventOffsets[other] != stopEventOffsets[other + 1]) {
+                    durations.insert({{s, other}, (int)std::ceil(meters / WALKING_SPEED)});
+                }
+            });
+        }
+    }
+
+    // Footpaths grouped by from stop, forbidden transfers are dropped
+    footpathOffsets.assign(stopCount + 1, 0);
+    footpaths.clear();
+    for (const auto& pair : durations) {
+        if (pair.second != INFINITE_TIME) {
+            footpaths.push_back({pair.first.second, pair.second});
+            footpathOffsets[pair.first.first + 1]++;
+        }
+    }
+    for (size_t s = 0; s < stopCount; ++s) {
+        footpathOffsets[s + 1] += footpathOffsets[s];
+    }
+
+    // The same footpaths grouped by target stop, for searches towards a stop
+    incomingFootpathOffsets.assign(stopCount + 1, 0);
+    for (const Footpath& footpath : footpaths) {
+        incomingFootpathOffsets[footpath.stop + 1]++;
+    }
+    for (size_t s = 0; s < stopCount; ++s) {
+        incomingFootpathOffsets[s + 1] += incomingFootpathOffsets[s];
+    }
+    std::vector<unsigned int> fill(incomingFootpathOffsets.begin(), incomingFootpathOffsets.end() - 1);
+    incomingFootpaths.resize(footpaths.size());
+    for (unsigned int s = 0; s < stopCount; ++s) {
+        for (unsigned int f = footpathOffsets[s]; f < footpathOffsets[s + 1]; ++f) {
+            incomingFootpaths[fill[footpaths[f].stop]++] = {s, footpaths[f].duration};
+        }
+    }
+
+    transferRuleOffsets.assign(1, 0);
+    transferRules.clear();
+    for (size_t s = 0; s < stopCount; ++s) {
+        transferRules.insert(transferRules.end(), rules[s].begin(), rules[s].end());
+        transferRuleOffsets.push_back(transferRules.size());
+    }
+}
+
+std::vector<StopTime> Network::getTravelPlanDepartingAt(const std::string& fromStopId, 
+                                                        const std::string& toStopId, 
+                                                        const GTFSTime& departureTime) const {
+    return getTravelPlanDepartingAt(QueryContext::local(), fromStopId, toStopId, departureTime);
+}
+
+std::vector<StopTime> Network::getTravelPlanDepartingAt(QueryContext& context,
+                                                        const std::string& fromStopId,
+                                                        const std::string& toStopId,
+                                                        const GTFSTime& departureTime,
+                                                        const QueryOptions& options) const {
+    // Check if stops exist
+    const unsigned int source = getStopIndex(fromStopId);
+    const unsigned int target = getStopIndex(toStopId);
+    if (source == INVALID_INDEX || target == INVALID_INDEX) {
+        return {}; // Return empty if either stop doesn't exist
+    }
+    
+    if (source == target || !planReachability.mayReach(source, target)) {
+        return {};
+    }
+
+    const int departure = toSeconds(departureTime);
+    if (queryCache == nullptr) {
+        return searchTravelPlanDepartingAt(context, source, target, departure, options);
+    }
+    const QueryCacheKey key = queryCache->makeKey(source, target, departure, false, options);
+    std::vector<StopTime> plan;
+    if (!queryCache->find(key, departure, dataVersion, plan)) {
+        plan = searchTravelPlanDepartingAt(context, source, target, departure, options);
+        cacheTravelPlan(key, source, departure, plan);
+    }
+    return plan;
+}
+
+void Network::cacheTravelPlan(const QueryCacheKey& key, unsigned int source, int departure, const std::vector<StopTime>& plan) const {
+    // Leaving later still catches the first vehicle until it departs
+    int validUntil = INFINITE_TIME;
+    if (!plan.empty()) {
+        const int walk = getWalkingTime(source, getStopIndex(plan.front().stopId));
+        validUntil = walk == INFINITE_TIME ? departure : toSeconds(plan.front().departureTime) - walk;
+    }
+    queryCache->insert(key, dataVersion, departure, validUntil, plan);
+}
+
+std::vector<StopTime> Network::searchTravelPlanDepartingAt(QueryContext& context, unsigned int source, unsigned int target, int departure,
+                                                           const QueryOptions& options) const {
+    // Without a target the search labels every stop, see streamTravelPlansDepartingAt().
+    // The trip-based search falls back to Dijkstra without preprocessed transfers and
+    // for filtered queries, the transfers were pruned with all trips of the network.
+    const bool toAll = target == INVALID_INDEX;
+    const uint32_t rejected = compileTripFilter(context, options);
+    const bool filtered = rejected != TripFlag_Canceled || !options.agencyIds.empty();
+    if (options.algorithm == RoutingAlgorithm_TripBased && !toAll && !filtered && !tripTransferOffsets.empty()) {
+        return getTripBasedTravelPlan(context, source, target, departure);
+    }
+    auto rides = [&](unsigned int trip) {
+        return (tripFlags[trip] & rejected) == 0 &&
+               (options.agencyIds.empty() || (tripAgencies[trip] != INVALID_INDEX && context.agencies[tripAgencies[trip]]));
+    };
+
+    // Labels only hold a reference to their predecessor, the journey itself is
+    // reconstructed once the search is finished
+    context.reset(stopIds.size());
+
+    // A* adds a lower bound of the remaining travel time to the boarding time of each stop:
+    // the distance to the target at the fastest speed in the feed
+    const bool guided = !toAll && (options.algorithm == RoutingAlgorithm_AStar || options.algorithm == RoutingAlgorithm_ALT) && heuristicScale > 0 &&
+                        clusterLatitudes[stopClusters[target]] != MISSING_COORDINATE;
+    if (guided) {
+        const unsigned int targetCluster = stopClusters[target];
+        context.targetDistances.resize(clusterLatitudes.size());
+        computeDistances(clusterLatitudes[targetCluster], clusterLongitudes[targetCluster], clusterLatitudes.data(), clusterLongitudes.data(),
+                         clusterLatitudes.size(), context.targetDistances.data(), heuristicLatitude);
+    }
+
+    // ALT takes the best triangle inequality bound over all landmarks: travel times
+    // to a landmark and from a landmark differ by at most the time from stop to target
+    const size_t landmarkCount = !toAll && options.algorithm == RoutingAlgorithm_ALT ? landmarks.size() : 0;
+    context.targetLandmarks.resize(2 * landmarkCount);
+    for (size_t l = 0; l < landmarkCount; ++l) {
+        context.targetLandmarks[l] = landmarkDistancesTo[target * landmarkCount + l];
+        context.targetLandmarks[landmarkCount + l] = landmarkDistancesFrom[target * landmarkCount + l];
+    }
+    auto bound = [&](unsigned int stop) {
+        int result = guided ? (int)(context.targetDistances[stopClusters[stop]] * heuristicScale) : 0;
+        const uint16_t* to = landmarkDistancesTo.data() + stop * landmarkCount;
+        const uint16_t* from = landmarkDistancesFrom.data() + stop * landmarkCount;
+        for (size_t l = 0; l < landmarkCount; ++l) {
+            // Saturated target entries give no bound, saturated stop entries still do
+            if (context.targetLandmarks[l] != SATURATED_LANDMARK) {
+                result = std::max(result, (int)to[l] - (int)context.targetLandmarks[l]);
+            }
+            if (context.targetLandmarks[landmarkCount + l] != SATURATED_LANDMARK) {
+                result = std::max(result, (int)context.targetLandmarks[landmarkCount + l] - (int)from[l]);
+            }
+        }
+        return result;
+    };
+
+    // Earliest arrival at the target and the stop whose ride arrival leads there
+    int targetArrival = INFINITE_TIME;
+    unsigned int targetVia = INVALID_INDEX;
+
+    // Transfer rules of the stop we arrived at may allow departures before the ready time,
+    // the heap is keyed by this earliest departure so no rule based change is cut off
+    auto earliestDeparture = [&](const StopLabel& label) {
+        if (label.readyFrom != INVALID_INDEX && transferRuleOffsets[label.readyFrom] != transferRuleOffsets[label.readyFrom + 1]) {
+            return std::min(label.ready, context.label(label.readyFrom).arrival);
+        }
+        return label.ready;
+    };
+
+    // Make a stop ready for boarding at the given time, coming from the ride arriving at stop from
+    auto relaxReady = [&](unsigned int stop, int time, unsigned int from) {
+        if (stop == target && time < targetArrival) {
+            targetArrival = time;
+            targetVia = from;
+        }
+        StopLabel& label = context.label(stop);
+        if (time < label.ready && !context.isSettled(stop)) {
+            label.ready = time;
+            label.readyFrom = from;
+            context.push({earliestDeparture(label) + bound(stop), stop});
+        }
+    };
+
+    context.label(source).ready = departure;
+    context.push({departure + bound(source), source});
+    for (unsigned int f = footpathOffsets[source]; f < footpathOffsets[source + 1]; ++f) {
+        relaxReady(footpaths[f].stop, departure + footpaths[f].duration, source);
+    }
+    
+    while (!context.heap.empty()) {
+        QueueEntry current = context.pop();
+        
+        // Skip outdated entries
+        if (context.isSettled(current.stop) || earliestDeparture(context.label(current.stop)) + bound(current.stop) < current.time) {
+            continue;
+        }
+        context.settle(current.stop);
+        const StopLabel here = context.label(current.stop);
+        const int earliest = earliestDeparture(here);
+
+        // Nothing boarded from now on can arrive earlier
+        if (earliest + bound(current.stop) >= targetArrival) {
+            break;
+        }
+        
+        // Ride the trip from here to all following stops
+        auto ride = [&](unsigned int trip, unsigned int position, int shift) {
+            const unsigned int begin = tripOffsets[trip];
+            const unsigned int end = tripOffsets[trip + 1];
+
+            for (unsigned int j = begin + position + 1; j < end; ++j) {
+                const TripEvent& next = tripEvents[j];
+                if (next.stop == INVALID_INDEX || next.stop == source || (options.wheelchairAccessible && !wheelchairStops[next.stop])) {
+                    continue;
+                }
+                const int arrival = next.arrival + shift;
+                StopLabel& label = context.label(next.stop);
+                if (arrival >= label.arrival) {
+                    continue;
+                }
+                label.arrival = arrival;
+                label.parentStop = current.stop;
+                label.trip = trip;
+                label.boardPosition = position;
+                label.alightPosition = j - begin;
+                label.shift = shift;
+                if (next.stop == target && arrival < targetArrival) {
+                    targetArrival = arrival;
+                    targetVia = target;
+                }
+
+                // Change trips at the same stop or walk to another one
+                if (stopChangeTimes[next.stop] != INFINITE_TIME) {
+                    relaxReady(next.stop, arrival + stopChangeTimes[next.stop], next.stop);
+                }
+                for (unsigned int f = footpathOffsets[next.stop]; f < footpathOffsets[next.stop + 1]; ++f) {
+                    relaxReady(footpaths[f].stop, arrival + footpaths[f].duration, next.stop);
+                }
+            }
+        };
+
+        // Every trip departing from here after our arrival
+        if (options.wheelchairAccessible && !wheelchairStops[current.stop]) {
+            continue;
+        }
+        const Departure* first = findFirstDeparture(departures.data() + departureOffsets[current.stop],
+                                                    departures.data() + departureOffsets[current.stop + 1],
+                                                    earliest);
+        for (const Departure* event = first; event != departures.data() + departureOffsets[current.stop + 1]; ++event) {
+            if (rides(event->trip) && canBoard(context, current.stop, here, event->trip, 0, event->time)) {
+                ride(event->trip, event->position, 0);
+            }
+        }
+
+        // The next boardable run of every headway based trip
+        for (unsigned int f = frequencyOffsets[current.stop]; f < frequencyOffsets[current.stop + 1]; ++f) {
+            const FrequencyDeparture& frequency = frequencyDepartures[f];
+            if (!rides(frequency.trip)) {
+                continue;
+            }
+            const int templateTime = tripEvents[tripOffsets[frequency.trip] + frequency.position].departure;
+            for (int time = nextRun(frequency, earliest); time != INFINITE_TIME; time = nextRun(frequency, time + 1)) {
+                if (canBoard(context, current.stop, here, frequency.trip, time - templateTime, time)) {
+                    ride(frequency.trip, frequency.position, time - templateTime);
+                    break;
+                }
+            }
+        }
+    }
+    
+    if (targetVia == INVALID_INDEX) {
+        return {}; // No path found
+    }
+    return reconstructTravelPlan(context, targetVia);
+}
+
+std::vector<StopTime> Network::getTravelPlanArrivingBy(const std::string& fromStopId,
+                                                       const std::string& toStopId,
+                                                       const GTFSTime& arrivalTime) const {
+    return getTravelPlanArrivingBy(QueryContext::local(), fromStopId, toStopId, arrivalTime);
+}
+
+std::vector<StopTime> Network::getTravelPlanArrivingBy(QueryContext& context,
+                                                       const std::string& fromStopId,
+                                                       const std::string& toStopId,
+                                                       const GTFSTime& arrivalTime,
+                                                       const QueryOptions& options) const {
+    const unsigned int source = getStopIndex(fromStopId);
+    const unsigned int target = getStopIndex(toStopId);
+    if (source == INVALID_INDEX || target == INVALID_INDEX || source == target || !planReachability.mayReach(source, target)) {
+        return {};
+    }
+
+    const int arrival = toSeconds(arrivalTime);
+    if (queryCache == nullptr) {
+        return searchTravelPlanArrivingBy(context, source, target, arrival, options);
+    }
+    const QueryCacheKey key = queryCache->makeKey(source, target, arrival, true, options);
+    std::vector<StopTime> plan;
+    if (!queryCache->find(key, arrival, dataVersion, plan)) {
+        plan = searchTravelPlanArrivingBy(context, source, target, arrival, options);
+
+        // Arriving earlier is fine as long as the last vehicle still arrives in time
+        int validFrom = -INFINITE_TIME;
+        if (!plan.empty()) {
+            const int walk = getWalkingTime(getStopIndex(plan.back().stopId), target);
+            validFrom = walk == INFINITE_TIME ? arrival : toSeconds(plan.back().arrivalTime) + walk;
+        }
+        queryCache->insert(key, dataVersion, validFrom, arrival, plan);
+    }
+    return plan;
+}
+
+std::vector<StopTime> Network::searchTravelPlanArrivingBy(QueryContext& context, unsigned int source, unsigned int target, int arrival,
+                                                          const QueryOptions& options) const {
+
+    // The backward search mirrors getTravelPlanDepartingAt. Labels store negated times,
+    // so the latest departure is the smallest value and the min-heap pops the latest
+    // deadline first. The ride part of a label is the latest departure by a vehicle:
+    // boarded here and left at parentStop. The ready part is the latest time to arrive
+    // here, before changing to or walking over to the ride departing from readyFrom.
+    const uint32_t rejected = compileTripFilter(context, options);
+    auto rides = [&](unsigned int trip) {
+        return (tripFlags[trip] & rejected) == 0 &&
+               (options.agencyIds.empty() || (tripAgencies[trip] != INVALID_INDEX && context.agencies[tripAgencies[trip]]));
+    };
+    context.reset(stopIds.size());
+
+    // Latest departure from the source and the stop whose ride departure it is based on
+    int sourceDeparture = INFINITE_TIME;
+    unsigned int sourceVia = INVALID_INDEX;
+
+    // Transfer rules of the stop we leave the vehicle at may allow arrivals after the deadline,
+    // the heap is keyed by this latest arrival like the forward search
+    auto latestArrival = [&](unsigned int stop, const StopLabel& label) {
+        if (label.readyFrom != INVALID_INDEX && transferRuleOffsets[stop] != transferRuleOffsets[stop + 1]) {
+            return std::min(label.ready, context.label(label.readyFrom).arrival);
+        }
+        return label.ready;
+    };
+
+    auto relaxDeadline = [&](unsigned int stop, int time, unsigned int from) {
+        if (stop == source && time < sourceDeparture) {
+            sourceDeparture = time;
+            sourceVia = from;
+        }
+        StopLabel& label = context.label(stop);
+        if (time < label.ready && !context.isSettled(stop)) {
+            label.ready = time;
+            label.readyFrom = from;
+            context.push({latestArrival(stop, label), stop});
+        }
+    };
+
+    const int deadline = -arrival;
+    context.label(target).ready = deadline;
+    context.push({deadline, target});
+    for (unsigned int f = incomingFootpathOffsets[target]; f < incomingFootpathOffsets[target + 1]; ++f) {
+        relaxDeadline(incomingFootpaths[f].stop, deadline + incomingFootpaths[f].duration, target);
+    }
+
+    while (!context.heap.empty()) {
+        QueueEntry current = context.pop();
+        if (context.isSettled(current.stop) || latestArrival(current.stop, context.label(current.stop)) < current.time) {
+            continue;
+        }
+        context.settle(current.stop);
+        const StopLabel here = context.label(current.stop);
+        const int latest = latestArrival(current.stop, here);
+
+        // Nothing left from now on can depart later
+        if (latest >= sourceDeparture) {
+            break;
+        }
+
+        // Ride the trip backwards to all stops before the one we leave it at
+        auto ride = [&](unsigned int trip, unsigned int position, int shift) {
+            const unsigned int begin = tripOffsets[trip];
+            for (unsigned int j = position; j-- > 0;) {
+                const TripEvent& previous = tripEvents[begin + j];
+                if (previous.stop == INVALID_INDEX || previous.stop == target ||
+                    tripStopTimes[begin + j].pickupType == PickupType_NoPickup ||
+                    (options.wheelchairAccessible && !wheelchairStops[previous.stop])) {
+                    continue;
+                }
+                const int departure = -(previous.departure + shift);
+                StopLabel& label = context.label(previous.stop);
+                if (departure >= label.arrival) {
+                    continue;
+                }
+                label.arrival = departure;
+                label.parentStop = current.stop;
+                label.trip = trip;
+                label.boardPosition = j;
+                label.alightPosition = position;
+                label.shift = shift;
+                if (previous.stop == source && departure < sourceDeparture) {
+                    sourceDeparture = departure;
+                    sourceVia = source;
+                }
+
+                // Arrive early enough to change trips here or to walk over from another stop
+                if (stopChangeTimes[previous.stop] != INFINITE_TIME) {
+                    relaxDeadline(previous.stop, departure + stopChangeTimes[previous.stop], previous.stop);
+                }
+                for (unsigned int f = incomingFootpathOffsets[previous.stop]; f < incomingFootpathOffsets[previous.stop + 1]; ++f) {
+                    relaxDeadline(incomingFootpaths[f].stop, departure + incomingFootpaths[f].duration, previous.stop);
+                }
+            }
+        };
+
+        // Every trip arriving here before the deadline, latest first
+        if (options.wheelchairAccessible && !wheelchairStops[current.stop]) {
+            continue;
+        }
+        const Departure* first = arrivals.data() + arrivalOffsets[current.stop];
+        for (const Departure* event = findFirstDeparture(first, arrivals.data() + arrivalOffsets[current.stop + 1], -latest + 1);
+             event-- != first;) {
+            if (rides(event->trip) && canAlight(context, current.stop, here, event->trip, 0, event->time)) {
+                ride(event->trip, event->position, 0);
+            }
+        }
+
+        // The previous run of every headway based trip that can be left in time
+        for (unsigned int f = frequencyArrivalOffsets[current.stop]; f < frequencyArrivalOffsets[current.stop + 1]; ++f) {
+            const FrequencyDeparture& frequency = frequencyArrivals[f];
+            if (!rides(frequency.trip)) {
+                continue;
+            }
+            const int templateTime = tripEvents[tripOffsets[frequency.trip] + frequency.position].arrival;
+            for (int time = previousRun(frequency, -latest); time != INFINITE_TIME; time = previousRun(frequency, time - 1)) {
+                if (canAlight(context, current.stop, here, frequency.trip, time - templateTime, time)) {
+                    ride(frequency.trip, frequency.position, time - templateTime);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (sourceVia == INVALID_INDEX) {
+        return {}; // No path found
+    }
+
+    // Follow the rides forward from the source, the plan has the same shape as a forward one
+    std::vector<StopTime> plan;
+    for (unsigned int stop = sourceVia; stop != INVALID_INDEX && context.label(stop).trip != INVALID_INDEX;
+         stop = context.label(context.label(stop).parentStop).readyFrom) {
+        const StopLabel& ride = context.label(stop);
+        const unsigned int first = plan.empty() ? ride.boardPosition : ride.boardPosition + 1;
+        for (unsigned int position = first; position <= ride.alightPosition; ++position) {
+            plan.push_back(getStopTime(ride.trip, position, ride.shift));
+        }
+    }
+    return plan;
+}
+
+std::vector<StopTime> Network::getTripBasedTravelPlan(QueryContext& context, unsigned int source, unsigned int target, int departure) const {
+    context.reset(stopIds.size(), trips.size());
+
+    // The ready time of a stop label holds the walking time from there to the target
+    context.label(target).ready = 0;
+    for (unsigned int f = incomingFootpathOffsets[target]; f < incomingFootpathOffsets[target + 1]; ++f) {
+        StopLabel& label = context.label(incomingFootpaths[f].stop);
+        label.ready = std::min(label.ready, incomingFootpaths[f].duration);
+    }
+
+    // Queue the part of a trip that was not reached before. Later trips of the same
+    // pattern arrive later everywhere, so they count as reached from here as well.
+    auto enqueue = [&](unsigned int trip, unsigned int position, unsigned int parent, unsigned int parentPosition) {
+        const unsigned int length = tripOffsets[trip + 1] - tripOffsets[trip];
+        const unsigned int reached = context.reached(trip, length);
+        if (position >= reached) {
+            return;
+        }
+        context.segments.push_back({trip, position, std::min(reached, length - 1), parent, parentPosition});
+        for (unsigned int r = tripPatternRanks[trip]; r < patternOffsets[tripPatterns[trip] + 1]; ++r) {
+            unsigned int& later = context.reached(patternTrips[r], length);
+            if (later <= position) {
+                break; // Trips after this one were marked by an earlier segment
+            }
+            later = position;
+        }
+    };
+
+    // Walking all the way, then the first trip of every pattern at the start or in walking distance
+    int targetArrival = context.label(source).ready == INFINITE_TIME ? INFINITE_TIME : departure + context.label(source).ready;
+    auto boardAt = [&](unsigned int stop, int time) {
+        for (unsigned int e = stopPatternOffsets[stop]; e < stopPatternOffsets[stop + 1]; ++e) {
+            const PatternEvent& pattern = stopPatterns[e];
+            const unsigned int r = findFirstPatternTrip(pattern.pattern, pattern.position, time);
+            if (r < patternOffsets[pattern.pattern + 1] && !frequencyTrips[patternTrips[r]]) {
+                enqueue(patternTrips[r], pattern.position, INVALID_INDEX, 0);
+            }
+        }
+    };
+    boardAt(source, departure);
+    for (unsigned int f = footpathOffsets[source]; f < footpathOffsets[source + 1]; ++f) {
+        boardAt(footpaths[f].stop, departure + footpaths[f].duration);
+    }
+
+    // Scan the segments in the order they were reached, which is by number of transfers
+    unsigned int best = INVALID_INDEX;
+    unsigned int bestPosition = 0;
+    for (size_t s = 0; s < context.segments.size(); ++s) {
+        const TripSegment segment = context.segments[s];
+        const unsigned int begin = tripOffsets[segment.trip];
+        context.settledCount++;
+
+        // Arrivals along a trip never decrease, nothing after the target arrival can help
+        for (unsigned int k = segment.from + 1; k <= segment.to && tripEvents[begin + k].arrival < targetArrival; ++k) {
+            const TripEvent& event = tripEvents[begin + k];
+            if (event.stop != INVALID_INDEX && context.label(event.stop).ready != INFINITE_TIME &&
+                event.arrival + context.label(event.stop).ready < targetArrival) {
+                targetArrival = event.arrival + context.label(event.stop).ready;
+                best = (unsigned int)s;
+                bestPosition = k;
+            }
+        }
+        for (unsigned int k = segment.from + 1; k <= segment.to && tripEvents[begin + k].arrival < targetArrival; ++k) {
+            for (unsigned int x = tripTransferOffsets[begin + k]; x < tripTransferOffsets[begin + k + 1]; ++x) {
+                enqueue(tripTransfers[x].trip, tripTransfers[x].position, (unsigned int)s, k);
+            }
+        }
+    }
+
+    if (best == INVALID_INDEX) {
+        return {}; // No path found or walking is fastest
+    }
+
+    // Follow the parent segments back to the start, then ride them in order
+    context.path.clear();
+    for (unsigned int s = best; s != INVALID_INDEX; s = context.segments[s].parent) {
+        context.path.push_back(s);
+    }
+    std::vector<StopTime> plan;
+    for (size_t i = context.path.size(); i-- > 0;) {
+        const TripSegment& segment = context.segments[context.path[i]];
+        const unsigned int alight = i == 0 ? bestPosition : context.segments[context.path[i - 1]].parentPosition;
+        for (unsigned int position = plan.empty() ? segment.from : segment.from + 1; position <= alight; ++position) {
+            plan.push_back(getStopTime(segment.trip, position, 0));
+        }
+    }
+    return plan;
+}
+
+unsigned int Network::findFirstPatternTrip(unsigned int pattern, unsigned int position, int time) const {
+    // Trips of a pattern never overtake each other, so departures are sorted at every position
+    const unsigned int* begin = patternTrips.data() + patternOffsets[pattern];
+    const unsigned int* end = patternTrips.data() + patternOffsets[pattern + 1];
+    const unsigned int* it = std::partition_point(begin, end, [&](unsigned int trip) {
+        return tripEvents[tripOffsets[trip] + position].departure < time;
+    });
+    while (it != end && ((tripFlags[*it] & TripFlag_Canceled) || tripStopTimes[tripOffsets[*it] + position].pickupType == PickupType_NoPickup)) {
+        ++it;
+    }
+    return (unsigned int)(it - patternTrips.data());
+}
+
+std::vector<std::vector<StopTime>> Network::getTravelPlansDepartingAt(const std::vector<TravelPlanQuery>& queries,
+                                                                     BatchStatistics* statistics,
+                                                                     unsigned int threadCount) const {
+    std::vector<std::vector<StopTime>> plans(queries.size());
+    streamTravelPlansDepartingAt(queries, [&plans](size_t index, std::vector<StopTime>& plan) {
+        plans[index] = std::move(plan);
+    }, statistics, threadCount);
+    return plans;
+}
+
+void Network::streamTravelPlansDepartingAt(const std::vector<TravelPlanQuery>& queries,
+                                           const std::function<void(size_t index, std::vector<StopTime>& plan)>& callback,
+                                           BatchStatistics* statistics,
+                                           unsigned int threadCount) const {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    auto secondsSince = [](Clock::time_point from) {
+        return std::chrono::duration<double>(Clock::now() - from).count();
+    };
+
+    // Dijkstra queries leaving the same stop at the same time with the same options share
+    // one search. A* and ALT only pay off towards one target, and the trip-based search
+    // has no search to all stops, so their queries keep a group of their own.
+    struct Group {
+        unsigned int source;
+        int departure;
+        QueryOptions options;
+        std::vector<size_t> queries;
+    };
+    std::vector<Group> groups;
+    std::map<std::pair<unsigned int, int>, std::vector<size_t>> groupsByOrigin;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const unsigned int source = getStopIndex(queries[i].fromStopId);
+        const int departure = toSeconds(queries[i].departureTime);
+        std::vector<size_t>& candidates = groupsByOrigin[{source, departure}];
+        auto group = std::find_if(candidates.begin(), candidates.end(), [&](size_t g) { return groups[g].options == queries[i].options; });
+        if (queries[i].options.algorithm != RoutingAlgorithm_Dijkstra) {
+            group = candidates.end();
+        }
+        if (group == candidates.end()) {
+            candidates.push_back(groups.size());
+            groups.push_back({source, departure, queries[i].options, {}});
+            group = candidates.end() - 1;
+        }
+        groups[*group].queries.push_back(i);
+    }
+
+    // Large groups first so the pool can even out the small ones at the end
+    std::stable_sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) {
+        return a.queries.size() > b.queries.size();
+    });
+
+    std::vector<QueryContext> contexts(WorkStealingPool::getWorkerCount(groups.size(), threadCount));
+    std::vector<double> latencies(queries.size(), 0.0);
+    std::atomic<size_t> searches{0};
+    std::mutex callbackMutex;
+    auto deliver = [&](size_t index, std::vector<StopTime>& plan) {
+        std::lock_guard<std::mutex> lock(callbackMutex);
+        callback(index, plan);
+    };
+
+    WorkStealingPool::run(groups.size(), threadCount, [&](size_t g, unsigned int worker) {
+        const Group& group = groups[g];
+        QueryContext& context = contexts[worker];
+        auto key = [&](unsigned int target) {
+            return queryCache->makeKey(group.source, target, group.departure, false, group.options);
+        };
+
+        // Plans of unconnected stops and cached plans are handed out right away
+        Clock::time_point begin = Clock::now();
+        std::vector<size_t> missing;
+        for (size_t index : group.queries) {
+            const unsigned int target = getStopIndex(queries[index].toStopId);
+            std::vector<StopTime> plan;
+            if (group.source != INVALID_INDEX && target != INVALID_INDEX && target != group.source && planReachability.mayReach(group.source, target) &&
+                (queryCache == nullptr || !queryCache->find(key(target), group.departure, dataVersion, plan))) {
+                missing.push_back(index);
+                continue;
+            }
+            latencies[index] = secondsSince(begin);
+            deliver(index, plan);
+            begin = Clock::now();
+        }
+        if (missing.empty()) {
+            return;
+        }
+        if (missing.size() == 1) {
+            const unsigned int target = getStopIndex(queries[missing[0]].toStopId);
+            std::vector<StopTime> plan = searchTravelPlanDepartingAt(context, group.source, target, group.departure, group.options);
+            searches++;
+            if (queryCache != nullptr) {
+                cacheTravelPlan(key(target), group.source, group.departure, plan);
+            }
+            latencies[missing[0]] = secondsSince(begin);
+            deliver(missing[0], plan);
+            return;
+        }
+
+        // One search from the origin labels every stop, then each target picks the
+        // earliest of its ride arrival, a footpath from a stop reached by ride or walking
+        searchTravelPlanDepartingAt(context, group.source, INVALID_INDEX, group.departure, group.options);
+        searches++;
+        const double share = secondsSince(begin) / missing.size();
+        for (size_t index : missing) {
+            begin = Clock::now();
+            const unsigned int target = getStopIndex(queries[index].toStopId);
+            int arrival = context.label(target).arrival;
+            unsigned int via = arrival == INFINITE_TIME ? INVALID_INDEX : target;
+            const int walk = getWalkingTime(group.source, target);
+            if (walk != INFINITE_TIME && group.departure + walk < arrival) {
+                arrival = group.departure + walk;
+                via = group.source;
+            }
+            for (unsigned int f = incomingFootpathOffsets[target]; f < incomingFootpathOffsets[target + 1]; ++f) {
+                const int rideArrival = context.label(incomingFootpaths[f].stop).arrival;
+                if (rideArrival != INFINITE_TIME && rideArrival + incomingFootpaths[f].duration < arrival) {
+                    arrival = rideArrival + incomingFootpaths[f].duration;
+                    via = incomingFootpaths[f].stop;
+                }
+            }
+            std::vector<StopTime> plan;
+            if (via != INVALID_INDEX) {
+                plan = reconstructTravelPlan(context, via);
+            }
+            if (queryCache != nullptr) {
+                cacheTravelPlan(key(target), group.source, group.departure, plan);
+            }
+            latencies[index] = share + secondsSince(begin);
+            deliver(index, plan);
+        }
+    });
+
+    if (statistics != nullptr) {
+        statistics->queries = queries.size();
+        statistics->searches = searches.load();
+        statistics->seconds = secondsSince(start);
+        statistics->queriesPerSecond = statistics->seconds > 0 ? queries.size() / statistics->seconds : 0;
+        statistics->p50Latency = statistics->p99Latency = 0;
+        if (!latencies.empty()) {
+            auto percentile = [&latencies](double p) {
+                auto nth = latencies.begin() + (size_t)(p * (latencies.size() - 1));
+                std::nth_element(latencies.begin(), nth, latencies.end());
+                return *nth;
+            };
+            statistics->p50Latency = percentile(0.5);
+            statistics->p99Latency = percentile(0.99);
+        }
+    }
+}
+
+int Network::getWalkingTime(unsigned int from, unsigned int to) const {
+    if (from == to) {
+        return 0;
+    }
+    for (unsigned int f = footpathOffsets[from]; f < footpathOffsets[from + 1]; ++f) {
+        if (footpaths[f].stop == to) {
+            return footpaths[f].duration;
+        }
+    }
+    return INFINITE_TIME;
+}
+
+uint32_t Network::compileTripFilter(QueryContext& context, const QueryOptions& options) const {
+    // Agencies are too many for flag bits, they get a table looked up for filtered queries only.
+    // The table is kept until a query of the context asks for other agencies or the network changed.
+    if (!options.agencyIds.empty() && (context.agencyVersion != dataVersion || context.agencyIds != options.agencyIds)) {
+        context.agencyVersion = dataVersion;
+        context.agencyIds = options.agencyIds;
+        context.agencies.assign(agencyIndex.size(), 0);
+        for (const std::string& id : options.agencyIds) {
+            auto agencyIt = agencyIndex.find(id);
+            if (agencyIt != agencyIndex.end()) {
+                context.agencies[agencyIt->second] = 1;
+            }
+        }
+    }
+
+    uint32_t rejected = TripFlag_Canceled | (~options.modes & TransportMode_All);
+    if (options.wheelchairAccessible) {
+        rejected |= TripFlag_NotWheelchairAccessible;
+    }
+    if (options.bikesAllowed) {
+        rejected |= TripFlag_NoBikes;
+    }
+    return rejected;
 }
 
-std::vector<StopTime> Network::getTravelPlanDepartingAt(const std::string& fromStopId, 
-                                                        const std::string& toStopId, 
-                                                        const GTFSTime& departureTime) const {
-    // Check if stops exist
-    if (stops.find(fromStopId) == stops.end() || stops.find(toStopId) == stops.end()) {
-        return {}; // Return empty if either stop doesn't exist
+bool Network::canBoard(QueryContext& context, unsigned int stop, const StopLabel& label, unsigned int trip, int shift, int departure) const {
+    // At the start of the search or after walking from there only the ready time counts
+    if (label.readyFrom == INVALID_INDEX || context.label(label.readyFrom).trip == INVALID_INDEX) {
+        return departure >= label.ready;
     }
-    
-    if (fromStopId == toStopId) {
-        return {};
+
+    const StopLabel& arrivedBy = context.label(label.readyFrom);
+    if (arrivedBy.trip == trip && arrivedBy.shift == shift) {
+        return false; // Already on board of this trip
     }
 
-    // Structure pour stocker les informations de chemin
-    struct PathInfo {
-        int arrivalTime;
-        std::string stopId;
-        std::vector<StopTime> path;
-        
-        // Opérateur de comparaison pour priority_queue (min-heap basé sur le temps d'arrivée)
-        bool operator>(const PathInfo& other) const {
-            return arrivalTime > other.arrivalTime;
-        }
-    };
+    const TransferRule* rule = findTransferRule(label.readyFrom, stop, arrivedBy.trip, trip);
+    if (rule == nullptr) {
+        return departure >= label.ready;
+    }
 
-    // Priority queue pour Dijkstra avec contraintes de temps
-    std::priority_queue<PathInfo, std::vector<PathInfo>, std::greater<PathInfo>> pq;
+    switch (rule->type) {
+    case TransferType_NoTransfer:
+        return false;
+    case TransferType_Timed:
+    case TransferType_InSeatTransfer:
+        return departure >= arrivedBy.arrival;
+    case TransferType_MinTransferTime:
+        return departure >= arrivedBy.arrival + rule->minTransferTime;
+    default:
+        return departure >= label.ready;
+    }
+}
 
-    std::unordered_map<std::string, int> bestTime; // meilleur temps d'arrivée pour chaque arrêt
-    
-    // Convertir le temps de départ en minutes pour faciliter la comparaison
-    int departureMinutes = departureTime.hour * 60 + departureTime.minute;
-    
-    // Commencer avec l'arrêt initial
-    pq.push({departureMinutes, fromStopId, {}});
-    bestTime[fromStopId] = departureMinutes;
-    
-    while (!pq.empty()) {
-        PathInfo current = pq.top();
-        pq.pop();
-        
-        // Ignorer si nous avons trouvé un meilleur chemin vers cet arrêt
-        if (bestTime.count(current.stopId) && bestTime[current.stopId] < current.arrivalTime) {
+bool Network::canAlight(QueryContext& context, unsigned int stop, const StopLabel& label, unsigned int trip, int shift, int arrival) const {
+    // At the end of the search or before walking there only the deadline counts
+    if (label.readyFrom == INVALID_INDEX || context.label(label.readyFrom).trip == INVALID_INDEX) {
+        return -arrival >= label.ready;
+    }
+
+    const StopLabel& departingBy = context.label(label.readyFrom);
+    if (departingBy.trip == trip && departingBy.shift == shift) {
+        return false; // Staying on board of this trip
+    }
+
+    const TransferRule* rule = findTransferRule(stop, label.readyFrom, trip, departingBy.trip);
+    if (rule == nullptr) {
+        return -arrival >= label.ready;
+    }
+
+    const int departure = -departingBy.arrival;
+    switch (rule->type) {
+    case TransferType_NoTransfer:
+        return false;
+    case TransferType_Timed:
+    case TransferType_InSeatTransfer:
+        return arrival <= departure;
+    case TransferType_MinTransferTime:
+        return arrival + rule->minTransferTime <= departure;
+    default:
+        return -arrival >= label.ready;
+    }
+}
+
+const TransferRule* Network::findTransferRule(unsigned int fromStop, unsigned int toStop, unsigned int fromTrip, unsigned int toTrip) const {
+    // Trip specific rules win over route specific ones
+    const TransferRule* best = nullptr;
+    int bestScore = -1;
+    for (unsigned int r = transferRuleOffsets[fromStop]; r < transferRuleOffsets[fromStop + 1]; ++r) {
+        const TransferRule& rule = transferRules[r];
+        if (rule.toStop != toStop ||
+            (rule.fromTrip != INVALID_INDEX && rule.fromTrip != fromTrip) ||
+            (rule.toTrip != INVALID_INDEX && rule.toTrip != toTrip) ||
+            (rule.fromRoute != INVALID_INDEX && rule.fromRoute != tripRoutes[fromTrip]) ||
+            (rule.toRoute != INVALID_INDEX && rule.toRoute != tripRoutes[toTrip])) {
             continue;
         }
-        
-        // Vérifier si nous avons atteint la destination
-        if (current.stopId == toStopId) {
-            return current.path;
-        }
-        
-        // Obtenir tous les prochains départs possibles depuis l'arrêt actuel
-        GTFSTime currentGTFSTime = {
-            static_cast<unsigned char>(current.arrivalTime / 60),
-            static_cast<unsigned char>(current.arrivalTime % 60),
-            0
-        };
-        
-        auto nextDepartures = getNextDeparturesFrom(current.stopId, currentGTFSTime);
-        
-        for (const auto& departure : nextDepartures) {
-            // Obtenir tous les arrêts sur ce voyage après l'arrêt actuel
-            auto range = tripStopTimes.equal_range(departure.tripId);
-            std::vector<StopTime> tripStops;
-            
-            for (auto it = range.first; it != range.second; ++it) {
-                tripStops.push_back(it->second);
-            }
-            
-            std::sort(tripStops.begin(), tripStops.end(), 
-                      [](const StopTime& a, const StopTime& b) {
-                          return a.stopSequence < b.stopSequence;
-                      });
-            
-            // Trouver la position de l'arrêt actuel dans le voyage
-            for (size_t i = 0; i < tripStops.size(); ++i) {
-                if (tripStops[i].stopId == current.stopId && 
-                    tripStops[i].stopSequence == departure.stopSequence) {
-                    
-                    // Ajouter tous les arrêts suivants comme destinations possibles
-                    for (size_t j = i + 1; j < tripStops.size(); ++j) {
-                        const auto& nextStop = tripStops[j];
-                        int arrivalTime = nextStop.arrivalTime.hour * 60 + nextStop.arrivalTime.minute;
-                        
-                        // Ne considérer que si c'est un meilleur temps d'arrivée
-                        if (!bestTime.count(nextStop.stopId) || bestTime[nextStop.stopId] > arrivalTime) {
-                            bestTime[nextStop.stopId] = arrivalTime;
-                            
-                            // Construire le nouveau chemin
-                            std::vector<StopTime> newPath = current.path;
-                            
-                            // Ajouter le point de départ si c'est le premier segment
-                            if (newPath.empty()) {
-                                newPath.push_back(departure);
-                            }
-                            
-                            // Ajouter tous les arrêts intermédiaires jusqu'au suivant
-                            for (size_t k = i + 1; k <= j; ++k) {
-                                newPath.push_back(tripStops[k]);
-                            }
-                            
-                            pq.push({arrivalTime, nextStop.stopId, newPath});
-                        }
-                    }
-                    break;
-                }
-            }
+        int score = (rule.fromTrip != INVALID_INDEX) * 4 + (rule.toTrip != INVALID_INDEX) * 4 +
+                    (rule.fromRoute != INVALID_INDEX) + (rule.toRoute != INVALID_INDEX);
+        if (score > bestScore) {
+            best = &rule;
+            bestScore = score;
         }
-        
-        // Considérer aussi les transferts à l'arrêt actuel
-        auto transferStops = getStopsForTransfer(current.stopId);
-        for (const auto& transferStop : transferStops) {
-            if (transferStop.id != current.stopId) {
-                // Aucun temps de transfert supposé, peut immédiatement prendre le prochain départ
-                if (!bestTime.count(transferStop.id) || bestTime[transferStop.id] > current.arrivalTime) {
-                    bestTime[transferStop.id] = current.arrivalTime;
-                    pq.push({current.arrivalTime, transferStop.id, current.path});
-                }
-            }
+    }
+    return best;
+}
+
+std::vector<StopTime> Network::reconstructTravelPlan(QueryContext& context, unsigned int lastStop) const {
+    // Collect the stops reached by a ride by walking back along the predecessor references,
+    // the stop we started from is never reached by a ride
+    context.path.clear();
+    for (unsigned int stop = lastStop; stop != INVALID_INDEX && context.label(stop).trip != INVALID_INDEX;
+         stop = context.label(context.label(stop).parentStop).readyFrom) {
+        context.path.push_back(stop);
+    }
+
+    // The boarding stop is only part of the plan for the first ride, following
+    // rides continue from the stop the previous ride or transfer ended at
+    std::vector<StopTime> plan;
+    for (auto it = context.path.rbegin(); it != context.path.rend(); ++it) {
+        const StopLabel& ride = context.label(*it);
+        const unsigned int first = plan.empty() ? ride.boardPosition : ride.boardPosition + 1;
+        for (unsigned int position = first; position <= ride.alightPosition; ++position) {
+            plan.push_back(getStopTime(ride.trip, position, ride.shift));
         }
     }
-    
-    // Aucun chemin trouvé
-    return {};
+    return plan;
+}
+
+StopTime Network::getStopTime(unsigned int trip, unsigned int position, int shift) const {
+    StopTime stopTime = tripStopTimes[tripOffsets[trip] + position];
+    if (shift != 0) {
+        stopTime.arrivalTime = fromSeconds(toSeconds(stopTime.arrivalTime) + shift);
+        stopTime.departureTime = fromSeconds(toSeconds(stopTime.departureTime) + shift);
+    }
+    return stopTime;
 }
 
 bool Network::isTimeGreaterOrEqual(const GTFSTime& time1, const GTFSTime& time2) const {
@@ -158,63 +2400,118 @@ bool Network::isTimeGreaterOrEqual(const GTFSTime& time1, const GTFSTime& time2)
 }
 
 std::vector<StopTime> Network::getNextDeparturesFrom(const std::string& stopId, const GTFSTime& afterTime) const {
-    std::vector<StopTime> departures;
-    
-    // Get all trips that stop at this station
-    auto tripRange = stopTrips.equal_range(stopId);
-    for (auto tripIt = tripRange.first; tripIt != tripRange.second; ++tripIt) {
-        const std::string& tripId = tripIt->second;
-        
-        // Get all stop times for this trip
-        auto stopRange = tripStopTimes.equal_range(tripId);
-        for (auto stopIt = stopRange.first; stopIt != stopRange.second; ++stopIt) {
-            const StopTime& stopTime = stopIt->second;
-            
-            // Check if this is the right stop and departure is after required time
-            if (stopTime.stopId == stopId && isTimeGreaterOrEqual(stopTime.departureTime, afterTime)) {
-                departures.push_back(stopTime);
+    // Unlike the departure board this keeps every stop time at the stop, also where trips end
+    // or do not pick up, and compares whole minutes like isTimeGreaterOrEqual()
+    std::vector<StopTime> result;
+    const unsigned int stop = getStopIndex(stopId);
+    if (stop == INVALID_INDEX) {
+        return result;
+    }
+    for (unsigned int e = stopEventOffsets[stop]; e < stopEventOffsets[stop + 1]; ++e) {
+        const StopEvent& event = stopEvents[e];
+        const StopTime& stopTime = tripStopTimes[tripOffsets[event.trip] + event.position];
+        if (!(tripFlags[event.trip] & TripFlag_Canceled) && isTimeGreaterOrEqual(stopTime.departureTime, afterTime)) {
+            result.push_back(stopTime);
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), [](const StopTime& a, const StopTime& b) {
+        return a.departureTime.hour * 60 + a.departureTime.minute < b.departureTime.hour * 60 + b.departureTime.minute;
+    });
+    return result;
+}
+
+std::vector<StopTime> Network::getDepartureBoard(const std::string& stopId, const GTFSTime& afterTime, size_t count, const std::string& routeId) const {
+    std::vector<StopTime> result;
+
+    const unsigned int stop = getStopIndex(stopId);
+    if (stop == INVALID_INDEX) {
+        return result;
+    }
+
+    const Departure* begin = departures.data() + departureOffsets[stop];
+    const Departure* end = departures.data() + departureOffsets[stop + 1];
+    unsigned int route = INVALID_INDEX;
+    if (!routeId.empty()) {
+        auto routeIt = routeIndex.find(routeId);
+        if (routeIt == routeIndex.end()) {
+            return result;
+        }
+
+        // Departures of one route form a block ordered by time
+        route = routeIt->second;
+        begin = std::lower_bound(routeDepartures.data() + departureOffsets[stop], routeDepartures.data() + departureOffsets[stop + 1], route,
+                                 [this](const Departure& departure, unsigned int value) { return tripRoutes[departure.trip] < value; });
+        end = std::upper_bound(begin, routeDepartures.data() + departureOffsets[stop + 1], route,
+                               [this](unsigned int value, const Departure& departure) { return value < tripRoutes[departure.trip]; });
+    }
+
+    // Runs of headway based trips are computed on the fly and merged with the timetable
+    const int after = toSeconds(afterTime);
+    std::vector<int> nextRuns;
+    for (unsigned int f = frequencyOffsets[stop]; f < frequencyOffsets[stop + 1]; ++f) {
+        const bool matches = !(tripFlags[frequencyDepartures[f].trip] & TripFlag_Canceled) && (route == INVALID_INDEX || tripRoutes[frequencyDepartures[f].trip] == route);
+        nextRuns.push_back(matches ? nextRun(frequencyDepartures[f], after) : INFINITE_TIME);
+    }
+
+    const Departure* departure = findFirstDeparture(begin, end, after);
+    while (result.size() < count) {
+        auto run = std::min_element(nextRuns.begin(), nextRuns.end());
+        if (run != nextRuns.end() && *run != INFINITE_TIME && (departure == end || *run < departure->time)) {
+            const FrequencyDeparture& frequency = frequencyDepartures[frequencyOffsets[stop] + (run - nextRuns.begin())];
+            const int templateTime = tripEvents[tripOffsets[frequency.trip] + frequency.position].departure;
+            result.push_back(getStopTime(frequency.trip, frequency.position, *run - templateTime));
+            *run = nextRun(frequency, *run + 1);
+        } else if (departure != end) {
+            if (!(tripFlags[departure->trip] & TripFlag_Canceled)) {
+                result.push_back(tripStopTimes[tripOffsets[departure->trip] + departure->position]);
             }
+            ++departure;
+        } else {
+            break;
         }
     }
-    
-    // Sort by departure time
-    std::sort(departures.begin(), departures.end(), 
-              [](const StopTime& a, const StopTime& b) {
-                  int timeA = a.departureTime.hour * 60 + a.departureTime.minute;
-                  int timeB = b.departureTime.hour * 60 + b.departureTime.minute;
-                  return timeA < timeB;
-              });
-    
-    return departures;
+    return result;
+}
+
+const Departure* Network::findFirstDeparture(const Departure* begin, const Departure* end, int time) {
+    return std::lower_bound(begin, end, time, [](const Departure& departure, int value) { return departure.time < value; });
 }
 
 std::vector<Stop> Network::search(std::string needle) const {
+  std::vector<const Stop*> matches;
+  search(needle, matches);
+
   std::vector<Stop> result;
+  result.reserve(matches.size());
+  for (const Stop* stop : matches) {
+      result.push_back(*stop);
+  }
+  return result;
+}
 
+void Network::search(std::string_view needle, std::vector<const Stop*>& result) const {
+  result.clear();
   for (const std::pair<const std::string, Stop>& pair : stops) {
       if (pair.second.name.find(needle) != std::string::npos) {
-          result.push_back(pair.second);
+          result.push_back(&pair.second);
       }
   }
-
-  return result;
 }
 
 std::vector<Route> Network::getRoutes() const {
     std::vector<Route> result;
-
-    for (auto &route : routes) {
-        result.push_back(route.second);
+    result.reserve(sortedRoutes.size());
+    for (const Route* route : sortedRoutes) {
+        result.push_back(*route);
     }
-
-    std::sort(result.begin(), result.end(), [] (const Route& lhs, const Route& rhs) {
-        return lhs.shortName < rhs.shortName;
-    });
-
     return result;
 }
 
-std::string Network::getRouteDisplayName(Route route) const {
+Span<const Route* const> Network::viewRoutes() const {
+    return Span<const Route* const>(sortedRoutes.data(), sortedRoutes.size());
+}
+
+std::string Network::getRouteDisplayName(const Route& route) const {
     std::string displayName = route.shortName;
     if (!route.longName.empty()) {
         displayName = displayName + " - " + route.longName;
@@ -224,15 +2521,21 @@ std::string Network::getRouteDisplayName(Route route) const {
 
 std::vector<Trip> Network::getTripsForRoute(std::string routeId) const {
     std::vector<Trip> result;
-    for (auto &trip : trips) {
-        if (trip.routeId == routeId) {
-            result.push_back(trip);
-        }
+    for (const Trip* trip : viewTripsForRoute(routeId)) {
+        result.push_back(*trip);
     }
     return result;
 }
 
-std::string Network::getTripDisplayName(Trip trip) const {
+Span<const Trip* const> Network::viewTripsForRoute(std::string_view routeId) const {
+    // Trips of unknown routes are kept as well, so this works on the route_id of the trips
+    auto range = std::equal_range(routeTrips.begin(), routeTrips.end(), routeId, [](const auto& a, const auto& b) {
+        return routeKey(a) < routeKey(b);
+    });
+    return Span<const Trip* const>(routeTrips.data() + (range.first - routeTrips.begin()), range.second - range.first);
+}
+
+std::string Network::getTripDisplayName(const Trip& trip) const {
     return trip.shortName + " - " + trip.headsign;
 }
 
@@ -240,15 +2543,68 @@ std::vector<StopTime> Network::getStopTimesForTrip(std::string tripId) const {
     return searchStopTimesForTrip("", tripId);
 }
 
+Span<const StopTime> Network::viewStopTimesForTrip(std::string_view tripId) const {
+    auto tripIt = tripIndex.find(tripId);
+    if (tripIt == tripIndex.end()) {
+        return Span<const StopTime>();
+    }
+    const unsigned int begin = tripOffsets[tripIt->second];
+    return Span<const StopTime>(tripStopTimes.data() + begin, tripOffsets[tripIt->second + 1] - begin);
+}
+
+std::vector<Coordinate> Network::getShapeForTrip(const std::string& tripId, double tolerance) const {
+    auto tripIt = tripIndex.find(tripId);
+    if (tripIt == tripIndex.end()) {
+        return {};
+    }
+    return shapes.getPolyline(trips[tripIt->second].shapeId, tolerance);
+}
+
+bool Network::getTripLeg(const std::string& tripId, unsigned int fromSequence, unsigned int toSequence, TripLeg& leg) const {
+    auto tripIt = tripIndex.find(tripId);
+    if (tripIt == tripIndex.end() || tripShapeStops[tripIt->second] == INVALID_INDEX) {
+        return false;
+    }
+    const unsigned int trip = tripIt->second;
+    const unsigned int from = findTripPosition(trip, fromSequence);
+    const unsigned int to = findTripPosition(trip, toSequence);
+    if (from == INVALID_INDEX || to == INVALID_INDEX || from > to) {
+        return false;
+    }
+
+    const ShapeStop& boarding = shapeStops[tripShapeStops[trip] + from];
+    const ShapeStop& alighting = shapeStops[tripShapeStops[trip] + to];
+    leg.from = {fromMicrodegrees(boarding.latitude), fromMicrodegrees(boarding.longitude)};
+    leg.points = shapes.getPoints(boarding, alighting);
+    leg.to = {fromMicrodegrees(alighting.latitude), fromMicrodegrees(alighting.longitude)};
+    leg.meters = alighting.distance - boarding.distance;
+    return true;
+}
+
 Stop Network::getStopById(std::string stopId) const {
-    auto stopIt = stops.find(stopId);
-    if (stopIt != stops.end()) {
-        return stopIt->second;
+    const Stop* stop = findStop(stopId);
+    if (stop != nullptr) {
+        return *stop;
     }
     // Return a default/empty stop if not found
     return Stop{};
 }
 
+const Stop* Network::findStop(std::string_view stopId) const {
+    auto stopIt = stopIndex.find(stopId);
+    return stopIt == stopIndex.end() ? nullptr : indexedStops[stopIt->second];
+}
+
+const Trip* Network::findTrip(std::string_view tripId) const {
+    auto tripIt = tripIndex.find(tripId);
+    return tripIt == tripIndex.end() ? nullptr : &trips[tripIt->second];
+}
+
+const Route* Network::findRoute(std::string_view routeId) const {
+    auto routeIt = routeIndex.find(routeId);
+    return routeIt == routeIndex.end() ? nullptr : indexedRoutes[routeIt->second];
+}
+
 std::vector<StopTime> Network::searchStopTimesForTrip(std::string needle, std::string tripId) const {
     std::vector<StopTime> result;
     
@@ -256,17 +2612,15 @@ std::vector<StopTime> Network::searchStopTimesForTrip(std::string needle, std::s
     std::string lowerNeedle = needle;
     std::transform(lowerNeedle.begin(), lowerNeedle.end(), lowerNeedle.begin(), ::tolower);
     
-    // Use optimized multimap for faster lookup
-    auto range = tripStopTimes.equal_range(tripId);
-    for (auto it = range.first; it != range.second; ++it) {
-        const StopTime& stopTime = it->second;
-        auto stopIt = stops.find(stopTime.stopId);
-        if (stopIt != stops.end()) {
+    // Stop times are already grouped by trip and ordered by stop sequence
+    for (const StopTime& stopTime : viewStopTimesForTrip(tripId)) {
+        const Stop* stop = findStop(stopTime.stopId);
+        if (stop != nullptr) {
             if (needle.empty()) {
                 result.push_back(stopTime);
             } else {
                 // Convert stop name to lowercase for comparison
-                std::string lowerStopName = stopIt->second.name;
+                std::string lowerStopName = stop->name;
                 std::transform(lowerStopName.begin(), lowerStopName.end(), lowerStopName.begin(), ::tolower);
                 
                 if (lowerStopName.find(lowerNeedle) != std::string::npos) {
@@ -276,269 +2630,291 @@ std::vector<StopTime> Network::searchStopTimesForTrip(std::string needle, std::s
         }
     }
 
-    std::sort(result.begin(), result.end(), [](const StopTime& lhs, const StopTime& rhs) {
-        return lhs.stopSequence < rhs.stopSequence;
-    });
-
     return result;
 }
 
 // New methods for Aufgabe 5
 
 std::vector<Stop> Network::getStopsForTransfer(const std::string& stopId) const {
+    std::vector<const Stop*> transferStops;
+    getStopsForTransfer(stopId, transferStops);
     std::vector<Stop> result;
-    
+    result.reserve(transferStops.size());
+    for (const Stop* transferStop : transferStops) {
+        result.push_back(*transferStop);
+    }
+    return result;
+}
+
+void Network::getStopsForTransfer(std::string_view stopId, std::vector<const Stop*>& result) const {
+    result.clear();
+
     // Check if stop exists
-    auto stopIt = stops.find(stopId);
-    if (stopIt == stops.end()) {
-        return result; // Return empty vector if stop doesn't exist
+    const Stop* found = findStop(stopId);
+    if (found == nullptr) {
+        return; // Return empty vector if stop doesn't exist
     }
-    
+
     // Add the stop itself
-    result.push_back(stopIt->second);
-    
-    const Stop& stop = stopIt->second;
-    
+    result.push_back(found);
+
+    const Stop& stop = *found;
+    auto add = [&result](const Stop* other) {
+        if (std::find(result.begin(), result.end(), other) == result.end()) {
+            result.push_back(other);
+        }
+    };
+
     // Method 1: Use parent_station relationship
     if (stop.locationType == LocationType_Station) {
         // If it's a station, find all platforms/tracks using multimap
         auto range = stopsForTransferMap.equal_range(stopId);
         for (auto it = range.first; it != range.second; ++it) {
             auto childStopIt = stops.find(it->second);
-            if (childStopIt != stops.end()) {
-                const Stop& childStop = childStopIt->second;
-                if (childStop.id != stopId) {
-                    result.push_back(childStop);
-                }
+            if (childStopIt != stops.end() && childStopIt->second.id != stopId) {
+                result.push_back(&childStopIt->second);
             }
         }
     } else if (!stop.parentStation.empty()) {
         // If it's a platform/track, find the parent station and all sibling platforms
-        // Add parent station
         auto parentStopIt = stops.find(stop.parentStation);
         if (parentStopIt != stops.end()) {
-            const Stop& parentStop = parentStopIt->second;
-            bool alreadyAdded = false;
-            for (const auto& existingStop : result) {
-                if (existingStop.id == parentStop.id) {
-                    alreadyAdded = true;
-                    break;
-                }
-            }
-            if (!alreadyAdded) {
-                result.push_back(parentStop);
-            }
+            add(&parentStopIt->second);
         }
-        
+
         // Add all sibling platforms using multimap
         auto range = stopsForTransferMap.equal_range(stop.parentStation);
         for (auto it = range.first; it != range.second; ++it) {
             auto siblingStopIt = stops.find(it->second);
-            if (siblingStopIt != stops.end()) {
-                const Stop& siblingStop = siblingStopIt->second;
-                if (siblingStop.id != stopId) {
-                    bool alreadyAdded = false;
-                    for (const auto& existingStop : result) {
-                        if (existingStop.id == siblingStop.id) {
-                            alreadyAdded = true;
-                            break;
-                        }
-                    }
-                    if (!alreadyAdded) {
-                        result.push_back(siblingStop);
-                    }
-                }
+            if (siblingStopIt != stops.end() && siblingStopIt->second.id != stopId) {
+                add(&siblingStopIt->second);
             }
         }
     }
-    
+
     // Method 2: Find stops with common prefix (for GTFS data without proper parent_station)
-    // Extract base station ID (everything before the first colon after the main ID)
-    std::string baseStationId = stopId;
-    size_t colonPos = stopId.find(':');
-    if (colonPos != std::string::npos) {
-        // Find the position after the third colon (typical pattern: de:region:station:...)
-        size_t count = 0;
-        for (size_t i = 0; i < stopId.length() && count < 3; ++i) {
-            if (stopId[i] == ':') {
-                count++;
-                if (count == 3) {
-                    baseStationId = stopId.substr(0, i);
-                    break;
-                }
-            }
+    // Extract base station ID (everything before the third colon, typical pattern: de:region:station:...)
+    std::string_view baseStationId = stopId;
+    size_t count = 0;
+    for (size_t i = 0; i < stopId.length(); ++i) {
+        if (stopId[i] == ':' && ++count == 3) {
+            baseStationId = stopId.substr(0, i);
+            break;
         }
     }
-    
-    // Find all stops that start with the base station ID
-    for (const auto& pair : stops) {
-        const std::string& otherStopId = pair.first;
-        const Stop& otherStop = pair.second;
-        
-        // Check if this stop shares the same base station ID and isn't already added
-        if (otherStopId != stopId && otherStopId.find(baseStationId) == 0) {
-            // Additional check: make sure it's really the same station
-            // (starts with baseStationId and next char is ':' or end of string)
-            if (otherStopId.length() == baseStationId.length() || 
-                (otherStopId.length() > baseStationId.length() && otherStopId[baseStationId.length()] == ':')) {
-                
-                bool alreadyAdded = false;
-                for (const auto& existingStop : result) {
-                    if (existingStop.id == otherStopId) {
-                        alreadyAdded = true;
-                        break;
-                    }
-                }
-                if (!alreadyAdded) {
-                    result.push_back(otherStop);
-                }
-            }
+
+    // Find all stops that are equal to the base station ID or continue it with ':'
+    auto prefixRange = prefixStops.equal_range(baseStationId);
+    for (auto it = prefixRange.first; it != prefixRange.second; ++it) {
+        if (it->second != stopId) {
+            add(&stops.at(it->second));
         }
     }
-    
+
     // Method 3: Zone-based transfers (Aufgabe 5a) - MOST IMPORTANT according to the assignment
     if (!stop.zoneId.empty()) {
         auto range = zoneStops.equal_range(stop.zoneId);
         for (auto it = range.first; it != range.second; ++it) {
             auto zoneStopIt = stops.find(it->second);
-            if (zoneStopIt != stops.end()) {
-                const Stop& zoneStop = zoneStopIt->second;
-                if (zoneStop.id != stopId) {
-                    // Check if not already added
-                    bool alreadyAdded = false;
-                    for (const auto& existingStop : result) {
-                        if (existingStop.id == zoneStop.id) {
-                            alreadyAdded = true;
-                            break;
-                        }
-                    }
-                    if (!alreadyAdded) {
-                        result.push_back(zoneStop);
-                    }
-                }
+            if (zoneStopIt != stops.end() && zoneStopIt->second.id != stopId) {
+                add(&zoneStopIt->second);
             }
         }
     }
-    
-    return result;
 }
 
 std::unordered_set<std::string> Network::getNeighbors(const std::string& stopId) const {
     std::unordered_set<std::string> neighbors;
-    
-    // Use optimized multimap for faster lookup
-    auto tripRange = stopTrips.equal_range(stopId);
-    for (auto tripIt = tripRange.first; tripIt != tripRange.second; ++tripIt) {
-        const std::string& tripId = tripIt->second;
-        
-        // Get all stops for this trip in order using multimap
-        std::vector<StopTime> tripStops;
-        auto stopRange = tripStopTimes.equal_range(tripId);
-        for (auto stopIt = stopRange.first; stopIt != stopRange.second; ++stopIt) {
-            tripStops.push_back(stopIt->second);
-        }
-        
-        // Sort by stop sequence
-        std::sort(tripStops.begin(), tripStops.end(), 
-                  [](const StopTime& a, const StopTime& b) {
-                      return a.stopSequence < b.stopSequence;
-                  });
-        
-        // Find current stop and add next/previous stops
-        for (size_t i = 0; i < tripStops.size(); ++i) {
-            if (tripStops[i].stopId == stopId) {
-                // Add next stop
-                if (i + 1 < tripStops.size()) {
-                    neighbors.insert(tripStops[i + 1].stopId);
-                }
-                // Add previous stop
-                if (i > 0) {
-                    neighbors.insert(tripStops[i - 1].stopId);
-                }
-                break;
-            }
-        }
+    for (unsigned int neighbor : getNeighbors(QueryContext::local(), stopId)) {
+        neighbors.insert(stopIds[neighbor]);
     }
-    
-    // Add transfer possibilities (same station)
-    std::vector<Stop> transferStops = getStopsForTransfer(stopId);
-    for (const auto& transferStop : transferStops) {
-        if (transferStop.id != stopId) {
-            neighbors.insert(transferStop.id);
-        }
-    }
-    
     return neighbors;
 }
 
+const std::vector<unsigned int>& Network::getNeighbors(QueryContext& context, const std::string& stopId) const {
+    context.reset(stopIds.size());
+    unsigned int stop = getStopIndex(stopId);
+    if (stop != INVALID_INDEX) {
+        context.neighbors.assign(adjacency.begin() + adjacencyOffsets[stop], adjacency.begin() + adjacencyOffsets[stop + 1]);
+    }
+    return context.neighbors;
+}
+
 std::vector<Stop> Network::getTravelPath(const std::string& fromStopId, const std::string& toStopId) const {
+    return getTravelPath(QueryContext::local(), fromStopId, toStopId);
+}
+
+std::vector<Stop> Network::getTravelPath(QueryContext& context, const std::string& fromStopId, const std::string& toStopId) const {
     // Check if stops exist
-    if (stops.find(fromStopId) == stops.end() || stops.find(toStopId) == stops.end()) {
+    const unsigned int source = getStopIndex(fromStopId);
+    const unsigned int target = getStopIndex(toStopId);
+    if (source == INVALID_INDEX || target == INVALID_INDEX) {
         return {}; // Return empty if either stop doesn't exist
     }
     
-    if (fromStopId == toStopId) {
+    if (source == target) {
         return {stops.at(fromStopId)};
     }
+
+    // Stops in different components have no path
+    if (!pathReachability.mayReach(source, target)) {
+        return {};
+    }
     
-    // BFS for shortest path
-    std::queue<std::string> queue;
-    std::unordered_map<std::string, std::string> parent;
-    std::unordered_set<std::string> visited;
-    
-    queue.push(fromStopId);
-    visited.insert(fromStopId);
-    parent[fromStopId] = "";
-    
-    while (!queue.empty()) {
-        std::string current = queue.front();
-        queue.pop();
-        
-        if (current == toStopId) {
-            // Reconstruct path
-            std::vector<Stop> path;
-            std::string node = toStopId;
-            while (!node.empty()) {
-                auto stopIt = stops.find(node);
-                if (stopIt != stops.end()) {
-                    path.push_back(stopIt->second);
+    // Bidirectional BFS: settled stops and arrival count the hops from the source,
+    // parentStop leads back there. ready counts the hops to the target and readyFrom
+    // leads there, INFINITE_TIME marks stops the backward search has not seen yet.
+    context.reset(stopIds.size());
+    std::vector<unsigned int>& forward = context.queue;
+    std::vector<unsigned int>& backward = context.reverseQueue;
+    forward.push_back(source);
+    context.settle(source);
+    context.label(source).arrival = 0;
+    backward.push_back(target);
+    context.label(target).ready = 0;
+
+    // Expand whole levels of the smaller side until the searches meet on an edge
+    int best = INFINITE_TIME;
+    unsigned int meetFrom = INVALID_INDEX, meetTo = INVALID_INDEX;
+    size_t forwardHead = 0, backwardHead = 0;
+    while (best == INFINITE_TIME && forwardHead < forward.size() && backwardHead < backward.size()) {
+        if (forward.size() - forwardHead <= backward.size() - backwardHead) {
+            for (const size_t levelEnd = forward.size(); forwardHead < levelEnd; ++forwardHead) {
+                const unsigned int current = forward[forwardHead];
+                const int hops = context.label(current).arrival + 1;
+                for (unsigned int e = adjacencyOffsets[current]; e < adjacencyOffsets[current + 1]; ++e) {
+                    const unsigned int neighbor = adjacency[e];
+                    StopLabel& label = context.label(neighbor);
+                    if (label.ready != INFINITE_TIME && hops + label.ready < best) {
+                        best = hops + label.ready;
+                        meetFrom = current;
+                        meetTo = neighbor;
+                    }
+                    if (!context.isSettled(neighbor)) {
+                        context.settle(neighbor);
+                        label.arrival = hops;
+                        label.parentStop = current;
+                        forward.push_back(neighbor);
+                    }
                 }
-                node = parent[node];
             }
-            std::reverse(path.begin(), path.end());
-            return path;
-        }
-        
-        // Get neighbors using optimized method
-        std::unordered_set<std::string> neighbors = getNeighbors(current);
-        for (const std::string& neighbor : neighbors) {
-            if (visited.find(neighbor) == visited.end()) {
-                visited.insert(neighbor);
-                parent[neighbor] = current;
-                queue.push(neighbor);
+        } else {
+            for (const size_t levelEnd = backward.size(); backwardHead < levelEnd; ++backwardHead) {
+                const unsigned int current = backward[backwardHead];
+                const int hops = context.label(current).ready + 1;
+                for (unsigned int e = incomingAdjacencyOffsets[current]; e < incomingAdjacencyOffsets[current + 1]; ++e) {
+                    const unsigned int neighbor = incomingAdjacency[e];
+                    StopLabel& label = context.label(neighbor);
+                    if (context.isSettled(neighbor) && label.arrival + hops < best) {
+                        best = label.arrival + hops;
+                        meetFrom = neighbor;
+                        meetTo = current;
+                    }
+                    if (label.ready == INFINITE_TIME) {
+                        label.ready = hops;
+                        label.readyFrom = current;
+                        backward.push_back(neighbor);
+                    }
+                }
             }
         }
     }
-    
-    // No path found
-    return {};
+
+    if (best == INFINITE_TIME) {
+        return {}; // No path found
+    }
+
+    // Source to the meeting edge, then on to the target
+    context.path.clear();
+    for (unsigned int node = meetFrom; node != INVALID_INDEX; node = context.label(node).parentStop) {
+        context.path.push_back(node);
+    }
+    std::reverse(context.path.begin(), context.path.end());
+    for (unsigned int node = meetTo; node != INVALID_INDEX; node = context.label(node).readyFrom) {
+        context.path.push_back(node);
+    }
+    std::vector<Stop> path;
+    path.reserve(context.path.size());
+    for (unsigned int node : context.path) {
+        path.push_back(stops.at(stopIds[node]));
+    }
+    return path;
+}
+
+unsigned int Network::getStopIndex(std::string_view stopId) const {
+    auto stopIt = stopIndex.find(stopId);
+    return stopIt == stopIndex.end() ? INVALID_INDEX : stopIt->second;
+}
+
+const std::string& Network::getStopId(unsigned int index) const {
+    return stopIds.at(index);
+}
+
+std::vector<StopDistance> Network::nearestStops(double latitude, double longitude, size_t k) const {
+    std::vector<StopDistance> result;
+    nearestStops(latitude, longitude, k, result);
+    return result;
+}
+
+void Network::nearestStops(double latitude, double longitude, size_t k, std::vector<StopDistance>& result) const {
+    stopGrid.nearest(latitude, longitude, k, result);
+}
+
+void Network::nearestStops(const std::vector<Coordinate>& positions, size_t k, std::vector<StopDistance>& result, std::vector<unsigned int>& offsets) const {
+    // Append the results of every position behind each other, reusing one scratch buffer per thread
+    static thread_local std::vector<StopDistance> single;
+    result.clear();
+    offsets.assign(1, 0);
+    for (const Coordinate& position : positions) {
+        stopGrid.nearest(position.latitude, position.longitude, k, single);
+        result.insert(result.end(), single.begin(), single.end());
+        offsets.push_back(result.size());
+    }
+}
+
+std::vector<StopDistance> Network::stopsWithinRadius(double latitude, double longitude, double meters) const {
+    std::vector<StopDistance> result;
+    stopsWithinRadius(latitude, longitude, meters, result);
+    return result;
+}
+
+void Network::stopsWithinRadius(double latitude, double longitude, double meters, std::vector<StopDistance>& result) const {
+    stopGrid.within(latitude, longitude, meters, result);
+}
+
+void Network::stopsWithinRadius(const std::vector<Coordinate>& positions, double meters, std::vector<StopDistance>& result, std::vector<unsigned int>& offsets) const {
+    static thread_local std::vector<StopDistance> single;
+    result.clear();
+    offsets.assign(1, 0);
+    for (const Coordinate& position : positions) {
+        stopGrid.within(position.latitude, position.longitude, meters, single);
+        result.insert(result.end(), single.begin(), single.end());
+        offsets.push_back(result.size());
+    }
+}
+
+void Network::enableQueryCache(size_t memoryBudget, int bucketSeconds) {
+    queryCache = std::make_shared<QueryCache>(memoryBudget, bucketSeconds);
+}
+
+void Network::disableQueryCache() {
+    queryCache.reset();
+}
+
+QueryCacheStatistics Network::getQueryCacheStatistics() const {
+    return queryCache == nullptr ? QueryCacheStatistics{0, 0, 0, 0} : queryCache->getStatistics();
 }
 
 NetworkScheduledTrip Network::getScheduledTrip(const std::string& tripId) const {
-    std::vector<StopTime> tripStopTimes;
-    
-    // Use optimized multimap for faster lookup
-    auto range = this->tripStopTimes.equal_range(tripId);
-    for (auto it = range.first; it != range.second; ++it) {
-        tripStopTimes.push_back(it->second);
+    auto tripIt = tripIndex.find(tripId);
+    if (tripIt == tripIndex.end()) {
+        return NetworkScheduledTrip(tripId, {});
     }
-    
-    std::sort(tripStopTimes.begin(), tripStopTimes.end(), 
-              [](const StopTime& a, const StopTime& b) {
-                  return a.stopSequence < b.stopSequence;
-              });
-    
-    return NetworkScheduledTrip(tripId, tripStopTimes);
+
+    // Stop times are already grouped by trip and ordered by stop sequence
+    auto begin = this->tripStopTimes.begin() + tripOffsets[tripIt->second];
+    auto end = this->tripStopTimes.begin() + tripOffsets[tripIt->second + 1];
+    return NetworkScheduledTrip(tripId, std::vector<StopTime>(begin, end));
 }
 
 void Network::readAgencies(std::string source) {
@@ -596,6 +2972,23 @@ void Network::readCalendars(std::string source) {
   } while (reader.next());
 }
 
+void Network::readFrequencies(std::string source) {
+  CSVReader reader(source);
+  do {
+    std::string id = reader.getField("trip_id");
+    if (id.empty() == false) {
+      Frequency item = {
+        id,
+        parseTime(reader.getField("start_time")),
+        parseTime(reader.getField("end_time")),
+        (unsigned int)std::stoi(reader.getField("headway_secs")),
+        reader.getField("exact_times") == "1"
+      };
+      frequencies.push_back(item);
+    }
+  } while (reader.next());
+}
+
 void Network::readLevels(std::string source) {
   CSVReader reader(source);
   do {
@@ -655,6 +3048,8 @@ void Network::readRoutes(std::string source) {
 }
 
 void Network::readShapes(std::string source) {
+  // The points are only kept until they are encoded into the shape index
+  std::vector<Shape> points;
   CSVReader reader(source);
   do {
     std::string id = reader.getField("shape_id");
@@ -665,9 +3060,10 @@ void Network::readShapes(std::string source) {
         std::stod(reader.getField("shape_pt_lon")),
         (unsigned int)std::stoi(reader.getField("shape_pt_sequence"))
       };
-      shapes.push_back(item);
+      points.push_back(item);
     }
   } while (reader.next());
+  shapes.build(points);
 }
 
 void Network::readStopTimes(std::string source) {
@@ -686,11 +3082,6 @@ void Network::readStopTimes(std::string source) {
         reader.getField("stop_headsign") 
       };
       stopTimes.push_back(item);
-      
-      // Build optimized data structures (as recommended by professor)
-      stopTrips.insert({item.stopId, item.tripId});
-      tripStops.insert({item.tripId, item.stopId});
-      tripStopTimes.insert({item.tripId, item});
     }
   } while (reader.next());
 }
@@ -727,6 +3118,12 @@ void Network::readStops(std::string source) {
       if (!item.zoneId.empty()) {
         zoneStops.insert({item.zoneId, id});
       }
+
+      // Index the id and all its ':' separated prefixes to find stops sharing a base station ID
+      for (size_t pos = id.find(':'); pos != std::string::npos; pos = id.find(':', pos + 1)) {
+        prefixStops.insert({id.substr(0, pos), id});
+      }
+      prefixStops.insert({id, id});
     }
   } while (reader.next());
 }
@@ -773,6 +3170,30 @@ void Network::readTrips(std::string source) {
   } while (reader.next());
 }
 
+std::vector<TripUpdate> Network::readTripUpdates(std::string source) const {
+  std::vector<TripUpdate> updates;
+  CSVReader reader(source);
+  do {
+    std::string id = reader.getField("trip_id");
+    if (id.empty() == false) {
+      std::string sequence = reader.getField("stop_sequence");
+      std::string arrival = reader.getField("arrival_delay");
+      std::string departure = reader.getField("departure_delay", arrival);
+      std::string relationship = reader.getField("schedule_relationship");
+      TripUpdate item = {
+        id,
+        sequence.empty() ? INVALID_INDEX : (unsigned int)std::stoi(sequence),
+        reader.getField("stop_id"),
+        std::stoi(reader.getField("arrival_delay", departure.empty() ? "0" : departure)),
+        departure.empty() ? 0 : std::stoi(departure),
+        relationship == "CANCELED" || relationship == "3"
+      };
+      updates.push_back(item);
+    }
+  } while (reader.next());
+  return updates;
+}
+
 GTFSDate Network::parseDate(std::string input) {
   GTFSDate result = { 
     .day = (unsigned char)std::stoi(input.substr(6, 2)),
@@ -1,18 +1,43 @@
 #pragma once
 #include "types.h"
+#include "timetable.h"
+#include "query_context.h"
+#include "query_options.h"
+#include "query_cache.h"
+#include "batch_query.h"
+#include "work_pool.h"
+#include "reachability.h"
+#include "realtime_update.h"
 #include "scheduled_trip.h"
+#include "shape_index.h"
+#include "span.h"
+#include "spatial_index.h"
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <map>
+#include <memory>
+#include <functional>
+#include <string_view>
 
 namespace bht {
 
+/**
+ * Public transport network read from a set of GTFS files.
+ *
+ * Loading fills the public data members and builds all indices; afterwards
+ * the network is only read. The const methods never modify shared state and
+ * keep their working memory in a QueryContext, so they are safe to call
+ * concurrently as long as no thread modifies the network at the same time.
+ * Use NetworkSnapshot to share a frozen network between threads and
+ * LiveNetwork to replace it by a new feed while it is being queried.
+ */
 class Network {
   private:
     void readAgencies(std::string source);
     void readCalendarDates(std::string source);
     void readCalendars(std::string source);
+    void readFrequencies(std::string source);
     void readLevels(std::string source);
     void readPathways(std::string source);
     void readRoutes(std::string source);
@@ -21,6 +46,7 @@ class Network {
     void readStops(std::string source);
     void readTransfers(std::string source);
     void readTrips(std::string source);
+    std::vector<TripUpdate> readTripUpdates(std::string source) const;
 
     /**
      * Parse a date string to a date component struct
@@ -32,22 +58,174 @@ class Network {
      */
     GTFSTime parseTime(std::string input);
 
+    /**
+     * Build the dense index tables used by the routing algorithms
+     * once all GTFS files are loaded
+     */
+    void buildIndices();
+
+    /**
+     * Build the stop adjacency graph of getNeighbors() and getTravelPath()
+     */
+    void buildAdjacency();
+
+    /**
+     * Compute the connected components of the stop adjacency graph and of the
+     * graph of trip hops and footpaths, used to reject unreachable queries
+     */
+    void buildReachability();
+
+    /**
+     * Group the trips into route patterns: trips of one route calling at the same
+     * stops in the same order, split so that no trip overtakes another
+     */
+    void buildRoutePatterns();
+
+    /**
+     * Project the stops of every route pattern onto the shapes of its trips, in parallel
+     * and once per pattern and shape, for getTripLeg()
+     */
+    void buildShapeProjections();
+
+    /**
+     * Helper function to find the entry of a trip with the given stop sequence
+     * @return Position within the trip, INVALID_INDEX if the trip does not have that sequence
+     */
+    unsigned int findTripPosition(unsigned int trip, unsigned int stopSequence) const;
+
+    /**
+     * Check if trip later never runs before trip earlier of the same stop sequence
+     */
+    bool tripFollows(unsigned int earlier, unsigned int later) const;
+
+    /**
+     * Write new times of a trip to the timetable and mark it canceled or running
+     * @param faster Set to true if a hop of the trip got faster than before
+     * @return true if anything changed
+     */
+    bool setTripTimes(unsigned int trip, const TripEvent* events, bool canceled, bool& faster);
+
+    /**
+     * Sort the departure and arrival tables of the stops served by the given
+     * trips again after their times changed, and drop the preprocessing results
+     * and cached plans that depend on the old times
+     */
+    void refreshRealtimeTables(std::vector<unsigned int>& changedTrips, bool faster);
+
+    /**
+     * Compute the stop clusters and the fastest speed in the feed used
+     * for the lower bounds of the A* search. The ends of hops faster than
+     * MAX_HEURISTIC_SPEED share a cluster, so misplaced stops keep the bound exact.
+     */
+    void buildHeuristic();
+
+    /**
+     * Hash of the data the preprocessing results depend on
+     */
+    uint64_t getFingerprint() const;
+
+    /**
+     * Compute the walking times between the platforms of each station
+     * from the pathway graph of pathways.txt
+     */
+    void buildPathways();
+
+    /**
+     * Compile the same-station transfers, pathways, transfers.txt and walking connections
+     * between nearby stops into the footpath, change time and transfer rule tables
+     */
+    void buildFootpaths();
+
     // Optimized data structures for faster lookups (as recommended by professor)
-    std::multimap<std::string, std::string> stopTrips; // stop_id -> trip_id
-    std::multimap<std::string, std::string> tripStops; // trip_id -> stop_id
-    std::multimap<std::string, StopTime> tripStopTimes; // trip_id -> StopTime
-    std::multimap<std::string, std::string> stopsForTransferMap; // station_id -> stop_id
+    std::multimap<std::string, std::string, std::less<>> stopsForTransferMap; // station_id -> stop_id
     std::multimap<std::string, std::string> zoneStops; // zone_id -> stop_id (Aufgabe 5a)
+    std::multimap<std::string, std::string, std::less<>> prefixStops; // stop_id and each of its ':' prefixes -> stop_id
+
+    // Dense timetable indices, built once by buildIndices()
+    std::unordered_map<std::string_view, unsigned int> stopIndex; // stop_id -> dense stop index, keys point into stopIds
+    std::vector<std::string> stopIds; // dense stop index -> stop_id
+    std::vector<const Stop*> indexedStops; // dense stop index -> entry of stops
+    std::unordered_map<std::string_view, unsigned int> tripIndex; // trip_id -> index into trips, keys point into trips
+    std::vector<unsigned int> tripOffsets; // trip index -> first entry in tripStopTimes/tripEvents
+    std::vector<StopTime> tripStopTimes; // stop times grouped by trip, ordered by stop sequence
+    std::vector<TripEvent> tripEvents; // compact copy of tripStopTimes for the routing hot paths
+    std::vector<unsigned int> stopEventOffsets; // stop index -> first entry in stopEvents
+    std::vector<StopEvent> stopEvents; // trips calling at each stop
+    std::unordered_map<std::string_view, unsigned int> routeIndex; // route_id -> dense route index, keys point into routes
+    std::vector<const Route*> indexedRoutes; // dense route index -> entry of routes
+    std::vector<const Route*> sortedRoutes; // routes ordered by short name as returned by getRoutes()
+    std::vector<const Trip*> routeTrips; // trips ordered by route_id, then by their position in trips
+    std::vector<unsigned int> tripRoutes; // trip index -> dense route index
+    std::vector<unsigned int> departureOffsets; // stop index -> first entry in departures/routeDepartures
+    std::vector<Departure> departures; // departures of each stop ordered by time
+    std::vector<Departure> routeDepartures; // departures of each stop ordered by route, then time
+    std::vector<unsigned int> frequencyOffsets; // stop index -> first entry in frequencyDepartures
+    std::vector<FrequencyDeparture> frequencyDepartures; // departures of headway based trips at each stop
+    std::vector<unsigned int> arrivalOffsets; // stop index -> first entry in arrivals
+    std::vector<Departure> arrivals; // arrivals at each stop ordered by time, time is the arrival
+    std::vector<unsigned int> frequencyArrivalOffsets; // stop index -> first entry in frequencyArrivals
+    std::vector<FrequencyDeparture> frequencyArrivals; // arrivals of headway based trips, first and last are arrival times
+    std::vector<bool> frequencyTrips; // trip index -> runs are given by frequencies.txt
+    std::vector<uint32_t> tripFlags; // trip index -> TransportMode of its route and TripFlag bits
+    std::unordered_map<std::string, unsigned int> agencyIndex; // agency_id -> dense agency index
+    std::vector<unsigned int> tripAgencies; // trip index -> dense agency index
+    std::vector<bool> wheelchairStops; // dense stop index -> boarding is known to be wheelchair accessible
+    std::unordered_map<unsigned int, std::vector<TripEvent>> scheduledTripEvents; // trip index -> timetable times of trips moved by real-time updates
+    std::vector<unsigned int> tripPatterns; // trip index -> route pattern
+    std::vector<unsigned int> tripPatternRanks; // trip index -> entry in patternTrips
+    std::vector<unsigned int> patternOffsets; // route pattern -> first entry in patternTrips
+    std::vector<unsigned int> patternTrips; // trips of each route pattern ordered by departure
+    std::vector<unsigned int> stopPatternOffsets; // stop index -> first entry in stopPatterns
+    std::vector<PatternEvent> stopPatterns; // route patterns calling at each stop
+    std::vector<unsigned int> tripShapeStops; // trip index -> first entry in shapeStops, INVALID_INDEX without shape
+    std::vector<ShapeStop> shapeStops; // stops of each route pattern projected onto the shape of its trips
+    std::vector<unsigned int> tripTransferOffsets; // entry of tripEvents -> first entry in tripTransfers
+    std::vector<TripTransfer> tripTransfers; // transfers of the trip-based search after leaving a trip
+    std::vector<unsigned int> transferOffsets; // stop index -> first entry in transferStops
+    std::vector<unsigned int> transferStops; // stops of the same station as returned by getStopsForTransfer
+    std::vector<unsigned int> adjacencyOffsets; // stop index -> first entry in adjacency
+    std::vector<unsigned int> adjacency; // neighbors of each stop as returned by getNeighbors
+    std::vector<unsigned int> incomingAdjacencyOffsets; // stop index -> first entry in incomingAdjacency
+    std::vector<unsigned int> incomingAdjacency; // stops having each stop as neighbor
+    Reachability pathReachability; // components of the adjacency graph of getTravelPath
+    Reachability planReachability; // components of the graph of trip hops and footpaths
+    std::vector<unsigned int> footpathOffsets; // stop index -> first entry in footpaths
+    std::vector<Footpath> footpaths; // walking connections used by the routing algorithms
+    std::vector<unsigned int> incomingFootpathOffsets; // stop index -> first entry in incomingFootpaths
+    std::vector<Footpath> incomingFootpaths; // footpaths grouped by target, stop is the stop they start at
+    std::vector<int> stopChangeTimes; // minimum time to change trips at the same stop
+    std::vector<unsigned int> transferRuleOffsets; // stop index -> first entry in transferRules
+    std::vector<TransferRule> transferRules; // route and trip specific rules by from stop
+    std::vector<unsigned int> stationPlatformOffsets; // station -> first entry in stationPlatforms
+    std::vector<unsigned int> stationPlatforms; // dense stop indices of the platforms of each station
+    std::vector<unsigned int> stationTimeOffsets; // station -> first entry in stationTimes
+    std::vector<uint16_t> stationTimes; // platform to platform walking seconds, row major per station
+    std::vector<unsigned int> stopClusters; // dense stop index -> stops reachable from each other without spending time
+    std::vector<int32_t> clusterLatitudes; // cluster center latitude in microdegrees
+    std::vector<int32_t> clusterLongitudes; // cluster center longitude in microdegrees
+    int32_t heuristicLatitude; // reference latitude of the A* distance projection
+    float heuristicScale; // seconds per meter of the A* lower bound, 0 if A* falls back to Dijkstra
+    std::vector<unsigned int> landmarks; // dense stop indices of the ALT landmarks
+    std::vector<uint16_t> landmarkDistancesTo; // stop major, seconds from each stop to every landmark
+    std::vector<uint16_t> landmarkDistancesFrom; // stop major, seconds from every landmark to each stop
+    std::vector<int32_t> stopLatitudes; // dense stop index -> latitude in microdegrees
+    std::vector<int32_t> stopLongitudes; // dense stop index -> longitude in microdegrees
+    SpatialIndex stopGrid; // stop coordinates by dense stop index
+    double footpathRadius; // maximum walking distance of generated footpaths in meters
+    uint64_t dataVersion; // changes whenever the indices are built, used to invalidate cached plans
+    std::map<std::string, uint64_t> feedHashes; // GTFS file name -> content hash of the version read last
+    std::shared_ptr<QueryCache> queryCache; // cache of travel plans, null unless enabled
 
   public:
     /// @brief Properties fetched from GTFS files
     std::unordered_map<std::string, Agency> agencies;
     std::vector<CalendarDate> calendarDates;
     std::unordered_map<std::string, Calendar> calendars;
+    std::vector<Frequency> frequencies;
     std::unordered_map<std::string, Level> levels;
     std::unordered_map<std::string, Pathway> pathways;
     std::unordered_map<std::string, Route> routes;
-    std::vector<Shape> shapes;
+    ShapeIndex shapes; // points grouped by shape, see ShapeIndex
     std::vector<StopTime> stopTimes;
     std::unordered_map<std::string, Stop> stops;
     std::vector<Transfer> transfers;
@@ -55,9 +233,26 @@ class Network {
 
     /**
      * Create a new network and read all data from files
-     * located in the given directory
+     * located in the given directory. Stops closer than footpathRadius
+     * meters are connected by walking footpaths, 0 disables them.
      */
-    Network(std::string directory);
+    Network(std::string directory, double footpathRadius = DEFAULT_FOOTPATH_RADIUS);
+
+    /// @brief The indices point into the GTFS tables, so a network can be moved but not copied
+    Network(const Network&) = delete;
+    Network& operator=(const Network&) = delete;
+    Network(Network&&) = default;
+    Network& operator=(Network&&) = default;
+
+    /**
+     * @brief Read again only the files whose content changed; no query may run meanwhile.
+     * agency, routes, stops, trips, stop_times and frequencies rebuild all indices and drop preprocessing
+     * and real-time updates, pathways and transfers the footpaths and drop preprocessing, shapes the stop
+     * projections; calendar, calendar_dates and levels rebuild nothing as there are no per-service bitsets.
+     * @param directory Directory containing the GTFS files
+     * @return Names of the files that were read again
+     */
+    std::vector<std::string> reload(const std::string& directory);
 
     /**
      * @brief search Search for stops matching the given search string
@@ -66,18 +261,31 @@ class Network {
      */
     std::vector<Stop> search(std::string needle) const;
 
+    /**
+     * @brief Search for stops matching the given search string without copying them
+     * @param needle Search string to use to find stops
+     * @param result Receives the matching stops, only allocates if its capacity is too small
+     */
+    void search(std::string_view needle, std::vector<const Stop*>& result) const;
+
     /**
      * @brief Return a vector of all routes in the network
      * @return Ordered result vector of routes
      */
     std::vector<Route> getRoutes() const;
 
+    /**
+     * @brief Return all routes in the network without copying them
+     * @return Routes ordered like getRoutes()
+     */
+    Span<const Route* const> viewRoutes() const;
+
     /**
      * @brief Return the display name of a route to show to the user
      * @param route Route object to return the display name for
      * @return String to display for the route
      */
-    std::string getRouteDisplayName(Route route) const;
+    std::string getRouteDisplayName(const Route& route) const;
 
     /**
      * Return a vector of all trips associated with the given route
@@ -86,12 +294,19 @@ class Network {
      */
     std::vector<Trip> getTripsForRoute(std::string routeId) const;
 
+    /**
+     * @brief Return all trips of the given route without copying them
+     * @param routeId ID of the route to get trips for
+     * @return Trips in the order of getTripsForRoute()
+     */
+    Span<const Trip* const> viewTripsForRoute(std::string_view routeId) const;
+
     /**
      * @brief Return the display name of a trip to show to the user
      * @param trip Trip object to return the display name for
      * @return String to display for the trip
      */
-    std::string getTripDisplayName(Trip trip) const;
+    std::string getTripDisplayName(const Trip& trip) const;
 
     /**
      * @brief Return a vector of all stops and their times associated with the given trip
@@ -100,6 +315,35 @@ class Network {
      */
     std::vector<StopTime> getStopTimesForTrip(std::string tripId) const;
 
+    /**
+     * @brief Return the stop times of the given trip without copying them. Unlike
+     * getStopTimesForTrip() this includes stop times of stops missing in stops.txt.
+     * @param tripId ID of the trip to get stop times for
+     * @return Stop times ordered by stop sequence, empty if the trip is unknown
+     */
+    Span<const StopTime> viewStopTimesForTrip(std::string_view tripId) const;
+
+    /**
+     * @brief Return the path the vehicle of a trip travels along, for drawing it on a map
+     * @param tripId ID of the trip
+     * @param tolerance Maximum distance in meters a dropped point may have from the
+     * simplified line, 0 returns all points of the shape
+     * @return Points in sequence order, empty if the trip has no shape
+     */
+    std::vector<Coordinate> getShapeForTrip(const std::string& tripId, double tolerance = 0) const;
+
+    /**
+     * @brief Return the geometry and length of the ride between two stops of a trip, e.g.
+     * for drawing a leg of a travel plan or distance based fares. Stops are projected onto
+     * the shape of the trip once when the network is loaded, so this takes constant time.
+     * @param tripId ID of the trip
+     * @param fromSequence Stop sequence of the boarding stop
+     * @param toSequence Stop sequence of the alighting stop, not before the boarding stop
+     * @param leg Receives the leg, its points refer to the network and stay valid until it is reloaded
+     * @return false if the trip or the stop sequences are unknown or the trip has no shape
+     */
+    bool getTripLeg(const std::string& tripId, unsigned int fromSequence, unsigned int toSequence, TripLeg& leg) const;
+
     /**
      * @brief Return the stop object for the object identified by the given id
      * @param stopId ID of the stop to get the datastructure for
@@ -107,6 +351,27 @@ class Network {
      */
     Stop getStopById(std::string stopId) const;
 
+    /**
+     * @brief Look up a stop without copying it
+     * @param stopId ID of the stop
+     * @return Stop of the network, nullptr if it is unknown
+     */
+    const Stop* findStop(std::string_view stopId) const;
+
+    /**
+     * @brief Look up a trip without copying it
+     * @param tripId ID of the trip
+     * @return Trip of the network, nullptr if it is unknown
+     */
+    const Trip* findTrip(std::string_view tripId) const;
+
+    /**
+     * @brief Look up a route without copying it
+     * @param routeId ID of the route
+     * @return Route of the network, nullptr if it is unknown
+     */
+    const Route* findRoute(std::string_view routeId) const;
+
     /**
      * @brief Return a vector of all stops and their times associated with the given trip
      * filtered by the given search word
@@ -125,6 +390,14 @@ class Network {
      */
     std::vector<Stop> getStopsForTransfer(const std::string& stopId) const;
 
+    /**
+     * @brief Get all stops that belong to the same station as the given stop without copying them
+     * @param stopId ID of the stop or station
+     * @param result Receives the stops in the order of getStopsForTransfer(), only allocates
+     * if its capacity is too small
+     */
+    void getStopsForTransfer(std::string_view stopId, std::vector<const Stop*>& result) const;
+
     /**
      * @brief Get all neighboring stops for a given stop (connected by trips and transfers)
      * @param stopId ID of the stop
@@ -132,6 +405,14 @@ class Network {
      */
     std::unordered_set<std::string> getNeighbors(const std::string& stopId) const;
 
+    /**
+     * @brief Get all neighboring stops for a given stop without allocating
+     * @param context Query context of the calling thread holding the result
+     * @param stopId ID of the stop
+     * @return Dense indices of the neighboring stops, valid until the next query on context
+     */
+    const std::vector<unsigned int>& getNeighbors(QueryContext& context, const std::string& stopId) const;
+
     /**
      * @brief Calculate the shortest path between two stops
      * @param fromStopId ID of the starting stop
@@ -140,6 +421,15 @@ class Network {
      */
     std::vector<Stop> getTravelPath(const std::string& fromStopId, const std::string& toStopId) const;
 
+    /**
+     * @brief Calculate the shortest path between two stops reusing the given working memory
+     * @param context Query context of the calling thread
+     * @param fromStopId ID of the starting stop
+     * @param toStopId ID of the destination stop
+     * @return Vector of stops representing the path (empty if no path exists)
+     */
+    std::vector<Stop> getTravelPath(QueryContext& context, const std::string& fromStopId, const std::string& toStopId) const;
+
     /**
      * @brief Get a scheduled trip object for iteration
      * @param tripId ID of the trip
@@ -147,6 +437,19 @@ class Network {
      */
     NetworkScheduledTrip getScheduledTrip(const std::string& tripId) const;
 
+    /**
+     * @brief Return the next departures from a stop, e.g. for a station display. Only stop
+     * times passengers can board are departures: not the last stop of a trip, not stops
+     * without pickup and not canceled trips.
+     * @param stopId ID of the stop
+     * @param afterTime Only departures at or after this time to the second are returned;
+     * times are seconds of the service day, so departures after midnight have hours of 24 and more
+     * @param count Maximum number of departures to return
+     * @param routeId Only return departures of this route, all routes if empty
+     * @return Stop times of the departing trips ordered by departure time
+     */
+    std::vector<StopTime> getDepartureBoard(const std::string& stopId, const GTFSTime& afterTime, size_t count, const std::string& routeId = "") const;
+
     // New methods for Aufgabe 5
 
     /**
@@ -160,6 +463,219 @@ class Network {
                                                    const std::string& toStopId, 
                                                    const GTFSTime& departureTime) const;
 
+    /**
+     * @brief Calculate travel plan with departure time constraints reusing the given working memory
+     * @param context Query context of the calling thread
+     * @param fromStopId ID of the starting stop
+     * @param toStopId ID of the destination stop
+     * @param departureTime Desired departure time
+     * @param options Search algorithm to use and filters on the trips that may be ridden:
+     * transport modes, agencies, wheelchair accessibility (of trips and of the stops boarded
+     * and left) and bikes. Filtered queries always run the Dijkstra search of the chosen
+     * algorithm, trip transfers are preprocessed for the unfiltered network.
+     * @return Vector of StopTime objects representing the travel plan with times
+     */
+    std::vector<StopTime> getTravelPlanDepartingAt(QueryContext& context,
+                                                   const std::string& fromStopId,
+                                                   const std::string& toStopId,
+                                                   const GTFSTime& departureTime,
+                                                   const QueryOptions& options = QueryOptions()) const;
+
+    /**
+     * @brief Calculate the travel plans of many queries on a pool of threads. Dijkstra
+     * queries leaving the same stop at the same time with the same filters share one
+     * search to all stops; queries of the goal directed algorithms are searched one by one.
+     * Plans are taken from and added to the query cache like single queries.
+     * @param queries Queries to answer
+     * @param statistics Receives the throughput and latency of the batch if not null
+     * @param threadCount Number of worker threads, 0 uses one per hardware thread
+     * @return Travel plans in the order of the queries
+     */
+    std::vector<std::vector<StopTime>> getTravelPlansDepartingAt(const std::vector<TravelPlanQuery>& queries,
+                                                                 BatchStatistics* statistics = nullptr,
+                                                                 unsigned int threadCount = 0) const;
+
+    /**
+     * @brief Calculate the travel plans of many queries like getTravelPlansDepartingAt, but
+     * hand out every plan as soon as it is ready instead of collecting them
+     * @param callback Called with the index of the query and its plan, which may be moved from.
+     * Calls come from the worker threads in any order, but never at the same time.
+     */
+    void streamTravelPlansDepartingAt(const std::vector<TravelPlanQuery>& queries,
+                                      const std::function<void(size_t index, std::vector<StopTime>& plan)>& callback,
+                                      BatchStatistics* statistics = nullptr,
+                                      unsigned int threadCount = 0) const;
+
+    /**
+     * @brief Calculate the travel plan that leaves as late as possible and still arrives in time
+     * @param fromStopId ID of the starting stop
+     * @param toStopId ID of the destination stop
+     * @param arrivalTime Latest arrival at the destination
+     * @return Vector of StopTime objects representing the travel plan with times
+     */
+    std::vector<StopTime> getTravelPlanArrivingBy(const std::string& fromStopId,
+                                                  const std::string& toStopId,
+                                                  const GTFSTime& arrivalTime) const;
+
+    /**
+     * @brief Calculate the latest departure travel plan reusing the given working memory
+     * @param context Query context of the calling thread
+     * @param fromStopId ID of the starting stop
+     * @param toStopId ID of the destination stop
+     * @param arrivalTime Latest arrival at the destination
+     * @param options Filters on the trips that may be ridden, see getTravelPlanDepartingAt();
+     * the algorithm is ignored
+     * @return Vector of StopTime objects representing the travel plan with times
+     */
+    std::vector<StopTime> getTravelPlanArrivingBy(QueryContext& context,
+                                                  const std::string& fromStopId,
+                                                  const std::string& toStopId,
+                                                  const GTFSTime& arrivalTime,
+                                                  const QueryOptions& options = QueryOptions()) const;
+
+    /**
+     * @brief Cache travel plans of repeated queries. Queries are keyed by stops, options
+     * and time bucket; cached plans are dropped when the network data changes.
+     * Call it before sharing the network between threads, the cache itself is thread-safe.
+     * @param memoryBudget Maximum estimated memory of the cached plans in bytes
+     * @param bucketSeconds Width of the time buckets queries are grouped by
+     */
+    void enableQueryCache(size_t memoryBudget = DEFAULT_CACHE_BUDGET, int bucketSeconds = DEFAULT_CACHE_BUCKET);
+
+    /**
+     * @brief Stop caching travel plans and free the cache
+     */
+    void disableQueryCache();
+
+    /**
+     * @brief Return the hit and miss counters of the query cache, all zero if it is disabled
+     */
+    QueryCacheStatistics getQueryCacheStatistics() const;
+
+    /**
+     * @brief Return the dense index of a stop as used by the query context results
+     * @param stopId ID of the stop
+     * @return Index of the stop or INVALID_INDEX if the stop is unknown
+     */
+    unsigned int getStopIndex(std::string_view stopId) const;
+
+    /**
+     * @brief Return the id of the stop with the given dense index
+     * @param index Dense index of the stop
+     * @return ID of the stop
+     */
+    const std::string& getStopId(unsigned int index) const;
+
+    /**
+     * @brief Return the stops closest to a position, e.g. to start a search from a GPS fix
+     * @param latitude Latitude in degrees
+     * @param longitude Longitude in degrees
+     * @param k Maximum number of stops to return
+     * @return Dense stop indices and distances ordered by distance
+     */
+    std::vector<StopDistance> nearestStops(double latitude, double longitude, size_t k) const;
+
+    /**
+     * @brief Return the stops closest to a position into a reused buffer
+     * @param result Receives the stops, only allocates if its capacity is smaller than k
+     */
+    void nearestStops(double latitude, double longitude, size_t k, std::vector<StopDistance>& result) const;
+
+    /**
+     * @brief Return the stops closest to each of the given positions
+     * @param positions Query positions
+     * @param k Maximum number of stops per position
+     * @param result Receives the stops of all positions, each ordered by distance
+     * @param offsets Receives the first entry in result for every position plus the end
+     */
+    void nearestStops(const std::vector<Coordinate>& positions, size_t k, std::vector<StopDistance>& result, std::vector<unsigned int>& offsets) const;
+
+    /**
+     * @brief Return all stops within walking distance of a position
+     * @param latitude Latitude in degrees
+     * @param longitude Longitude in degrees
+     * @param meters Search radius
+     * @return Dense stop indices and distances ordered by distance
+     */
+    std::vector<StopDistance> stopsWithinRadius(double latitude, double longitude, double meters) const;
+
+    /**
+     * @brief Return all stops within walking distance of a position into a reused buffer
+     * @param result Receives the stops, only allocates if its capacity is too small
+     */
+    void stopsWithinRadius(double latitude, double longitude, double meters, std::vector<StopDistance>& result) const;
+
+    /**
+     * @brief Return all stops within walking distance of each of the given positions
+     * @param positions Query positions
+     * @param meters Search radius
+     * @param result Receives the stops of all positions, each ordered by distance
+     * @param offsets Receives the first entry in result for every position plus the end
+     */
+    void stopsWithinRadius(const std::vector<Coordinate>& positions, double meters, std::vector<StopDistance>& result, std::vector<unsigned int>& offsets) const;
+
+    /**
+     * @brief Select landmarks and precompute the travel time lower bounds to and from
+     * them used by RoutingAlgorithm_ALT. Runs the searches of the landmarks in parallel;
+     * call it before sharing the network between threads.
+     * @param landmarkCount Number of landmarks to select
+     */
+    void preprocessLandmarks(unsigned int landmarkCount = DEFAULT_LANDMARK_COUNT);
+
+    /**
+     * @brief Precompute the trip to trip transfers used by RoutingAlgorithm_TripBased.
+     * Only transfers that lead to an earlier arrival somewhere are kept. Trips are
+     * processed in parallel; call it before sharing the network between threads.
+     * Headway based trips are not part of the transfer set, the trip-based search
+     * does not ride them.
+     */
+    void preprocessTripTransfers();
+
+    /**
+     * @brief Write the preprocessing results (landmark tables, trip transfers) to a file
+     * @param path File to write
+     * @return true if the file was written
+     */
+    bool savePreprocessing(const std::string& path) const;
+
+    /**
+     * @brief Read preprocessing results written by savePreprocessing()
+     * @param path File to read
+     * @return false if the file is missing, damaged or was written for different GTFS data
+     */
+    bool loadPreprocessing(const std::string& path);
+
+    /**
+     * @brief Apply real-time delays and cancellations on top of the timetable. Only the
+     * times of the updated trips change and only the departure and arrival tables of
+     * the stops they serve are sorted again, so a batch of updates takes milliseconds.
+     * Travel plans and departure boards see the new times at the next query.
+     *
+     * The updates of a trip replace earlier updates of the same trip, other trips keep
+     * their state. Times of headway based trips are not moved, they can only be canceled.
+     * Precomputed trip transfers are dropped, run preprocessTripTransfers() again to use
+     * RoutingAlgorithm_TripBased; landmarks are dropped if a hop got faster than before.
+     * Like loading, this modifies the network: no query may run at the same time.
+     * @param updates Updates to apply, unknown trips and stops are ignored
+     * @return Number of trips whose times or cancellation changed
+     */
+    size_t applyRealtimeUpdates(const std::vector<TripUpdate>& updates);
+
+    /**
+     * @brief Read real-time updates from a file and apply them like above. The file is a
+     * CSV table with the fields of a GTFS-RT trip update: trip_id, stop_sequence or
+     * stop_id, arrival_delay, departure_delay (each defaults to the other) and
+     * schedule_relationship, where CANCELED cancels the whole trip.
+     * @param path File to read
+     * @return Number of trips whose times or cancellation changed
+     */
+    size_t applyRealtimeUpdates(const std::string& path);
+
+    /**
+     * @brief Drop all real-time updates and return to the timetable
+     */
+    void clearRealtimeUpdates();
+
 private:
     /**
      * Helper function to compare GTFSTime objects
@@ -167,9 +683,91 @@ private:
     bool isTimeGreaterOrEqual(const GTFSTime& time1, const GTFSTime& time2) const;
     
     /**
-     * Helper function to get next available departure from a stop after given time
+     * Helper function to get next available departure from a stop after given time.
+     * Returns every stop time at the stop in minute precision, see getDepartureBoard()
+     * for the departures passengers can board.
      */
     std::vector<StopTime> getNextDeparturesFrom(const std::string& stopId, const GTFSTime& afterTime) const;
+
+    /**
+     * Helper function to binary search the first departure at or after the given time
+     */
+    static const Departure* findFirstDeparture(const Departure* begin, const Departure* end, int time);
+
+    /**
+     * Helper function to turn the predecessor references of a finished search
+     * into the stop times of the travel plan ending with the ride to the given stop
+     */
+    std::vector<StopTime> reconstructTravelPlan(QueryContext& context, unsigned int lastStop) const;
+
+    /**
+     * Helper function to run the search of getTravelPlanDepartingAt between two stops
+     */
+    std::vector<StopTime> searchTravelPlanDepartingAt(QueryContext& context, unsigned int source, unsigned int target, int departure,
+                                                      const QueryOptions& options) const;
+
+    /**
+     * Helper function to run the backward search of getTravelPlanArrivingBy between two stops
+     */
+    std::vector<StopTime> searchTravelPlanArrivingBy(QueryContext& context, unsigned int source, unsigned int target, int arrival,
+                                                     const QueryOptions& options) const;
+
+    /**
+     * Helper function to return the footpath duration between two stops
+     * @return 0 for the same stop, INFINITE_TIME if there is no footpath
+     */
+    int getWalkingTime(unsigned int from, unsigned int to) const;
+
+    /**
+     * Helper function to store a plan departing from source in the query cache,
+     * valid for later departures that still catch its first vehicle
+     */
+    void cacheTravelPlan(const QueryCacheKey& key, unsigned int source, int departure, const std::vector<StopTime>& plan) const;
+
+    /**
+     * Helper function to run the trip-based search, see preprocessTripTransfers()
+     */
+    std::vector<StopTime> getTripBasedTravelPlan(QueryContext& context, unsigned int source, unsigned int target, int departure) const;
+
+    /**
+     * Helper function to find the first trip of a route pattern that departs at the given
+     * position not before time and allows boarding there
+     * @return Entry in patternTrips or the end of the pattern if there is none
+     */
+    unsigned int findFirstPatternTrip(unsigned int pattern, unsigned int position, int time) const;
+
+    /**
+     * Helper function to return a stop time of a trip, moved by shift seconds
+     * for runs of headway based trips
+     */
+    StopTime getStopTime(unsigned int trip, unsigned int position, int shift) const;
+
+    /**
+     * Helper function to check if the run of trip moved by shift can be left at the arrival
+     * time at the stop of the given backward search label, see getTravelPlanArrivingBy()
+     */
+    bool canAlight(QueryContext& context, unsigned int stop, const StopLabel& label, unsigned int trip, int shift, int arrival) const;
+
+    /**
+     * Helper function to compile the trip filters of the query options once per query
+     * @param context Receives the agencies the query may ride
+     * @return Trip flags the query rejects, tripFlags of allowed trips have none of them
+     */
+    uint32_t compileTripFilter(QueryContext& context, const QueryOptions& options) const;
+
+    /**
+     * Helper function to find the most specific transfer rule for changing from
+     * trip fromTrip at stop fromStop to trip toTrip at stop toStop
+     * @return Matching rule or nullptr if only the footpath and change time tables apply
+     */
+    const TransferRule* findTransferRule(unsigned int fromStop, unsigned int toStop, unsigned int fromTrip, unsigned int toTrip) const;
+
+    /**
+     * Helper function to check if the run of trip moved by shift can be boarded at the
+     * departure time from the stop of the given label, applying change times and transfer rules
+     */
+    bool canBoard(QueryContext& context, unsigned int stop, const StopLabel& label, unsigned int trip, int shift, int departure) const;
+
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,17 @@
+#include "network_snapshot.h"
+
+namespace bht {
+
+NetworkSnapshot::NetworkSnapshot(Network&& network)
+    : network(std::make_shared<const Network>(std::move(network))) {
+}
+
+NetworkSnapshot::NetworkSnapshot(std::shared_ptr<const Network> network)
+    : network(std::move(network)) {
+}
+
+NetworkSnapshot NetworkSnapshot::load(const std::string& directory, double footpathRadius) {
+    return NetworkSnapshot(Network(directory, footpathRadius));
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "network.h"
+#include <memory>
+#include <string>
+
+namespace bht {
+
+/**
+ * Immutable, shareable view of a fully loaded network.
+ *
+ * A snapshot only hands out const access to the network it owns, so the
+ * data can no longer change after loading (e.g. through stops[] inserting
+ * missing keys). All const methods of Network only read shared data and use
+ * thread-local or caller-provided QueryContext objects for their working
+ * memory, which makes every query on a snapshot safe to call concurrently
+ * from any number of threads. Copies are cheap and share the same network.
+ */
+class NetworkSnapshot {
+  private:
+    std::shared_ptr<const Network> network;
+
+  public:
+    /**
+     * Freeze an already loaded network
+     */
+    explicit NetworkSnapshot(Network&& network);
+
+    /**
+     * Share a network that is already frozen, e.g. one taken from share()
+     */
+    explicit NetworkSnapshot(std::shared_ptr<const Network> network);
+
+    /**
+     * @brief Read all GTFS files in the given directory and freeze the result
+     * @param directory Directory containing the GTFS files
+     * @param footpathRadius Maximum walking distance between stops in meters
+     * @return Snapshot of the loaded network
+     */
+    static NetworkSnapshot load(const std::string& directory, double footpathRadius = DEFAULT_FOOTPATH_RADIUS);
+
+    /**
+     * @brief Access the read API of the network
+     */
+    const Network& operator*() const { return *network; }
+    const Network* operator->() const { return network.get(); }
+
+    /**
+     * @brief Return the shared pointer keeping the network alive
+     */
+    std::shared_ptr<const Network> share() const { return network; }
+};
+
+}
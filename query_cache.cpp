@@ -0,0 +1,105 @@
+#include "query_cache.h"
+#include <algorithm>
+#include <functional>
+
+namespace bht {
+
+size_t QueryCache::KeyHash::operator()(const QueryCacheKey& key) const {
+    size_t hash = std::hash<uint64_t>()(((uint64_t)key.from << 32) | key.to);
+    hash = hash * 31 + std::hash<int>()(key.bucket);
+    hash = hash * 31 + key.arriving;
+    hash = hash * 31 + key.options.algorithm;
+    hash = hash * 31 + key.options.modes;
+    hash = hash * 31 + (key.options.wheelchairAccessible ? 1 : 0) * 2 + (key.options.bikesAllowed ? 1 : 0);
+    for (const std::string& agencyId : key.options.agencyIds) {
+        hash = hash * 31 + std::hash<std::string>()(agencyId);
+    }
+    return hash;
+}
+
+namespace {
+
+// Rough heap usage of a plan, strings are counted by capacity
+size_t estimateBytes(const std::vector<StopTime>& plan) {
+    size_t bytes = plan.capacity() * sizeof(StopTime);
+    for (const StopTime& stopTime : plan) {
+        bytes += stopTime.tripId.capacity() + stopTime.stopId.capacity() + stopTime.stopHeadsign.capacity();
+    }
+    return bytes;
+}
+
+}
+
+QueryCache::QueryCache(size_t memoryBudget, int bucketSeconds)
+    : shardBudget(memoryBudget / SHARD_COUNT), bucketSeconds(std::max(1, bucketSeconds)) {
+}
+
+QueryCacheKey QueryCache::makeKey(unsigned int from, unsigned int to, int time, bool arriving, const QueryOptions& options) const {
+    return QueryCacheKey{from, to, time / bucketSeconds, arriving, options};
+}
+
+bool QueryCache::find(const QueryCacheKey& key, int time, uint64_t version, std::vector<StopTime>& plan) {
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end() && it->second->version != version) {
+        erase(shard, it->second);
+        it = shard.index.end();
+    }
+    if (it == shard.index.end() || time < it->second->validFrom || time > it->second->validUntil) {
+        misses++;
+        return false;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    plan = it->second->plan;
+    hits++;
+    return true;
+}
+
+void QueryCache::insert(const QueryCacheKey& key, uint64_t version, int validFrom, int validUntil, const std::vector<StopTime>& plan) {
+    Entry entry{key, version, validFrom, validUntil, plan, 0};
+    entry.bytes = sizeof(Entry) + 2 * sizeof(void*) + sizeof(QueryCacheKey) + estimateBytes(entry.plan);
+    if (entry.bytes > shardBudget) {
+        return;
+    }
+
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        erase(shard, it->second);
+    }
+    shard.bytes += entry.bytes;
+    shard.entries.push_front(std::move(entry));
+    shard.index[key] = shard.entries.begin();
+    while (shard.bytes > shardBudget) {
+        erase(shard, std::prev(shard.entries.end()));
+    }
+}
+
+void QueryCache::erase(Shard& shard, std::list<Entry>::iterator entry) {
+    shard.bytes -= entry->bytes;
+    shard.index.erase(entry->key);
+    shard.entries.erase(entry);
+}
+
+void QueryCache::clear() {
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.entries.clear();
+        shard.index.clear();
+        shard.bytes = 0;
+    }
+}
+
+QueryCacheStatistics QueryCache::getStatistics() {
+    QueryCacheStatistics statistics{hits.load(), misses.load(), 0, 0};
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        statistics.entries += shard.entries.size();
+        statistics.bytes += shard.bytes;
+    }
+    return statistics;
+}
+
+}
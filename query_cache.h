@@ -0,0 +1,133 @@
+#pragma once
+#include "types.h"
+#include "query_options.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace bht {
+
+/// @brief Memory budget of a query cache in bytes used by Network::enableQueryCache by default
+constexpr size_t DEFAULT_CACHE_BUDGET = 64 * 1024 * 1024;
+
+/// @brief Width of the departure time buckets of the query cache in seconds
+constexpr int DEFAULT_CACHE_BUCKET = 300;
+
+/**
+ * Counters of a query cache
+ */
+typedef struct SQueryCacheStatistics {
+  uint64_t hits;
+  uint64_t misses;
+  size_t entries;
+  size_t bytes;  // estimated memory used by the entries
+} QueryCacheStatistics;
+
+/**
+ * Key of a cached travel plan: the query with its time reduced to a bucket
+ */
+typedef struct SQueryCacheKey {
+  unsigned int from;  // dense stop index
+  unsigned int to;    // dense stop index
+  int bucket;         // query time divided by the bucket width
+  bool arriving;      // arrive-by instead of depart-at query
+  QueryOptions options;
+} QueryCacheKey;
+
+inline bool operator==(const QueryCacheKey& a, const QueryCacheKey& b) {
+  return a.from == b.from && a.to == b.to && a.bucket == b.bucket && a.arriving == b.arriving && a.options == b.options;
+}
+
+/**
+ * Thread-safe LRU cache of travel plans.
+ *
+ * Queries a few minutes apart share one entry: an entry stores the range of
+ * query times its plan is still the best answer for, e.g. a depart-at plan
+ * stays optimal for every later departure until its first vehicle leaves.
+ * Entries carry the data version of the network they were computed on and
+ * are dropped when it changed. The cache is split into shards with their own
+ * lock and an equal part of the memory budget, so concurrent queries rarely
+ * wait for each other.
+ */
+class QueryCache {
+  private:
+    struct KeyHash {
+      size_t operator()(const QueryCacheKey& key) const;
+    };
+    struct Entry {
+      QueryCacheKey key;
+      uint64_t version;     // network data version the plan was computed on
+      int validFrom;        // first query time the plan answers
+      int validUntil;       // last query time the plan answers
+      std::vector<StopTime> plan;
+      size_t bytes;
+    };
+    struct Shard {
+      std::mutex mutex;
+      std::list<Entry> entries; // most recently used first
+      std::unordered_map<QueryCacheKey, std::list<Entry>::iterator, KeyHash> index;
+      size_t bytes = 0;
+    };
+
+    /// @brief Number of independently locked parts of the cache
+    static constexpr size_t SHARD_COUNT = 16;
+
+    Shard shards[SHARD_COUNT];
+    size_t shardBudget; // memory budget of each shard in bytes
+    int bucketSeconds;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    Shard& shardOf(const QueryCacheKey& key) { return shards[KeyHash()(key) % SHARD_COUNT]; }
+
+    /**
+     * Remove an entry, the shard must be locked
+     */
+    void erase(Shard& shard, std::list<Entry>::iterator entry);
+
+  public:
+    /**
+     * @brief Create an empty cache
+     * @param memoryBudget Maximum estimated memory of all entries in bytes
+     * @param bucketSeconds Width of the query time buckets
+     */
+    QueryCache(size_t memoryBudget = DEFAULT_CACHE_BUDGET, int bucketSeconds = DEFAULT_CACHE_BUCKET);
+
+    /**
+     * @brief Return the key of a query
+     * @param time Departure or arrival time of the query in seconds after midnight
+     */
+    QueryCacheKey makeKey(unsigned int from, unsigned int to, int time, bool arriving, const QueryOptions& options) const;
+
+    /**
+     * @brief Look up the plan of a query
+     * @param key Key returned by makeKey
+     * @param time Query time in seconds after midnight
+     * @param version Current data version of the network
+     * @param plan Receives the cached plan on a hit
+     * @return true on a hit
+     */
+    bool find(const QueryCacheKey& key, int time, uint64_t version, std::vector<StopTime>& plan);
+
+    /**
+     * @brief Store the plan of a query, evicting the least recently used entries over budget
+     * @param validFrom First query time the plan is the answer for
+     * @param validUntil Last query time the plan is the answer for
+     */
+    void insert(const QueryCacheKey& key, uint64_t version, int validFrom, int validUntil, const std::vector<StopTime>& plan);
+
+    /**
+     * @brief Remove all entries, the counters are kept
+     */
+    void clear();
+
+    /**
+     * @brief Return the hit and miss counters and the current size
+     */
+    QueryCacheStatistics getStatistics();
+};
+
+}
@@ -0,0 +1,56 @@
+#include "query_context.h"
+#include <algorithm>
+#include <functional>
+
+namespace bht {
+
+QueryContext::QueryContext() : epoch(0), agencyVersion(0), settledCount(0) {
+}
+
+QueryContext& QueryContext::local() {
+  static thread_local QueryContext context;
+  return context;
+}
+
+void QueryContext::reset(size_t stopCount, size_t tripCount) {
+  // Grow the arrays once, new entries get stamp 0 which is never a valid epoch
+  if (labels.size() < stopCount) {
+    labels.resize(stopCount);
+    labelStamps.resize(stopCount, 0);
+    settledStamps.resize(stopCount, 0);
+  }
+  if (tripReached.size() < tripCount) {
+    tripReached.resize(tripCount);
+    tripStamps.resize(tripCount, 0);
+  }
+
+  // Only clear the stamps when the epoch counter wraps around
+  if (++epoch == 0) {
+    std::fill(labelStamps.begin(), labelStamps.end(), 0);
+    std::fill(settledStamps.begin(), settledStamps.end(), 0);
+    std::fill(tripStamps.begin(), tripStamps.end(), 0);
+    epoch = 1;
+  }
+
+  settledCount = 0;
+  heap.clear();
+  queue.clear();
+  reverseQueue.clear();
+  neighbors.clear();
+  path.clear();
+  segments.clear();
+}
+
+void QueryContext::push(QueueEntry entry) {
+  heap.push_back(entry);
+  std::push_heap(heap.begin(), heap.end(), std::greater<QueueEntry>());
+}
+
+QueueEntry QueryContext::pop() {
+  std::pop_heap(heap.begin(), heap.end(), std::greater<QueueEntry>());
+  QueueEntry entry = heap.back();
+  heap.pop_back();
+  return entry;
+}
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "timetable.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bht {
+
+class Network;
+
+/**
+ * Reusable working memory for the routing queries of a Network.
+ *
+ * All arrays are dense over the stop indices of the network and are only
+ * allocated on first use. Instead of clearing them between queries every
+ * entry carries the epoch it was written in, so starting a new query is O(1).
+ * A context must only be used by one thread at a time; keep one per thread
+ * so repeated queries reuse its working memory instead of allocating it
+ * again. This covers the search workspace only, the plans the queries return
+ * are still fresh vectors.
+ */
+class QueryContext {
+  friend class Network;
+
+  private:
+    /// @brief Current query, entries with an older stamp are treated as unset
+    unsigned int epoch;
+
+    std::vector<StopLabel> labels;
+    std::vector<unsigned int> labelStamps;
+    std::vector<unsigned int> settledStamps;
+    std::vector<unsigned int> tripReached;
+    std::vector<unsigned int> tripStamps;
+
+    /// @brief Binary min-heap of the current search
+    std::vector<QueueEntry> heap;
+
+    /// @brief FIFO queue of the current breadth first search
+    std::vector<unsigned int> queue;
+
+    /// @brief FIFO queue of the backward half of a bidirectional search
+    std::vector<unsigned int> reverseQueue;
+
+    /// @brief Collected neighbor stops
+    std::vector<unsigned int> neighbors;
+
+    /// @brief Scratch space for journey reconstruction
+    std::vector<unsigned int> path;
+
+    /// @brief Distance in meters from each stop cluster to the target of an A* search
+    std::vector<float> targetDistances;
+
+    /// @brief Landmark travel times from and to the target of an ALT search
+    std::vector<uint16_t> targetLandmarks;
+
+    /// @brief Agencies allowed by the options of the current query, by dense agency index
+    std::vector<unsigned char> agencies;
+
+    /// @brief Agency ids and network data version the agencies table was compiled for,
+    /// repeated queries with the same agencies reuse it
+    std::vector<std::string> agencyIds;
+    uint64_t agencyVersion;
+
+    /// @brief Trip segments of the current trip-based search in breadth first order
+    std::vector<TripSegment> segments;
+
+    /// @brief Number of stops settled by the current search
+    unsigned int settledCount;
+
+    /**
+     * Start a new query over a network with the given number of stops,
+     * trip arrays are only allocated for searches that use them
+     */
+    void reset(size_t stopCount, size_t tripCount = 0);
+
+    /**
+     * Return the label of a stop, resetting it if it was written by an earlier query
+     */
+    StopLabel& label(unsigned int stop) {
+      if (labelStamps[stop] != epoch) {
+        labelStamps[stop] = epoch;
+        labels[stop] = StopLabel{INFINITE_TIME, INVALID_INDEX, INVALID_INDEX, 0, 0, INFINITE_TIME, INVALID_INDEX, 0};
+      }
+      return labels[stop];
+    }
+
+    /**
+     * Return the first position a trip is reached at by the current trip-based search,
+     * initialized to the given end position of the trip
+     */
+    unsigned int& reached(unsigned int trip, unsigned int end) {
+      if (tripStamps[trip] != epoch) {
+        tripStamps[trip] = epoch;
+        tripReached[trip] = end;
+      }
+      return tripReached[trip];
+    }
+
+    bool isSettled(unsigned int stop) const { return settledStamps[stop] == epoch; }
+    void settle(unsigned int stop) {
+      settledStamps[stop] = epoch;
+      settledCount++;
+    }
+
+    void push(QueueEntry entry);
+    QueueEntry pop();
+
+  public:
+    QueryContext();
+
+    /**
+     * @brief Return the context of the calling thread, used by the query
+     * methods of Network that are called without an explicit context
+     * @return Context owned by the calling thread
+     */
+    static QueryContext& local();
+
+    /**
+     * @brief Return the number of stops the last search on this context settled,
+     * e.g. to compare how much of the network different algorithms look at.
+     * The trip-based search counts the trip segments it scanned instead.
+     */
+    unsigned int getSettledCount() const { return settledCount; }
+};
+
+}
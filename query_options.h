@@ -0,0 +1,90 @@
+#pragma once
+#include "types.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bht {
+
+/**
+ * Search algorithm used by the travel plan queries
+ */
+typedef enum ERoutingAlgorithm {
+  RoutingAlgorithm_Dijkstra = 0,  // expand stops in order of their earliest boarding time
+  RoutingAlgorithm_AStar = 1,     // additionally prefer stops closer to the target
+  RoutingAlgorithm_ALT = 2,       // A* with landmark bounds, see Network::preprocessLandmarks
+  RoutingAlgorithm_TripBased = 3  // scan trips over precomputed transfers, see Network::preprocessTripTransfers
+} RoutingAlgorithm;
+
+/**
+ * Transport modes as bits of QueryOptions::modes. Extended GTFS route types
+ * (e.g. 700 for buses) map to the basic mode they belong to, types without
+ * a basic mode (air, taxi and unknown types) to TransportMode_Other.
+ */
+typedef enum ETransportMode {
+  TransportMode_Tram = 1 << 0,
+  TransportMode_Subway = 1 << 1,
+  TransportMode_Rail = 1 << 2,
+  TransportMode_Bus = 1 << 3,
+  TransportMode_Ferry = 1 << 4,
+  TransportMode_CableTram = 1 << 5,
+  TransportMode_AerialLift = 1 << 6,
+  TransportMode_Funicular = 1 << 7,
+  TransportMode_Trolleybus = 1 << 8,
+  TransportMode_Monorail = 1 << 9,
+  TransportMode_Other = 1 << 10,
+  TransportMode_All = (1 << 11) - 1
+} TransportMode;
+
+/**
+ * Return the transport mode of a basic or extended GTFS route type
+ */
+inline TransportMode getTransportMode(int routeType) {
+  switch (routeType) {
+  case RouteType_Tram: return TransportMode_Tram;
+  case RouteType_Subway: return TransportMode_Subway;
+  case RouteType_Rail: return TransportMode_Rail;
+  case RouteType_Bus: return TransportMode_Bus;
+  case RouteType_Ferry: return TransportMode_Ferry;
+  case RouteType_CableTram: return TransportMode_CableTram;
+  case RouteType_AerialLift: return TransportMode_AerialLift;
+  case RouteType_Funicular: return TransportMode_Funicular;
+  case RouteType_Trolleybus: return TransportMode_Trolleybus;
+  case RouteType_Monorail: return TransportMode_Monorail;
+  default: break;
+  }
+
+  // Extended route types come in blocks of 100 per mode
+  switch (routeType / 100) {
+  case 1: case 3: return TransportMode_Rail;         // railway, suburban railway
+  case 2: case 7: return TransportMode_Bus;          // coach, bus
+  case 4: case 5: case 6: return TransportMode_Subway; // urban railway, metro, underground
+  case 8: return TransportMode_Trolleybus;
+  case 9: return TransportMode_Tram;
+  case 10: case 12: return TransportMode_Ferry;      // water transport, ferry
+  case 13: return TransportMode_AerialLift;
+  case 14: return TransportMode_Funicular;
+  default: return TransportMode_Other;               // air, taxi, self drive, miscellaneous and unknown types
+  }
+}
+
+/**
+ * Options of a travel plan query. All algorithms return an earliest arrival
+ * plan, they only differ in how much of the network they look at. The
+ * filters restrict the trips that may be ridden; they are compiled to a bit
+ * mask once per query, see Network::getTravelPlanDepartingAt.
+ */
+typedef struct SQueryOptions {
+  RoutingAlgorithm algorithm = RoutingAlgorithm_Dijkstra;
+  uint32_t modes = TransportMode_All;  // allowed transport modes, see TransportMode
+  std::vector<std::string> agencyIds;  // only ride trips of these agencies, all agencies if empty
+  bool wheelchairAccessible = false;   // only ride trips and use stops known to be wheelchair accessible
+  bool bikesAllowed = false;           // only ride trips that allow bikes
+} QueryOptions;
+
+inline bool operator==(const QueryOptions& a, const QueryOptions& b) {
+  return a.algorithm == b.algorithm && a.modes == b.modes && a.agencyIds == b.agencyIds &&
+         a.wheelchairAccessible == b.wheelchairAccessible && a.bikesAllowed == b.bikesAllowed;
+}
+
+}
@@ -0,0 +1,80 @@
+#include "reachability.h"
+#include <algorithm>
+#include <numeric>
+
+namespace bht {
+
+void Reachability::build(const std::vector<unsigned int>& offsets, const std::vector<unsigned int>& targets) {
+    const unsigned int nodeCount = offsets.empty() ? 0 : (unsigned int)offsets.size() - 1;
+    const unsigned int unvisited = static_cast<unsigned int>(-1);
+
+    // Tarjan's algorithm with an explicit stack, large feeds would overflow the call stack
+    components.assign(nodeCount, unvisited);
+    std::vector<unsigned int> order(nodeCount, unvisited); // discovery order
+    std::vector<unsigned int> low(nodeCount, 0);
+    std::vector<unsigned int> stack; // nodes of components not finished yet
+    std::vector<std::pair<unsigned int, unsigned int>> calls; // node and next edge to look at
+    unsigned int discovered = 0;
+    componentCount = 0;
+    for (unsigned int root = 0; root < nodeCount; ++root) {
+        if (order[root] != unvisited) {
+            continue;
+        }
+        calls.push_back({root, offsets[root]});
+        order[root] = low[root] = discovered++;
+        stack.push_back(root);
+        while (!calls.empty()) {
+            const unsigned int node = calls.back().first;
+            unsigned int& edge = calls.back().second;
+            if (edge < offsets[node + 1]) {
+                const unsigned int next = targets[edge++];
+                if (order[next] == unvisited) {
+                    order[next] = low[next] = discovered++;
+                    stack.push_back(next);
+                    calls.push_back({next, offsets[next]});
+                } else if (components[next] == unvisited) {
+                    low[node] = std::min(low[node], order[next]);
+                }
+                continue;
+            }
+
+            // All edges done: either node roots a component or passes its low link up
+            calls.pop_back();
+            if (low[node] == order[node]) {
+                unsigned int member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    components[member] = (unsigned int)componentCount;
+                } while (member != node);
+                componentCount++;
+            }
+            if (!calls.empty()) {
+                low[calls.back().first] = std::min(low[calls.back().first], low[node]);
+            }
+        }
+    }
+
+    // Weakly connected regions by union-find over all edges
+    regions.resize(nodeCount);
+    std::iota(regions.begin(), regions.end(), 0u);
+    auto find = [this](unsigned int node) {
+        while (regions[node] != node) {
+            node = regions[node] = regions[regions[node]];
+        }
+        return node;
+    };
+    for (unsigned int node = 0; node < nodeCount; ++node) {
+        for (unsigned int e = offsets[node]; e < offsets[node + 1]; ++e) {
+            const unsigned int a = find(node), b = find(targets[e]);
+            if (a != b) {
+                regions[std::max(a, b)] = std::min(a, b);
+            }
+        }
+    }
+    for (unsigned int node = 0; node < nodeCount; ++node) {
+        regions[node] = find(node);
+    }
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+namespace bht {
+
+/**
+ * Precomputed reachability information of a directed graph, used to reject
+ * queries between stops that cannot be connected without searching.
+ *
+ * Nodes are numbered by strongly connected component in the order Tarjan's
+ * algorithm finishes them, so every edge between two components leads from
+ * a higher to a lower number. Together with the weakly connected regions
+ * this gives a constant time test that never rejects a reachable pair.
+ * It is exact for symmetric graphs, where components and regions coincide.
+ */
+class Reachability {
+  private:
+    std::vector<unsigned int> components; // node -> strongly connected component
+    std::vector<unsigned int> regions; // node -> weakly connected region
+    size_t componentCount = 0;
+
+  public:
+    /**
+     * @brief Compute the components of a graph given as adjacency lists in CSR form
+     * @param offsets Node -> first entry in targets, plus the end
+     * @param targets Edge targets grouped by source node
+     */
+    void build(const std::vector<unsigned int>& offsets, const std::vector<unsigned int>& targets);
+
+    /**
+     * @brief Check if a path from one node to another may exist
+     * @return false only if the graph has no path between them
+     */
+    bool mayReach(unsigned int from, unsigned int to) const {
+        return regions[from] == regions[to] && components[from] >= components[to];
+    }
+
+    /**
+     * @brief Check if two nodes are in the same strongly connected component
+     */
+    bool isStronglyConnected(unsigned int a, unsigned int b) const {
+        return components[a] == components[b];
+    }
+
+    /**
+     * @brief Return the number of strongly connected components
+     */
+    size_t getComponentCount() const { return componentCount; }
+};
+
+}
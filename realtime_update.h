@@ -0,0 +1,23 @@
+#pragma once
+#include "timetable.h"
+#include <string>
+
+namespace bht {
+
+/**
+ * Real-time change of one trip, like a stop time update of a GTFS-RT trip
+ * update, see Network::applyRealtimeUpdates. A delay holds from the stop it
+ * is given for until the next update of the same trip; stops before the
+ * first update keep their timetable times. Updates without a stop apply
+ * from the first stop of the trip.
+ */
+typedef struct STripUpdate {
+  std::string tripId;
+  unsigned int stopSequence;  // stop sequence the delays start at, INVALID_INDEX to use stopId
+  std::string stopId;         // stop the delays start at, the whole trip if empty as well
+  int arrivalDelay;           // seconds, may be negative for early vehicles
+  int departureDelay;         // seconds, may be negative for early vehicles
+  bool canceled;              // the trip does not run at all
+} TripUpdate;
+
+}
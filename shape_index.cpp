@@ -0,0 +1,287 @@
+#include "shape_index.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace bht {
+
+namespace {
+
+// Append a zigzag encoded variable length delta, small deltas of either sign take few bytes
+void writeDelta(std::vector<uint8_t>& bytes, int32_t delta) {
+    uint32_t value = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+    while (value >= 0x80) {
+        bytes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((uint8_t)value);
+}
+
+// Distance in meters of a point from the segment between two others, in a plane around the point
+double segmentDistance(const Coordinate& point, const Coordinate& from, const Coordinate& to) {
+    const double toRadians = M_PI / 180.0;
+    const double scale = std::cos(point.latitude * toRadians);
+    const double ax = (from.longitude - point.longitude) * scale, ay = from.latitude - point.latitude;
+    const double bx = (to.longitude - point.longitude) * scale, by = to.latitude - point.latitude;
+    const double dx = bx - ax, dy = by - ay;
+    const double length = dx * dx + dy * dy;
+    const double t = length > 0 ? std::max(0.0, std::min(1.0, -(ax * dx + ay * dy) / length)) : 0.0;
+    const double x = ax + t * dx, y = ay + t * dy;
+    return EARTH_RADIUS * toRadians * std::sqrt(x * x + y * y);
+}
+
+}
+
+void ShapeIndex::build(const std::vector<Shape>& points) {
+    shapeIds.clear();
+    pointOffsets.clear();
+    byteOffsets.clear();
+    encoded.clear();
+
+    // Intern the ids, then number the shapes in id order
+    std::unordered_map<std::string, unsigned int> interned;
+    std::vector<unsigned int> pointShapes(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        auto inserted = interned.emplace(points[i].id, (unsigned int)shapeIds.size());
+        if (inserted.second) {
+            shapeIds.push_back(points[i].id);
+        }
+        pointShapes[i] = inserted.first->second;
+    }
+    std::vector<unsigned int> order(shapeIds.size());
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return shapeIds[a] < shapeIds[b]; });
+    std::vector<unsigned int> rank(order.size());
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        rank[order[i]] = i;
+    }
+    std::vector<std::string> sortedIds(order.size());
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        sortedIds[i] = std::move(shapeIds[order[i]]);
+    }
+    shapeIds.swap(sortedIds);
+
+    // Counting sort of the points by shape, then by sequence within each shape
+    pointOffsets.assign(shapeIds.size() + 1, 0);
+    for (unsigned int& shape : pointShapes) {
+        shape = rank[shape];
+        pointOffsets[shape + 1]++;
+    }
+    for (size_t shape = 0; shape < shapeIds.size(); ++shape) {
+        pointOffsets[shape + 1] += pointOffsets[shape];
+    }
+    std::vector<unsigned int> sorted(points.size());
+    std::vector<unsigned int> fill(pointOffsets.begin(), pointOffsets.end() - 1);
+    for (unsigned int i = 0; i < points.size(); ++i) {
+        sorted[fill[pointShapes[i]]++] = i;
+    }
+
+    byteOffsets.assign(shapeIds.size() + 1, 0);
+    encoded.reserve(points.size() * 5);
+    for (size_t shape = 0; shape < shapeIds.size(); ++shape) {
+        auto begin = sorted.begin() + pointOffsets[shape], end = sorted.begin() + pointOffsets[shape + 1];
+        std::stable_sort(begin, end, [&](unsigned int a, unsigned int b) { return points[a].sequence < points[b].sequence; });
+
+        // The first point is a delta to 0, so every shape decodes on its own
+        byteOffsets[shape] = (unsigned int)encoded.size();
+        int32_t latitude = 0, longitude = 0;
+        for (auto it = begin; it != end; ++it) {
+            const int32_t nextLatitude = toMicrodegrees(points[*it].latitide);
+            const int32_t nextLongitude = toMicrodegrees(points[*it].longitude);
+            writeDelta(encoded, nextLatitude - latitude);
+            writeDelta(encoded, nextLongitude - longitude);
+            latitude = nextLatitude;
+            longitude = nextLongitude;
+        }
+    }
+    byteOffsets[shapeIds.size()] = (unsigned int)encoded.size();
+    encoded.shrink_to_fit();
+}
+
+unsigned int ShapeIndex::getShapeIndex(const std::string& shapeId) const {
+    auto it = std::lower_bound(shapeIds.begin(), shapeIds.end(), shapeId);
+    if (it == shapeIds.end() || *it != shapeId) {
+        return INVALID_INDEX;
+    }
+    return (unsigned int)(it - shapeIds.begin());
+}
+
+void ShapeIndex::projectStops(unsigned int shape, const int32_t* latitudes, const int32_t* longitudes, size_t count, ShapeStop* result) const {
+    // Decode the shape once, with where each point starts in the encoding and its distance along the shape
+    const ShapeView view = getShape(shape);
+    std::vector<int32_t> pointLatitudes, pointLongitudes;
+    std::vector<uint32_t> pointBytes;
+    std::vector<double> pointDistances;
+    pointLatitudes.reserve(view.size());
+    pointLongitudes.reserve(view.size());
+    pointBytes.reserve(view.size() + 1);
+    pointDistances.reserve(view.size());
+    pointBytes.push_back(byteOffsets[shape]);
+    for (auto it = view.begin(); it != view.end(); ++it) {
+        const int32_t latitude = it.latitudeMicrodegrees(), longitude = it.longitudeMicrodegrees();
+        pointDistances.push_back(pointLatitudes.empty() ? 0.0 :
+            SpatialIndex::distance(fromMicrodegrees(pointLatitudes.back()), fromMicrodegrees(pointLongitudes.back()),
+                                   fromMicrodegrees(latitude), fromMicrodegrees(longitude)) + pointDistances.back());
+        pointLatitudes.push_back(latitude);
+        pointLongitudes.push_back(longitude);
+    }
+    // Point starts follow from the encoded lengths, every point is two deltas
+    const uint8_t* bytes = encoded.data() + byteOffsets[shape];
+    for (unsigned int i = 1; i <= view.size(); ++i) {
+        for (int delta = 0; delta < 2; ++delta) {
+            while (*bytes++ & 0x80) {
+            }
+        }
+        pointBytes.push_back((uint32_t)(bytes - encoded.data()));
+    }
+
+    auto project = [&](unsigned int segment, double t) {
+        const unsigned int last = std::min(segment + 1, view.size() - 1);
+        ShapeStop stop;
+        stop.latitude = pointLatitudes[segment] + (int32_t)std::lround(t * (pointLatitudes[last] - pointLatitudes[segment]));
+        stop.longitude = pointLongitudes[segment] + (int32_t)std::lround(t * (pointLongitudes[last] - pointLongitudes[segment]));
+        stop.distance = (float)(pointDistances[segment] + t * (pointDistances[last] - pointDistances[segment]));
+        stop.point = segment + 1;
+        stop.byte = pointBytes[segment + 1];
+        stop.pointLatitude = pointLatitudes[segment];
+        stop.pointLongitude = pointLongitudes[segment];
+        return stop;
+    };
+
+    // Closest position of a stop on a segment not before the given one, in a plane around the
+    // shape. The segments are measured once, every stop is compared with every segment.
+    const unsigned int segments = std::max(1u, view.size() - 1);
+    const double scale = std::cos(fromMicrodegrees(pointLatitudes[pointLatitudes.size() / 2]) * M_PI / 180.0);
+    std::vector<double> segmentX(segments), segmentY(segments), segmentLengths(segments);
+    for (unsigned int j = 0; j < segments; ++j) {
+        const unsigned int next = std::min(j + 1, view.size() - 1);
+        segmentX[j] = (pointLongitudes[next] - pointLongitudes[j]) * scale;
+        segmentY[j] = pointLatitudes[next] - pointLatitudes[j];
+        segmentLengths[j] = segmentX[j] * segmentX[j] + segmentY[j] * segmentY[j];
+    }
+    auto closest = [&](size_t k, unsigned int j, double minimum, double& t) {
+        const double ax = (pointLongitudes[j] - longitudes[k]) * scale, ay = pointLatitudes[j] - latitudes[k];
+        const double dx = segmentX[j], dy = segmentY[j];
+        t = std::max(minimum, segmentLengths[j] > 0 ? std::max(0.0, std::min(1.0, -(ax * dx + ay * dy) / segmentLengths[j])) : 0.0);
+        const double x = ax + t * dx, y = ay + t * dy;
+        return std::sqrt(x * x + y * y);
+    };
+
+    // Pick the positions with the least total distance among those following the order
+    // of the stops. Taking the closest position stop by stop would pull the first stop of
+    // a loop to its end, leaving no room for the stops after it. For each segment, costs
+    // hold the best total of the stops so far with the last one on that segment.
+    std::vector<size_t> located;
+    for (size_t k = 0; k < count; ++k) {
+        if (latitudes[k] != MISSING_COORDINATE && longitudes[k] != MISSING_COORDINATE) {
+            located.push_back(k);
+        }
+    }
+    std::vector<double> costs(segments, 0.0), positions(segments, 0.0), previousCosts(segments), previousPositions(segments);
+    std::vector<unsigned int> choices(located.size() * segments); // segment of the stop before on the best path
+    for (size_t i = 0; i < located.size(); ++i) {
+        previousCosts.swap(costs);
+        previousPositions.swap(positions);
+        unsigned int earlier = INVALID_INDEX; // cheapest segment before j of the stop before
+        for (unsigned int j = 0; j < segments; ++j) {
+            double t;
+            const double distance = closest(located[i], j, 0.0, t);
+            costs[j] = distance;
+            positions[j] = t;
+            choices[i * segments + j] = j;
+            if (i > 0) {
+                costs[j] = earlier == INVALID_INDEX ? INFINITY : previousCosts[earlier] + distance;
+                choices[i * segments + j] = earlier;
+
+                // Sharing the segment with the stop before, not before it
+                const double shared = previousCosts[j] + (t < previousPositions[j] ? closest(located[i], j, previousPositions[j], t) : distance);
+                if (shared < costs[j]) {
+                    costs[j] = shared;
+                    positions[j] = t;
+                    choices[i * segments + j] = j;
+                }
+                if (earlier == INVALID_INDEX || previousCosts[j] < previousCosts[earlier]) {
+                    earlier = j;
+                }
+            }
+        }
+    }
+    std::vector<unsigned int> chosen(located.size());
+    if (!located.empty()) {
+        chosen.back() = (unsigned int)(std::min_element(costs.begin(), costs.end()) - costs.begin());
+        for (size_t i = located.size() - 1; i > 0; --i) {
+            chosen[i - 1] = choices[i * segments + chosen[i]];
+        }
+    }
+
+    // Stops without a position take the position of the stop before
+    unsigned int segment = 0;
+    double minimum = 0;
+    for (size_t k = 0, i = 0; k < count; ++k) {
+        if (i < located.size() && located[i] == k) {
+            double t;
+            closest(k, chosen[i], i > 0 && chosen[i] == segment ? minimum : 0.0, t);
+            segment = chosen[i++];
+            minimum = t;
+        }
+        result[k] = project(segment, minimum);
+    }
+}
+
+std::vector<Coordinate> ShapeIndex::getPolyline(unsigned int shape, double tolerance) const {
+    if (shape >= shapeIds.size()) {
+        return {};
+    }
+    const ShapeView view = getShape(shape);
+    std::vector<Coordinate> points;
+    points.reserve(view.size());
+    for (const Coordinate& point : view) {
+        points.push_back(point);
+    }
+    return tolerance > 0 ? simplifyPolyline(points, tolerance) : points;
+}
+
+std::vector<Coordinate> ShapeIndex::getPolyline(const std::string& shapeId, double tolerance) const {
+    return getPolyline(getShapeIndex(shapeId), tolerance);
+}
+
+std::vector<Coordinate> simplifyPolyline(const std::vector<Coordinate>& points, double tolerance) {
+    if (points.size() <= 2) {
+        return points;
+    }
+
+    // Split ranges at their farthest point until every dropped point is within the tolerance.
+    // An explicit stack keeps long shapes from exhausting the call stack.
+    std::vector<bool> keep(points.size(), false);
+    keep.front() = keep.back() = true;
+    std::vector<std::pair<size_t, size_t>> ranges = {{0, points.size() - 1}};
+    while (!ranges.empty()) {
+        const size_t first = ranges.back().first, last = ranges.back().second;
+        ranges.pop_back();
+        double farthest = 0;
+        size_t split = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            const double distance = segmentDistance(points[i], points[first], points[last]);
+            if (distance > farthest) {
+                farthest = distance;
+                split = i;
+            }
+        }
+        if (farthest > tolerance) {
+            keep[split] = true;
+            ranges.push_back({first, split});
+            ranges.push_back({split, last});
+        }
+    }
+
+    std::vector<Coordinate> simplified;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (keep[i]) {
+            simplified.push_back(points[i]);
+        }
+    }
+    return simplified;
+}
+
+}
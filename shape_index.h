@@ -0,0 +1,223 @@
+#pragma once
+#include "spatial_index.h"
+#include "timetable.h"
+#include "types.h"
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace bht {
+
+/**
+ * Points of one shape decoded while iterating, see ShapeIndex::getShape().
+ * The view points into the index and stays valid as long as the index is
+ * not rebuilt.
+ */
+class ShapeView {
+  private:
+    const uint8_t* bytes = nullptr; // encoded points of the shape
+    unsigned int count = 0; // number of points
+    int32_t latitude = 0; // microdegrees the first delta is added to
+    int32_t longitude = 0;
+
+  public:
+    class iterator {
+      private:
+        const uint8_t* next = nullptr; // encoding of the point after the current one
+        unsigned int remaining = 0; // points left including the current one
+        int32_t latitude = 0; // current latitude in microdegrees
+        int32_t longitude = 0; // current longitude in microdegrees
+
+        // Read one zigzag encoded variable length delta
+        int32_t readDelta() {
+            uint32_t value = 0;
+            for (int shift = 0;; shift += 7) {
+                const uint8_t byte = *next++;
+                value |= (uint32_t)(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    break;
+                }
+            }
+            return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        }
+
+        void decode() {
+            latitude += readDelta();
+            longitude += readDelta();
+        }
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Coordinate;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Coordinate*;
+        using reference = Coordinate;
+
+        iterator() = default;
+        iterator(const uint8_t* bytes, unsigned int count, int32_t latitude, int32_t longitude)
+            : next(bytes), remaining(count), latitude(latitude), longitude(longitude) {
+            if (remaining > 0) {
+                decode();
+            }
+        }
+
+        Coordinate operator*() const { return {fromMicrodegrees(latitude), fromMicrodegrees(longitude)}; }
+        int32_t latitudeMicrodegrees() const { return latitude; }
+        int32_t longitudeMicrodegrees() const { return longitude; }
+
+        iterator& operator++() {
+            if (--remaining > 0) {
+                decode();
+            }
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const iterator& other) const { return remaining == other.remaining; }
+        bool operator!=(const iterator& other) const { return remaining != other.remaining; }
+    };
+
+    ShapeView() = default;
+    ShapeView(const uint8_t* bytes, unsigned int count, int32_t latitude = 0, int32_t longitude = 0)
+        : bytes(bytes), count(count), latitude(latitude), longitude(longitude) {
+    }
+
+    iterator begin() const { return iterator(bytes, count, latitude, longitude); }
+    iterator end() const { return iterator(); }
+    unsigned int size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
+/**
+ * Position of a stop projected onto a shape, see ShapeIndex::projectStops().
+ * Besides the distance it keeps where decoding has to start for the shape
+ * points following the projection, so legs between stops are sliced out of
+ * the encoded shape without decoding it from the beginning.
+ */
+typedef struct SShapeStop {
+  float distance;          // meters along the shape from its first point
+  unsigned int point;      // index of the first shape point after the projection
+  uint32_t byte;           // offset of that point in the encoded points
+  int32_t latitude;        // projected position in microdegrees
+  int32_t longitude;
+  int32_t pointLatitude;   // shape point before the projection in microdegrees, the base of the next delta
+  int32_t pointLongitude;
+} ShapeStop;
+
+/**
+ * Geometry and length of the ride between two stops of a trip, see Network::getTripLeg()
+ */
+typedef struct STripLeg {
+  Coordinate from;    // boarding stop projected onto the shape
+  ShapeView points;   // shape points between the two projections
+  Coordinate to;      // alighting stop projected onto the shape
+  double meters;      // distance along the shape
+} TripLeg;
+
+/**
+ * Compact storage of the shapes of a feed.
+ *
+ * Shape ids are interned once; points are grouped by shape in contiguous
+ * ranges sorted by their sequence number. Coordinates are stored as
+ * fixed point microdegrees, each one as the zigzag variable length delta to
+ * the previous point of the shape, which takes 2 to 4 bytes per point for
+ * the usual point distances instead of a Shape with its own id string.
+ */
+class ShapeIndex {
+  private:
+    std::vector<std::string> shapeIds; // sorted shape ids, the position is the dense shape index
+    std::vector<unsigned int> pointOffsets; // shape -> number of points before it, plus the end
+    std::vector<unsigned int> byteOffsets; // shape -> first byte of its points in encoded, plus the end
+    std::vector<uint8_t> encoded; // delta encoded points grouped by shape
+
+  public:
+    /**
+     * @brief Index the given points, replacing the current content
+     * @param points Shape points in any order
+     */
+    void build(const std::vector<Shape>& points);
+
+    /**
+     * @brief Return the dense index of a shape
+     * @return Index of the shape, INVALID_INDEX if it is unknown
+     */
+    unsigned int getShapeIndex(const std::string& shapeId) const;
+
+    /**
+     * @brief Return the id of a shape by its dense index
+     */
+    const std::string& getShapeId(unsigned int shape) const { return shapeIds[shape]; }
+
+    /**
+     * @brief Return the points of a shape in sequence order without copying them
+     */
+    ShapeView getShape(unsigned int shape) const {
+        return ShapeView(encoded.data() + byteOffsets[shape], pointOffsets[shape + 1] - pointOffsets[shape]);
+    }
+
+    /**
+     * @brief Return the shape points between two projections of projectStops() without copying them
+     */
+    ShapeView getPoints(const ShapeStop& from, const ShapeStop& to) const {
+        return ShapeView(encoded.data() + from.byte, to.point > from.point ? to.point - from.point : 0,
+                         from.pointLatitude, from.pointLongitude);
+    }
+
+    /**
+     * @brief Project the stops of a trip onto its shape. The stops go to the positions
+     * with the least total distance that follow the order of the stops, so stops
+     * visited twice by loops keep their order.
+     * @param shape Dense shape index, must have at least one point
+     * @param latitudes Stop latitudes in microdegrees in the order the trip calls at them,
+     * stops with MISSING_COORDINATE keep the position of the stop before
+     * @param longitudes Stop longitudes in microdegrees
+     * @param count Number of stops
+     * @param result Receives count projections
+     */
+    void projectStops(unsigned int shape, const int32_t* latitudes, const int32_t* longitudes, size_t count, ShapeStop* result) const;
+
+    /**
+     * @brief Decode the points of a shape into a polyline
+     * @param shape Dense shape index
+     * @param tolerance Maximum distance in meters a dropped point may have from the
+     * simplified line, 0 keeps all points
+     * @return Points in sequence order, empty for unknown shapes
+     */
+    std::vector<Coordinate> getPolyline(unsigned int shape, double tolerance = 0) const;
+
+    /**
+     * @brief Decode a shape by its id, see above
+     */
+    std::vector<Coordinate> getPolyline(const std::string& shapeId, double tolerance = 0) const;
+
+    /**
+     * @brief Return the number of shapes
+     */
+    size_t size() const { return shapeIds.size(); }
+
+    /**
+     * @brief Return the number of points of all shapes
+     */
+    size_t pointCount() const { return pointOffsets.empty() ? 0 : pointOffsets.back(); }
+
+    /**
+     * @brief Check if the index holds no shapes
+     */
+    bool empty() const { return shapeIds.empty(); }
+};
+
+/**
+ * @brief Simplify a polyline with the Douglas-Peucker algorithm
+ * @param points Polyline to simplify
+ * @param tolerance Maximum distance in meters a dropped point may have from the simplified line
+ * @return Subset of the points including the first and the last one
+ */
+std::vector<Coordinate> simplifyPolyline(const std::vector<Coordinate>& points, double tolerance);
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+
+namespace bht {
+
+/**
+ * Non-owning view of contiguous elements, a minimal stand-in for the C++20
+ * std::span. Spans returned by Network point into its index tables and stay
+ * valid until the network is reloaded or destroyed.
+ */
+template <typename T>
+class Span {
+  private:
+    T* first = nullptr; // first element
+    size_t count = 0; // number of elements
+
+  public:
+    using element_type = T;
+    using iterator = T*;
+
+    constexpr Span() = default;
+    constexpr Span(T* first, size_t count)
+        : first(first), count(count) {
+    }
+
+    constexpr T* begin() const { return first; }
+    constexpr T* end() const { return first + count; }
+    constexpr T* data() const { return first; }
+    constexpr size_t size() const { return count; }
+    constexpr bool empty() const { return count == 0; }
+    constexpr T& operator[](size_t i) const { return first[i]; }
+    constexpr T& front() const { return first[0]; }
+    constexpr T& back() const { return first[count - 1]; }
+};
+
+}
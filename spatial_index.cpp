@@ -0,0 +1,141 @@
+#include "spatial_index.h"
+
+namespace bht {
+
+int SpatialIndex::row(double latitude) const {
+    return (int)std::floor((latitude - minLatitude) / cellLatitude);
+}
+
+int SpatialIndex::column(double longitude) const {
+    return (int)std::floor((longitude - minLongitude) / cellLongitude);
+}
+
+void SpatialIndex::build(const std::vector<int32_t>& pointLatitudes, const std::vector<int32_t>& pointLongitudes, double cellSize) {
+    cellOffsets.clear();
+    pointIds.clear();
+    latitudes.clear();
+    longitudes.clear();
+    rows = columns = 0;
+
+    // Bounding box of all points with coordinates
+    std::vector<unsigned int> ids;
+    double maxLatitude = -90, maxLongitude = -180;
+    minLatitude = 90;
+    minLongitude = 180;
+    for (unsigned int i = 0; i < pointLatitudes.size(); ++i) {
+        if (pointLatitudes[i] != MISSING_COORDINATE && pointLongitudes[i] != MISSING_COORDINATE) {
+            ids.push_back(i);
+            minLatitude = std::min(minLatitude, fromMicrodegrees(pointLatitudes[i]));
+            maxLatitude = std::max(maxLatitude, fromMicrodegrees(pointLatitudes[i]));
+            minLongitude = std::min(minLongitude, fromMicrodegrees(pointLongitudes[i]));
+            maxLongitude = std::max(maxLongitude, fromMicrodegrees(pointLongitudes[i]));
+        }
+    }
+    if (ids.empty()) {
+        return;
+    }
+
+    // Cells are at least cellSize wide at the latitude farthest from the equator.
+    // Grow them for sparse, wide spread feeds to keep the grid at a few cells per point.
+    const double widest = std::min(89.0, std::max(std::fabs(minLatitude), std::fabs(maxLatitude)));
+    cellLatitude = std::max(cellSize, 1.0) / EARTH_RADIUS * 180.0 / M_PI;
+    cellLongitude = cellLatitude / std::cos(widest * M_PI / 180.0);
+    const double maxCells = 4.0 * ids.size() + 1024;
+    for (;;) {
+        rows = row(maxLatitude) + 1;
+        columns = column(maxLongitude) + 1;
+        if ((double)rows * columns <= maxCells) {
+            break;
+        }
+        cellLatitude *= 2;
+        cellLongitude *= 2;
+    }
+
+    // Counting sort of the points by cell
+    std::vector<unsigned int> cells(ids.size());
+    cellOffsets.assign((size_t)rows * columns + 1, 0);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        cells[i] = row(fromMicrodegrees(pointLatitudes[ids[i]])) * columns + column(fromMicrodegrees(pointLongitudes[ids[i]]));
+        cellOffsets[cells[i] + 1]++;
+    }
+    for (size_t c = 0; c + 1 < cellOffsets.size(); ++c) {
+        cellOffsets[c + 1] += cellOffsets[c];
+    }
+    std::vector<unsigned int> position(cellOffsets.begin(), cellOffsets.end() - 1);
+    pointIds.resize(ids.size());
+    latitudes.resize(ids.size());
+    longitudes.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        const unsigned int target = position[cells[i]]++;
+        pointIds[target] = ids[i];
+        latitudes[target] = pointLatitudes[ids[i]];
+        longitudes[target] = pointLongitudes[ids[i]];
+    }
+}
+
+void SpatialIndex::within(double latitude, double longitude, double meters, std::vector<StopDistance>& result) const {
+    result.clear();
+    forEachWithin(latitude, longitude, meters, [&result](unsigned int id, double d) {
+        result.push_back({id, d});
+    });
+    std::sort(result.begin(), result.end(), [](const StopDistance& a, const StopDistance& b) {
+        return a.meters < b.meters;
+    });
+}
+
+void SpatialIndex::nearest(double latitude, double longitude, size_t k, std::vector<StopDistance>& result) const {
+    result.clear();
+    if (k == 0 || pointIds.empty() || !std::isfinite(latitude) || !std::isfinite(longitude)) {
+        return;
+    }
+
+    // result is kept as a max-heap of the k closest points found so far
+    auto closer = [](const StopDistance& a, const StopDistance& b) { return a.meters < b.meters; };
+    auto consider = [&](unsigned int i, float d) {
+        if (result.size() < k) {
+            result.push_back({pointIds[i], d});
+            std::push_heap(result.begin(), result.end(), closer);
+        } else if (d < result.front().meters) {
+            std::pop_heap(result.begin(), result.end(), closer);
+            result.back() = {pointIds[i], d};
+            std::push_heap(result.begin(), result.end(), closer);
+        }
+    };
+
+    // Every point outside ring r around the center cell is at least r cells away.
+    // Cells are narrowest at the latitude farthest from the equator.
+    const double toRadians = M_PI / 180.0;
+    const double widest = std::min(89.0, std::max({std::fabs(latitude), std::fabs(minLatitude), std::fabs(minLatitude + rows * cellLatitude)}));
+    const double cellMeters = EARTH_RADIUS * toRadians * std::min(cellLatitude, cellLongitude * std::cos(widest * toRadians));
+
+    const int32_t queryLatitude = toMicrodegrees(latitude);
+    const int32_t queryLongitude = toMicrodegrees(longitude);
+    const int centerRow = row(latitude);
+    const int centerColumn = column(longitude);
+    const int firstRing = std::max({0, -centerRow, centerRow - (rows - 1), -centerColumn, centerColumn - (columns - 1)});
+    const int lastRing = std::max({centerRow, rows - 1 - centerRow, centerColumn, columns - 1 - centerColumn});
+    for (int ring = firstRing; ring <= lastRing; ++ring) {
+        // Top and bottom row of the ring, then the left and right column between them.
+        // Sides outside of the grid are skipped, clamping them would visit cells twice.
+        const int top = centerRow - ring, bottom = centerRow + ring;
+        const int left = centerColumn - ring, right = centerColumn + ring;
+        if (top >= 0) {
+            forEachInCells(queryLatitude, queryLongitude, top, top, left, right, consider);
+        }
+        if (ring > 0 && bottom < rows) {
+            forEachInCells(queryLatitude, queryLongitude, bottom, bottom, left, right, consider);
+        }
+        if (ring > 0 && left >= 0) {
+            forEachInCells(queryLatitude, queryLongitude, top + 1, bottom - 1, left, left, consider);
+        }
+        if (ring > 0 && right < columns) {
+            forEachInCells(queryLatitude, queryLongitude, top + 1, bottom - 1, right, right, consider);
+        }
+        if (result.size() == k && result.front().meters <= ring * cellMeters) {
+            break;
+        }
+    }
+    std::sort_heap(result.begin(), result.end(), closer);
+}
+
+}
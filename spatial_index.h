@@ -0,0 +1,143 @@
+#pragma once
+#include "distance_kernel.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+namespace bht {
+
+/**
+ * Geographic position in degrees
+ */
+typedef struct SCoordinate {
+  double latitude;
+  double longitude;
+} Coordinate;
+
+/**
+ * Result entry of a proximity query
+ */
+typedef struct SStopDistance {
+  unsigned int stop;  // dense stop index
+  double meters;      // distance from the query position
+} StopDistance;
+
+/**
+ * Uniform grid over point coordinates for proximity queries.
+ *
+ * Points are bucketed into cells at least as large as the cell size given
+ * to build() and stored grouped by cell, so a radius query only looks at
+ * the cells overlapping the circle instead of scanning all points.
+ * Coordinates are kept as fixed point microdegrees in separate arrays, so
+ * each cell row is handed to computeDistances() as one contiguous block.
+ */
+class SpatialIndex {
+  private:
+    double minLatitude = 0;
+    double minLongitude = 0;
+    double cellLatitude = 1; // cell height in degrees
+    double cellLongitude = 1; // cell width in degrees
+    int rows = 0;
+    int columns = 0;
+    std::vector<unsigned int> cellOffsets; // cell -> first entry in the point arrays
+    std::vector<unsigned int> pointIds; // point ids grouped by cell
+    std::vector<int32_t> latitudes; // point latitudes in microdegrees grouped by cell
+    std::vector<int32_t> longitudes; // point longitudes in microdegrees grouped by cell
+
+    /// @brief Number of distances computed per call of the distance kernel
+    static constexpr unsigned int DISTANCE_BLOCK = 64;
+
+    int row(double latitude) const;
+    int column(double longitude) const;
+
+    /**
+     * Call visit(i, meters) for every point array entry in the given cell rectangle, clamped to the grid
+     */
+    template <typename Visitor>
+    void forEachInCells(int32_t latitude, int32_t longitude, int firstRow, int lastRow, int firstColumn, int lastColumn, Visitor visit) const {
+        firstRow = std::max(0, firstRow);
+        lastRow = std::min(rows - 1, lastRow);
+        firstColumn = std::max(0, firstColumn);
+        lastColumn = std::min(columns - 1, lastColumn);
+        if (firstColumn > lastColumn) {
+            return;
+        }
+        float meters[DISTANCE_BLOCK];
+        for (int r = firstRow; r <= lastRow; ++r) {
+            // Cells of one row are contiguous in the point arrays
+            const unsigned int end = cellOffsets[r * columns + lastColumn + 1];
+            for (unsigned int begin = cellOffsets[r * columns + firstColumn]; begin < end; begin += DISTANCE_BLOCK) {
+                const unsigned int count = std::min(DISTANCE_BLOCK, end - begin);
+                computeDistances(latitude, longitude, latitudes.data() + begin, longitudes.data() + begin, count, meters);
+                for (unsigned int i = 0; i < count; ++i) {
+                    visit(begin + i, meters[i]);
+                }
+            }
+        }
+    }
+
+  public:
+    /**
+     * @brief Index the given points, point ids are their positions in the vectors
+     * @param pointLatitudes Latitudes in microdegrees, points with MISSING_COORDINATE are skipped
+     * @param pointLongitudes Longitudes in microdegrees
+     * @param cellSize Minimum cell size in meters, usually the most common query radius
+     */
+    void build(const std::vector<int32_t>& pointLatitudes, const std::vector<int32_t>& pointLongitudes, double cellSize);
+
+    /**
+     * @brief Call visit(id, meters) for every point within the given distance
+     * @param latitude Latitude of the center in degrees
+     * @param longitude Longitude of the center in degrees
+     * @param meters Search radius
+     * @param visit Callback receiving the point id and its distance in meters
+     */
+    template <typename Visitor>
+    void forEachWithin(double latitude, double longitude, double meters, Visitor visit) const {
+        if (pointIds.empty() || !std::isfinite(latitude) || !std::isfinite(longitude)) {
+            return;
+        }
+        const double deltaLatitude = meters / EARTH_RADIUS * 180.0 / M_PI;
+        const double widest = std::min(89.0, std::fabs(latitude) + deltaLatitude);
+        const double deltaLongitude = deltaLatitude / std::cos(widest * M_PI / 180.0);
+
+        forEachInCells(toMicrodegrees(latitude), toMicrodegrees(longitude),
+                       row(latitude - deltaLatitude), row(latitude + deltaLatitude),
+                       column(longitude - deltaLongitude), column(longitude + deltaLongitude), [&](unsigned int i, float d) {
+            if (d <= meters) {
+                visit(pointIds[i], (double)d);
+            }
+        });
+    }
+
+    /**
+     * @brief Collect all points within the given distance ordered by distance
+     * @param result Receives the points, only allocates if its capacity is too small
+     */
+    void within(double latitude, double longitude, double meters, std::vector<StopDistance>& result) const;
+
+    /**
+     * @brief Collect the k points closest to the given position ordered by distance
+     * @param result Receives the points, only allocates if its capacity is too small
+     */
+    void nearest(double latitude, double longitude, size_t k, std::vector<StopDistance>& result) const;
+
+    /**
+     * @brief Return the number of indexed points
+     */
+    size_t size() const { return pointIds.size(); }
+
+    /**
+     * @brief Equirectangular distance between two coordinates
+     * @return Distance in meters
+     */
+    static double distance(double latitude1, double longitude1, double latitude2, double longitude2) {
+        const double toRadians = M_PI / 180.0;
+        const double x = (longitude2 - longitude1) * toRadians * std::cos((latitude1 + latitude2) * 0.5 * toRadians);
+        const double y = (latitude2 - latitude1) * toRadians;
+        return EARTH_RADIUS * std::sqrt(x * x + y * y);
+    }
+};
+
+}
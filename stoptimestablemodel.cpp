@@ -63,6 +63,13 @@ int StopTimesTableModel::columnCount(const QModelIndex &) const
     }
 }
 
+QString StopTimesTableModel::stopName(const bht::StopTime &item) const
+{
+    // Look the stop up in place, copying it would copy all its strings for every painted cell
+    const bht::Stop *stop = network.findStop(item.stopId);
+    return stop != nullptr ? QString::fromStdString(stop->name) : QString();
+}
+
 QVariant StopTimesTableModel::data(const QModelIndex &index, int role) const
 {
     if (!index.isValid() || index.row() >= static_cast<int>(displayedStopTimes.size())) {
@@ -87,7 +94,7 @@ QVariant StopTimesTableModel::data(const QModelIndex &index, int role) const
             case 0:
                 return QString::number(item.stopSequence);
             case 1:
-                return QString(network.getStopById(item.stopId).name.c_str());
+                return stopName(item);
             case 2:
                 // Afficher l'heure de départ (plus logique pour un horaire)
                 return QString("%1:%2")
@@ -101,7 +108,7 @@ QVariant StopTimesTableModel::data(const QModelIndex &index, int role) const
             case 0:
                 return QString::number(item.stopSequence);
             case 1:
-                return QString(network.getStopById(item.stopId).name.c_str());
+                return stopName(item);
             case 2:
                 // Ankunftszeit
                 return QString("%1:%2")
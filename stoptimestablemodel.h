@@ -61,6 +61,11 @@ public:
     DisplayMode getDisplayMode() const { return displayMode; }
 
 private:
+    /**
+     * @brief Return the name of the stop of the given stop time
+     */
+    QString stopName(const bht::StopTime &item) const;
+
     /// Network instance to resolve stop ids to names
     const bht::Network &network;
 
@@ -0,0 +1,274 @@
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <future>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include "types.h"
+#include "network_snapshot.h"
+#include "live_network.h"
+#include "work_pool.h"
+
+using namespace bht;
+
+namespace {
+
+const unsigned int threadCount = 8;
+const unsigned int queriesPerThread = 300;
+
+typedef enum EQueryKind { QueryKind_TravelPlan, QueryKind_TravelPath, QueryKind_Neighbors, QueryKind_Transfers, QueryKind_StopTimes, QueryKind_Count } QueryKind;
+
+struct Query {
+  QueryKind kind;
+  std::string from;
+  std::string to;
+  GTFSTime time;
+};
+
+// Turn the result of a query into a string so results of different threads can be compared
+std::string runQuery(const Network& network, QueryContext* context, const Query& query) {
+  std::string result;
+  switch (query.kind) {
+  case QueryKind_TravelPlan:
+    for (const StopTime& stopTime : context ? network.getTravelPlanDepartingAt(*context, query.from, query.to, query.time)
+                                            : network.getTravelPlanDepartingAt(query.from, query.to, query.time)) {
+      result += stopTime.tripId + "@" + stopTime.stopId + "@" + std::to_string(stopTime.departureTime.hour * 60 + stopTime.departureTime.minute) + ";";
+    }
+    break;
+  case QueryKind_TravelPath:
+    for (const Stop& stop : context ? network.getTravelPath(*context, query.from, query.to) : network.getTravelPath(query.from, query.to)) {
+      result += stop.id + ";";
+    }
+    break;
+  case QueryKind_Neighbors: {
+    std::vector<std::string> ids;
+    for (const std::string& id : network.getNeighbors(query.from)) {
+      ids.push_back(id);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (const std::string& id : ids) {
+      result += id + ";";
+    }
+    break;
+  }
+  case QueryKind_Transfers:
+    for (const Stop& stop : network.getStopsForTransfer(query.from)) {
+      result += stop.id + ";";
+    }
+    break;
+  default:
+    for (const StopTime& stopTime : network.getStopTimesForTrip(query.to)) {
+      result += stopTime.stopId + ";";
+    }
+    break;
+  }
+  return result;
+}
+
+// N threads run a mixed workload against one shared snapshot; build with
+// -fsanitize=thread (make stresstest) to check for data races
+TEST(NetworkSnapshot, concurrentQueries) {
+  std::string inputDirectory{"/GTFSTest"};
+  NetworkSnapshot snapshot = NetworkSnapshot::load(inputDirectory);
+
+  std::vector<std::string> stopIds;
+  for (const auto& pair : snapshot->stops) {
+    stopIds.push_back(pair.first);
+  }
+  std::sort(stopIds.begin(), stopIds.end());
+  ASSERT_GT(stopIds.size(), 0);
+  ASSERT_GT(snapshot->trips.size(), 0);
+
+  std::mt19937 random(42);
+  std::vector<Query> queries;
+  for (unsigned int i = 0; i < queriesPerThread; i++) {
+    Query query;
+    query.kind = (QueryKind)(i % QueryKind_Count);
+    query.from = stopIds[random() % stopIds.size()];
+    query.to = query.kind == QueryKind_StopTimes ? snapshot->trips[random() % snapshot->trips.size()].id : stopIds[random() % stopIds.size()];
+    query.time = GTFSTime{.hour = (unsigned char)(5 + random() % 15), .minute = (unsigned char)(random() % 60), .second = 0};
+    queries.push_back(query);
+  }
+
+  // Expected results from a single thread
+  std::vector<std::string> expected;
+  for (const Query& query : queries) {
+    expected.push_back(runQuery(*snapshot, nullptr, query));
+  }
+
+  std::atomic<unsigned int> mismatches{0};
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t]() {
+      // Every thread gets its own copy of the snapshot handle, half of them bring their own context
+      NetworkSnapshot shared = snapshot;
+      QueryContext context;
+      for (unsigned int i = 0; i < queries.size(); i++) {
+        size_t index = (i * 7 + t * 31) % queries.size();
+        if (runQuery(*shared, t % 2 == 0 ? &context : nullptr, queries[index]) != expected[index]) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(mismatches.load(), 0u) << mismatches.load() << " concurrent query results differ from the single threaded results";
+}
+
+// Threads sharing a network with the query cache enabled get the same plans as without it
+TEST(NetworkSnapshot, cachedQueries) {
+  std::string inputDirectory{"/GTFSTest"};
+  Network network{inputDirectory};
+  network.enableQueryCache(1024 * 1024, 600);
+  NetworkSnapshot uncached = NetworkSnapshot::load(inputDirectory);
+  NetworkSnapshot cached{std::move(network)};
+
+  std::vector<std::string> stopIds;
+  for (const auto& pair : uncached->stops) {
+    stopIds.push_back(pair.first);
+  }
+  std::sort(stopIds.begin(), stopIds.end());
+
+  // A few popular connected pairs queried at times minutes apart
+  std::mt19937 random(7);
+  std::vector<std::pair<std::string, std::string>> pairs;
+  for (unsigned int attempt = 0; attempt < 10000 && pairs.size() < 10; attempt++) {
+    std::string from = stopIds[random() % stopIds.size()];
+    std::string to = stopIds[random() % stopIds.size()];
+    if (!uncached->getTravelPlanDepartingAt(from, to, GTFSTime{.hour = 8, .minute = 0, .second = 0}).empty()) {
+      pairs.push_back({from, to});
+    }
+  }
+  ASSERT_GT(pairs.size(), 0u);
+  std::vector<Query> queries;
+  for (unsigned int i = 0; i < queriesPerThread; i++) {
+    Query query;
+    query.kind = QueryKind_TravelPlan;
+    query.from = pairs[i % pairs.size()].first;
+    query.to = pairs[i % pairs.size()].second;
+    query.time = GTFSTime{.hour = 8, .minute = (unsigned char)(random() % 60), .second = 0};
+    queries.push_back(query);
+  }
+
+  // Only the arrival has to match, cached plans may differ in equally fast alternatives
+  auto arrivalOf = [](const std::vector<StopTime>& plan) {
+    return plan.empty() ? -1 : plan.back().arrivalTime.hour * 3600 + plan.back().arrivalTime.minute * 60 + plan.back().arrivalTime.second;
+  };
+  std::vector<int> expected;
+  for (const Query& query : queries) {
+    expected.push_back(arrivalOf(uncached->getTravelPlanDepartingAt(query.from, query.to, query.time)));
+  }
+
+  std::atomic<unsigned int> mismatches{0};
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t]() {
+      for (unsigned int i = 0; i < queries.size(); i++) {
+        size_t index = (i * 7 + t * 31) % queries.size();
+        if (arrivalOf(cached->getTravelPlanDepartingAt(queries[index].from, queries[index].to, queries[index].time)) != expected[index]) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  QueryCacheStatistics statistics = cached->getQueryCacheStatistics();
+  EXPECT_EQ(mismatches.load(), 0u) << mismatches.load() << " cached query results differ from the uncached results";
+  EXPECT_GT(statistics.hits, 0u) << "Repeated queries should be answered from the cache";
+  EXPECT_LE(statistics.bytes, 1024u * 1024u) << "Cache should stay within its memory budget";
+}
+
+// Copies of a snapshot share the same network
+TEST(NetworkSnapshot, share) {
+  std::string inputDirectory{"/GTFSTest"};
+  NetworkSnapshot snapshot = NetworkSnapshot::load(inputDirectory);
+  NetworkSnapshot copy = snapshot;
+
+  EXPECT_EQ(&*snapshot, &*copy) << "Copies of a snapshot should refer to the same network";
+  EXPECT_EQ(snapshot.share().use_count(), 3) << "Snapshot should be shared by both copies";
+}
+
+// Readers keep querying while the feed is reloaded and swapped in underneath them
+TEST(LiveNetwork, reloadWhileQuerying) {
+  std::string inputDirectory{"/GTFSTest"};
+  LiveNetwork live{NetworkSnapshot::load(inputDirectory)};
+  std::weak_ptr<const Network> old = live.current().share();
+
+  std::vector<std::string> stopIds;
+  for (const auto& pair : live.current()->stops) {
+    stopIds.push_back(pair.first);
+  }
+  std::sort(stopIds.begin(), stopIds.end());
+
+  std::mt19937 random(11);
+  std::vector<Query> queries;
+  for (unsigned int i = 0; i < queriesPerThread; i++) {
+    Query query;
+    query.kind = i % 2 == 0 ? QueryKind_TravelPlan : QueryKind_Neighbors;
+    query.from = stopIds[random() % stopIds.size()];
+    query.to = stopIds[random() % stopIds.size()];
+    query.time = GTFSTime{.hour = (unsigned char)(5 + random() % 15), .minute = (unsigned char)(random() % 60), .second = 0};
+    queries.push_back(query);
+  }
+  std::vector<std::string> expected;
+  for (const Query& query : queries) {
+    expected.push_back(runQuery(*live.current(), nullptr, query));
+  }
+
+  // The same feed is loaded again, so every query has the same answer on both networks
+  std::future<bool> reloaded = live.reload(inputDirectory);
+  std::atomic<bool> done{false};
+  std::atomic<unsigned int> mismatches{0};
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t]() {
+      for (unsigned int i = 0; !done || i < queries.size(); i++) {
+        size_t index = (i * 7 + t * 31) % queries.size();
+        if (runQuery(*live.current(), nullptr, queries[index]) != expected[index]) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  EXPECT_TRUE(reloaded.get()) << "Reload of a valid feed should publish it";
+  done = true;
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(mismatches.load(), 0u) << mismatches.load() << " query results differ during the reload";
+  EXPECT_TRUE(old.expired()) << "Old network should be freed once no reader holds it";
+  EXPECT_FALSE(live.reload("/nonexistent").get()) << "Reload of a missing feed should keep the current network";
+  EXPECT_GT(live.current()->stops.size(), 0u);
+}
+
+// The first exception of a task stops the pool and reaches the caller after all workers joined
+TEST(WorkStealingPool, rethrowsTaskExceptions) {
+  for (unsigned int threads : {1u, 4u}) {
+    std::atomic<size_t> done{0};
+    bool thrown = false;
+    try {
+      WorkStealingPool::run(1000, threads, [&](size_t task, unsigned int) {
+        if (task == 10) {
+          throw std::runtime_error("task 10");
+        }
+        done++;
+      });
+    } catch (const std::runtime_error& error) {
+      thrown = std::string(error.what()) == "task 10";
+    }
+    EXPECT_TRUE(thrown) << threads << " threads";
+    EXPECT_LT(done.load(), 999u) << "Tasks after the exception should not start, " << threads << " threads";
+  }
+}
+
+} // namespace
@@ -0,0 +1,220 @@
+#pragma once
+#include "types.h"
+#include <climits>
+#include <cstdint>
+#include <type_traits>
+
+namespace bht {
+
+/// @brief Marker for a missing entry in the dense index tables
+constexpr unsigned int INVALID_INDEX = static_cast<unsigned int>(-1);
+
+/// @brief Marker for a stop that has not been reached by a search
+constexpr int INFINITE_TIME = INT_MAX;
+
+/// @brief Radius in meters within which walking footpaths between stops are generated
+constexpr double DEFAULT_FOOTPATH_RADIUS = 200.0;
+
+/// @brief Walking speed in meters per second used for generated footpaths
+constexpr double WALKING_SPEED = 1.2;
+
+/// @brief Marker for a pair the pathways link but give no way from one to the other, in the station walking time matrices
+constexpr uint16_t UNREACHABLE_PATHWAY = 0xFFFE;
+
+/// @brief Marker for a pair the pathways do not link at all, in the station walking time matrices
+constexpr uint16_t UNLINKED_PATHWAY = 0xFFFF;
+
+/// @brief Speed in meters per second above which the A* bound treats a hop as misplaced stops
+constexpr double MAX_HEURISTIC_SPEED = 100.0;
+
+/// @brief Number of landmarks selected by Network::preprocessLandmarks by default
+constexpr unsigned int DEFAULT_LANDMARK_COUNT = 16;
+
+/// @brief Entry of the landmark tables for travel times that are unknown, unreachable or too long
+constexpr uint16_t SATURATED_LANDMARK = 0xFFFF;
+
+/**
+ * Convert a GTFS time to seconds after midnight of the service day
+ */
+inline int toSeconds(const GTFSTime& time) {
+  return time.hour * 3600 + time.minute * 60 + time.second;
+}
+
+/**
+ * Convert seconds after midnight of the service day to a GTFS time
+ */
+inline GTFSTime fromSeconds(int seconds) {
+  GTFSTime result = {
+    .hour = (unsigned char)(seconds / 3600),
+    .minute = (unsigned char)((seconds / 60) % 60),
+    .second = (unsigned char)(seconds % 60)
+  };
+  return result;
+}
+
+/**
+ * Bits of Network::tripFlags besides the transport mode of the trip. A query
+ * rejects trips having any of the flags compiled from its options.
+ */
+typedef enum ETripFlag {
+  TripFlag_NotWheelchairAccessible = 1 << 16,  // not known to be wheelchair accessible
+  TripFlag_NoBikes = 1 << 17,                  // bikes not known to be allowed
+  TripFlag_Canceled = 1 << 18                  // canceled by a real-time update
+} TripFlag;
+
+/**
+ * Compact copy of a single stop time of a trip, used in the routing hot paths.
+ * The events of a trip are stored contiguously and ordered by stop sequence.
+ */
+typedef struct STripEvent {
+  unsigned int stop;  // dense stop index or INVALID_INDEX
+  int arrival;        // seconds after midnight
+  int departure;      // seconds after midnight
+} TripEvent;
+
+/**
+ * Reference from a stop to a trip calling at it
+ */
+typedef struct SStopEvent {
+  unsigned int trip;      // index into Network::trips
+  unsigned int position;  // position of the stop inside the trip
+} StopEvent;
+
+/**
+ * Entry of the departure board of a stop
+ */
+typedef struct SDeparture {
+  int time;               // departure in seconds after midnight
+  unsigned int trip;      // index into Network::trips
+  unsigned int position;  // position of the stop inside the trip
+} Departure;
+
+/**
+ * Departure of a headway based trip at a stop. Instead of one entry per run
+ * only the first and last run are stored, the runs in between follow every
+ * headway seconds.
+ */
+typedef struct SFrequencyDeparture {
+  int first;              // departure of the first run in seconds after midnight
+  int last;               // departure of the last run in seconds after midnight
+  int headway;            // seconds between two runs
+  unsigned int trip;      // index into Network::trips of the template trip
+  unsigned int position;  // position of the stop inside the trip
+} FrequencyDeparture;
+
+/**
+ * Return the departure of the first run at or after the given time, INFINITE_TIME if there is none
+ */
+inline int nextRun(const FrequencyDeparture& departure, int time) {
+  if (time <= departure.first) {
+    return departure.first;
+  }
+  const int run = departure.first + (time - departure.first + departure.headway - 1) / departure.headway * departure.headway;
+  return run <= departure.last ? run : INFINITE_TIME;
+}
+
+/**
+ * Return the arrival of the last run at or before the given time, INFINITE_TIME if there is none.
+ * Used with the arrival tables, where first and last are arrival times.
+ */
+inline int previousRun(const FrequencyDeparture& arrival, int time) {
+  if (time >= arrival.last) {
+    return arrival.last;
+  }
+  if (time < arrival.first) {
+    return INFINITE_TIME;
+  }
+  return arrival.first + (time - arrival.first) / arrival.headway * arrival.headway;
+}
+
+/**
+ * Walking connection from one stop to another, including the time needed to change
+ */
+typedef struct SFootpath {
+  unsigned int stop;  // dense index of the target stop
+  int duration;       // seconds
+} Footpath;
+
+/**
+ * Reference from a stop to a route pattern calling at it
+ */
+typedef struct SPatternEvent {
+  unsigned int pattern;   // route pattern index
+  unsigned int position;  // position of the stop inside the pattern
+} PatternEvent;
+
+/**
+ * Precomputed transfer of the trip-based search: the trip and position to board
+ * after leaving another trip at a certain position
+ */
+typedef struct STripTransfer {
+  unsigned int trip;      // index into Network::trips
+  unsigned int position;  // position of the boarding stop inside the trip
+} TripTransfer;
+
+/**
+ * Part of a trip reached by the trip-based search. The trip is boarded at from
+ * and can be left at the positions after it up to and including to. parent is
+ * the segment the trip was reached from, left at parentPosition, or
+ * INVALID_INDEX for trips boarded at the start of the search.
+ */
+typedef struct STripSegment {
+  unsigned int trip;
+  unsigned int from;
+  unsigned int to;
+  unsigned int parent;
+  unsigned int parentPosition;
+} TripSegment;
+
+/**
+ * Transfer rule from transfers.txt which only applies to certain routes or trips.
+ * Unset route and trip references are INVALID_INDEX and match every trip.
+ */
+typedef struct STransferRule {
+  unsigned int toStop;
+  unsigned int fromRoute;
+  unsigned int toRoute;
+  unsigned int fromTrip;
+  unsigned int toTrip;
+  TransferType type;
+  int minTransferTime;  // seconds
+} TransferRule;
+
+/**
+ * Search label of a stop.
+ *
+ * The ride part describes the earliest arrival by a vehicle: the trip and the
+ * positions it was boarded at parentStop and left at this stop. The ready part
+ * is the earliest time a vehicle can be boarded here, after changing trips or
+ * walking over from the stop readyFrom whose ride arrival it is based on.
+ * readyFrom is INVALID_INDEX for the start of a search. For headway based
+ * trips shift holds the offset of the ridden run against the template times.
+ */
+typedef struct SStopLabel {
+  int arrival;
+  unsigned int parentStop;
+  unsigned int trip;
+  unsigned int boardPosition;
+  unsigned int alightPosition;
+  int ready;
+  unsigned int readyFrom;
+  int shift;
+} StopLabel;
+
+/**
+ * Priority queue entry of the routing searches. Kept trivially copyable and
+ * small so heap operations only move 8 bytes.
+ */
+typedef struct SQueueEntry {
+  int time;
+  unsigned int stop;
+} QueueEntry;
+
+inline bool operator>(const QueueEntry& a, const QueueEntry& b) {
+  return a.time > b.time;
+}
+
+static_assert(sizeof(QueueEntry) < 16, "queue entries must stay small");
+static_assert(std::is_trivially_copyable<QueueEntry>::value, "queue entries must be trivially copyable");
+
+}
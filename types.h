@@ -59,6 +59,19 @@ typedef struct SCalendar {
   GTFSDate endDate;
 } Calendar;
 
+/**
+ * Headway based service of a trip, the stop times of the trip are a template
+ * repeated every headwaySecs seconds between startTime and endTime.
+ * https://gtfs.org/schedule/reference/#frequenciestxt
+ */
+typedef struct SFrequency {
+  std::string tripId;
+  GTFSTime startTime;
+  GTFSTime endTime;
+  unsigned int headwaySecs;
+  bool exactTimes;
+} Frequency;
+
 /**
  * Describes levels in a station. Useful in conjunction with pathways.txt.
  * https://gtfs.org/schedule/reference/#levelstxt
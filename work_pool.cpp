@@ -0,0 +1,102 @@
+#include "work_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bht {
+
+unsigned int WorkStealingPool::getWorkerCount(size_t taskCount, unsigned int threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return (unsigned int)std::max<size_t>(1, std::min<size_t>(threadCount, taskCount));
+}
+
+void WorkStealingPool::run(size_t taskCount, unsigned int threadCount, const std::function<void(size_t task, unsigned int worker)>& work) {
+    const unsigned int workerCount = getWorkerCount(taskCount, threadCount);
+    if (workerCount == 1) {
+        for (size_t task = 0; task < taskCount; ++task) {
+            work(task, 0);
+        }
+        return;
+    }
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    for (unsigned int w = 0; w < workerCount; ++w) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t task = 0; task < taskCount; ++task) {
+        queues[task % workerCount]->tasks.push_back(task);
+    }
+
+    // No tasks are added while running, so a worker is done once every queue was empty
+    auto next = [&](unsigned int worker, size_t& task) {
+        {
+            std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+            if (!queues[worker]->tasks.empty()) {
+                task = queues[worker]->tasks.front();
+                queues[worker]->tasks.pop_front();
+                return true;
+            }
+        }
+        for (;;) {
+            unsigned int victim = workerCount;
+            size_t most = 0;
+            for (unsigned int w = 0; w < workerCount; ++w) {
+                std::lock_guard<std::mutex> lock(queues[w]->mutex);
+                if (queues[w]->tasks.size() > most) {
+                    most = queues[w]->tasks.size();
+                    victim = w;
+                }
+            }
+            if (victim == workerCount) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(queues[victim]->mutex);
+            if (!queues[victim]->tasks.empty()) {
+                task = queues[victim]->tasks.back();
+                queues[victim]->tasks.pop_back();
+                return true;
+            }
+        }
+    };
+
+    // The first exception stops all workers and is rethrown by the calling thread
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> workers;
+    for (unsigned int w = 0; w < workerCount; ++w) {
+        workers.emplace_back([&, w]() {
+            size_t task;
+            while (!failed.load(std::memory_order_relaxed) && next(w, task)) {
+                try {
+                    work(task, w);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(failureMutex);
+                    if (!failure) {
+                        failure = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+}
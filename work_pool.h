@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+namespace bht {
+
+/**
+ * Runs a fixed set of independent tasks on a group of threads.
+ *
+ * Tasks are dealt out round-robin in the given order, so callers should pass
+ * expensive tasks first. Every worker takes tasks from the front of its own
+ * queue; once that is empty it steals from the back of the fullest other
+ * queue, which evens out tasks of very different cost. If a task throws, no
+ * further tasks are started and run() rethrows the first exception once all
+ * workers have finished.
+ */
+class WorkStealingPool {
+  public:
+    /**
+     * @brief Run tasks 0 to taskCount - 1 and return once all are done or one has thrown
+     * @param taskCount Number of tasks
+     * @param threadCount Number of worker threads, 0 uses one per hardware thread
+     * @param work Called with the task and the worker running it, worker is below the thread count
+     */
+    static void run(size_t taskCount, unsigned int threadCount, const std::function<void(size_t task, unsigned int worker)>& work);
+
+    /**
+     * @brief Return the number of workers run() uses for the given thread count and tasks
+     */
+    static unsigned int getWorkerCount(size_t taskCount, unsigned int threadCount);
+};
+
+}